@@ -1,21 +1,378 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <math.h>
+#include <string.h>
 #include <assert.h>
-#include <jansson.h>
 #include "game_board.h"
 #include "util.h"
 #include "alphabeta.h"
 #include "graphs.h"
+#include "bitboard.h"
+#include "tablebase.h"
+#include "arena.h"
+#include "treewriter.h"
 
 static const short ALPHA_MIN = -100;
 static const short BETA_MAX = 100;
 
-static void saveABNodeJSON(const ABNode * node, UnscoredState state, const char * filePath);
-static json_t * ABNodeToJSON(const ABNode * node, UnscoredState state);
+
+// Leaf evaluations are remembered in a small direct-mapped cache so that leaves reached
+// again through a different move order cost a single lookup.
+// It is separate from any transposition table and survives between searches,
+// since the static evaluation depends only on the position.
+#define LEAF_CACHE_SIZE (1 << 16) // must be a power of 2
+
+typedef struct LeafCacheEntry {
+    Bitboard board;
+    short moverBoxes;
+    bool isValid;
+} LeafCacheEntry;
+
+typedef struct LeafCacheStats {
+    int lookups;
+    int hits;
+    unsigned long long missMicros; // time spent evaluating the leaves which weren't cached
+} LeafCacheStats;
+
+static LeafCacheEntry leafCache[LEAF_CACHE_SIZE];
+static LeafCacheStats leafCacheStats;
+
+// The score of the game at the root of the current search. Once either player has
+// WINNING_SCORE boxes the result can't change, so the margin isn't searched for.
+typedef struct ABGameScore {
+    short maximizerScore;
+    short minimizerScore;
+    short rootBoxesLeft;
+    bool isUndecided; // cutoffs only make sense when the root isn't decided already
+} ABGameScore;
+
+static ABGameScore abGameScore;
+
+// The best move found at each node, tried first the next time the same position is searched.
+// Like the leaf cache it is direct-mapped and survives between searches.
+#define BEST_MOVE_TABLE_SIZE (1 << 16) // must be a power of 2
+#define AB_SAFE_MOVE_STAGE_SIZE 2 // safe moves tried before the graph is built
+
+typedef struct BestMoveEntry {
+    Bitboard board;
+    Edge move;
+    bool isForced; // it was the only move full generation gave
+    bool isValid;
+} BestMoveEntry;
+
+typedef struct ABMoveGenStats {
+    int stagedCutoffs;   // nodes that cut off before any graph was built
+    int fullGenerations; // nodes that needed getGraphsPotentialMoves
+} ABMoveGenStats;
+
+static BestMoveEntry bestMoveTable[BEST_MOVE_TABLE_SIZE];
+static ABMoveGenStats abMoveGenStats;
+
+ABSelectiveSettings abSelectiveSettings = {
+    .isLMREnabled = false,
+    .lmrMinDepth = 3,
+    .lmrMinMoveIndex = 3,
+    .lmrReduction = 1,
+
+    .isProbCutEnabled = false,
+    .probCutMinDepth = 4,
+    .probCutDepth = 1,
+    .probCutMargin = 3
+};
+
+// How often each selective feature fired and how many nodes it searched.
+typedef struct ABSelectiveStats {
+    int lmrReductions;
+    int lmrReSearches;
+    int lmrNodes;       // nodes searched by reduced searches
+    int lmrReSearchNodes;
+    int probCutTries;
+    int probCutCutoffs;
+    int probCutNodes;   // nodes searched by shallow searches
+} ABSelectiveStats;
+
+static ABSelectiveStats abSelectiveStats;
+
+ABSearchStats abSearchStats;
+const char * abStatsPath = NULL;
+
+static unsigned long long getABStatsTimeMicros() {
+    // Reading the clock around every leaf and move generation costs more than they do, so
+    // abSearchStats only times them when its statistics are written out. Otherwise this is always 0.
+    return abStatsPath != NULL ? getTimeMicros() : 0;
+}
+
+// How far the node being searched is from the root, for abSearchStats.nodesAtPly.
+static short abPly;
+
+// When getABMove is asked to save its tree, each node is written once its value is known.
+// Nodes keep the id they were given on the way down, so children can refer to their parent.
+TreeWriterSettings abTreeSettings = { "abTree.json", 6, 0 };
+
+static TreeWriter abTreeWriter;
+static int abTreeParentId;
+static short abTreeDepth;
+
+// All of a search's scratch memory (move lists, graphs, tree nodes) comes from this arena.
+// doAlphaBetaStack gives back what a node used when it returns, and the whole arena is reset
+// when a search starts, so nothing is malloc'd or freed while searching.
+#define AB_ARENA_BLOCK_SIZE (256 * 1024)
+
+static Arena abArena;
+
+static bool getDecidedValue(const UnscoredState * state, short totalBoxesTaken, short * value) {
+    // Sets value for a won node above rootBoxesLeft, which no undecided node can reach, and for a lost
+    // node below 0. The boxes the winner has taken since the root rank decided nodes among themselves,
+    // so that the bigger of two wins is still chosen. Both stay inside ALPHA_MIN and BETA_MAX.
+    if (!abGameScore.isUndecided)
+        return false;
+
+    short boxesLeft = getNumBoxesLeft(state);
+    short minimizerBoxesTaken = abGameScore.rootBoxesLeft - boxesLeft - totalBoxesTaken;
+
+    if (abGameScore.maximizerScore + totalBoxesTaken >= WINNING_SCORE) {
+        *value = abGameScore.rootBoxesLeft + 1 + totalBoxesTaken;
+        return true;
+    }
+    else if (abGameScore.minimizerScore + minimizerBoxesTaken >= WINNING_SCORE) {
+        *value = -1 - minimizerBoxesTaken;
+        return true;
+    }
+
+    return false;
+}
+
+static short getCachedStaticEvaluation(const Bitboard * board) {
+    LeafCacheEntry * entry = &leafCache[getBitboardHash(board) & (LEAF_CACHE_SIZE - 1)];
+    leafCacheStats.lookups++;
+
+    if (entry->isValid && entry->board.lo == board->lo && entry->board.hi == board->hi) {
+        leafCacheStats.hits++;
+        return entry->moverBoxes;
+    }
+
+    unsigned long long startTime = getTimeMicros();
+    short moverBoxes = getBitboardStaticEvaluation(board);
+    leafCacheStats.missMicros += getTimeMicros() - startTime;
+
+    // Whatever was in the slot before is simply replaced.
+    entry->board = *board;
+    entry->moverBoxes = moverBoxes;
+    entry->isValid = true;
+
+    return moverBoxes;
+}
+
+static short getHeuristicValue(const UnscoredState * state, bool isMaximizer) {
+    // Returns how many of the boxes left on the board the maximizer can expect to get.
+    // Works on a bitboard copy of the state so that no graph needs to be built.
+    // Positions covered by the tablebase get their exact value instead of an estimate.
+    Bitboard board;
+    unscoredStateToBitboard(&board, state);
+
+    short moverBoxes;
+    short netScore;
+    if (getTablebaseMaxFreeEdges() >= 0)
+        abSearchStats.tablebaseProbes++;
+
+    if (probeTablebase(&board, &netScore)) {
+        abSearchStats.tablebaseHits++;
+        moverBoxes = (getBitboardNumBoxesLeft(&board) + netScore) / 2;
+    }
+    else
+        moverBoxes = getCachedStaticEvaluation(&board);
+
+    if (isMaximizer)
+        return moverBoxes;
+    else
+        return getBitboardNumBoxesLeft(&board) - moverBoxes;
+}
+
+static short doAlphaBetaStack(UnscoredState * state, short depth, int * nodesVisitedCount, int * branchesPrunedCount, bool isRoot, double alpha, double beta, Edge move, short totalBoxesTaken, bool isMaximizer, short value);
+
+static bool getCaptureSequenceValue(UnscoredState * state, short depth, int * nodesVisitedCount, int * branchesPrunedCount, double alpha, double beta, short totalBoxesTaken, bool isMaximizer, short * value) {
+    // Quiescence for forced chains: the captures available are played out as macro-moves, so the
+    // search never stops in the middle of a capture sequence and walks no chain one box at a time.
+    // Returns false when there is nothing to capture.
+    Bitboard board;
+    unscoredStateToBitboard(&board, state);
+
+    MacroMove macroMoves[MAX_MACRO_MOVES];
+    short numMacroMoves = getBitboardMacroMoves(&board, macroMoves);
+    if (numMacroMoves == 0)
+        return false;
+
+    // Free captures don't use up any depth, but choosing whether to double-deal costs a ply.
+    if (numMacroMoves > 1)
+        depth = max(depth - 1, 0);
+
+    UnscoredState preCaptureState = *state;
+    *value = isMaximizer ? ALPHA_MIN : BETA_MAX;
+
+    for (short i=0; i < numMacroMoves; i++) {
+        const MacroMove * macroMove = &macroMoves[i];
+        makeMacroMove(&board, macroMove);
+        bitboardToUnscoredState(state, &board);
+        unmakeMacroMove(&board, macroMove);
+
+        bool childIsMaximizer = macroMove->keepsTurn ? isMaximizer : !isMaximizer;
+        abPly++;
+        short v = doAlphaBetaStack(state, depth, nodesVisitedCount, branchesPrunedCount, false, alpha, beta, NO_EDGE,
+            isMaximizer ? totalBoxesTaken + macroMove->numBoxes : totalBoxesTaken,
+            childIsMaximizer, childIsMaximizer ? ALPHA_MIN : BETA_MAX);
+        abPly--;
+
+        if (isMaximizer) {
+            *value = max(*value, v);
+            alpha = max(alpha, v);
+        }
+        else {
+            *value = min(*value, v);
+            beta = min(beta, v);
+        }
+
+        if (beta <= alpha && i < numMacroMoves - 1) {
+            *branchesPrunedCount += 1;
+            break;
+        }
+    }
+
+    *state = preCaptureState;
+    return true;
+}
+
+static short getSafeMoves(const Bitboard * board, Edge * moves, short maxMoves, Edge skip) {
+    // Fills moves with up to maxMoves moves which give nothing away: every box next to the edge
+    // still has at least 2 free edges afterwards.
+    short numMoves = 0;
+
+    for (Edge e=0; e < NUM_EDGES && numMoves < maxMoves; e++) {
+        if (e == skip || isBitboardEdgeTaken(board, e))
+            continue;
+
+        const Box * edgeBoxes = getEdgeBoxes(e);
+        bool isSafe = true;
+        for (short i=0; i < 2; i++) {
+            if (edgeBoxes[i] != NO_BOX && getBitboardBoxNumTakenEdges(board, edgeBoxes[i]) >= 2)
+                isSafe = false;
+        }
+
+        if (isSafe)
+            moves[numMoves++] = e;
+    }
+
+    return numMoves;
+}
+
+static short searchABChild(UnscoredState * state, Edge move, short childDepth, int * nodesVisitedCount, int * branchesPrunedCount, double alpha, double beta, short totalBoxesTaken, bool isMaximizer) {
+    // Plays move, searches the position after it and takes the move back.
+    short boxesTaken = howManyBoxesDoesMoveComplete(state, move);
+    setEdgeTaken(state, move); // now it's a postMoveState
+
+    // Completing a box means moving again.
+    bool childIsMaximizer = boxesTaken > 0 ? isMaximizer : !isMaximizer;
+    short childTotalBoxesTaken = isMaximizer ? totalBoxesTaken + boxesTaken : totalBoxesTaken;
+
+    abPly++;
+    short v = doAlphaBetaStack(state, childDepth, nodesVisitedCount, branchesPrunedCount, false, alpha, beta, move,
+        childTotalBoxesTaken, childIsMaximizer, childIsMaximizer ? ALPHA_MIN : BETA_MAX);
+    abPly--;
+
+    setEdgeFree(state, move); // reset the state
+    return v;
+}
+
+static bool isLateMoveReducible(short depth, short moveIndex, short numPotentialMoves) {
+    const ABSelectiveSettings * settings = &abSelectiveSettings;
+    return settings->isLMREnabled && numPotentialMoves > 1 &&
+        depth >= settings->lmrMinDepth && moveIndex >= settings->lmrMinMoveIndex;
+}
+
+static short searchABLateMove(UnscoredState * state, Edge move, short childDepth, int * nodesVisitedCount, int * branchesPrunedCount, double alpha, double beta, short totalBoxesTaken, bool isMaximizer) {
+    // Late-move reduction: moves ordered this late rarely turn out best, so they are searched less deeply
+    // at first. Only a move that beats the bound it was searched against is searched again in full.
+    short reducedDepth = max(childDepth - abSelectiveSettings.lmrReduction, 0);
+    int nodesBefore = *nodesVisitedCount;
+    short v = searchABChild(state, move, reducedDepth, nodesVisitedCount, branchesPrunedCount, alpha, beta, totalBoxesTaken, isMaximizer);
+    abSelectiveStats.lmrReductions++;
+    abSelectiveStats.lmrNodes += *nodesVisitedCount - nodesBefore;
+
+    if ((isMaximizer && v > alpha) || (!isMaximizer && v < beta)) {
+        nodesBefore = *nodesVisitedCount;
+        v = searchABChild(state, move, childDepth, nodesVisitedCount, branchesPrunedCount, alpha, beta, totalBoxesTaken, isMaximizer);
+        abSelectiveStats.lmrReSearches++;
+        abSelectiveStats.lmrReSearchNodes += *nodesVisitedCount - nodesBefore;
+    }
+
+    return v;
+}
+
+static bool getProbCutValue(UnscoredState * state, short depth, int * nodesVisitedCount, int * branchesPrunedCount, double alpha, double beta, short totalBoxesTaken, bool isMaximizer, short * value) {
+    // ProbCut: if a shallow search already clears the bound by the margin, the deep search most likely
+    // would too, so the node is cut off straight away. Returns false when the node has to be searched.
+    const ABSelectiveSettings * settings = &abSelectiveSettings;
+    if (!settings->isProbCutEnabled || depth < settings->probCutMinDepth || settings->probCutDepth >= depth)
+        return false;
+
+    // Only a bound that can be cleared is worth testing.
+    double bound = isMaximizer ? beta + settings->probCutMargin : alpha - settings->probCutMargin;
+    if (bound <= ALPHA_MIN + 1 || bound >= BETA_MAX - 1)
+        return false;
+
+    abSelectiveStats.probCutTries++;
+    int nodesBefore = *nodesVisitedCount;
+
+    // A null window around the bound is all the shallow search needs.
+    double shallowAlpha = isMaximizer ? bound - 1 : bound;
+    double shallowBeta = isMaximizer ? bound : bound + 1;
+    short v = doAlphaBetaStack(state, settings->probCutDepth, nodesVisitedCount, branchesPrunedCount, false, shallowAlpha, shallowBeta, NO_EDGE,
+        totalBoxesTaken, isMaximizer, isMaximizer ? ALPHA_MIN : BETA_MAX);
+    abSelectiveStats.probCutNodes += *nodesVisitedCount - nodesBefore;
+
+    if ((isMaximizer && v >= bound) || (!isMaximizer && v <= bound)) {
+        // Only the bound the parent searched against is claimed, not the shallow value.
+        abSelectiveStats.probCutCutoffs++;
+        *value = isMaximizer ? beta : alpha;
+        return true;
+    }
+
+    return false;
+}
+
+static void recordABCutoff(short moveIndex) {
+    abSearchStats.cutoffs++;
+    abSearchStats.cutoffsAtMoveIndex[min(moveIndex, AB_STATS_MAX_MOVE_INDEX - 1)]++;
+}
+
+static bool updateABNodeValue(bool isMaximizer, short v, Edge move, short * value, Edge * bestMove, double * alpha, double * beta, int * branchesPrunedCount) {
+    // Takes the value of a child into account. Returns true if the rest of the children can be pruned.
+    if (isMaximizer) {
+        if (v > *value) {
+            *value = v;
+            *bestMove = move;
+        }
+        *alpha = max(*alpha, v);
+    }
+    else { // node is minimizer
+        if (v < *value) {
+            *value = v;
+            *bestMove = move;
+        }
+        *beta = min(*beta, v);
+    }
+
+    if (*beta <= *alpha) {
+        *branchesPrunedCount += 1;
+        log_debug("Pruned branch with %s cutoff!\n", isMaximizer ? "beta" : "alpha");
+        return true;
+    }
+
+    return false;
+}
 
 static ABNode * newABRootNode(const UnscoredState * rootState) {
-    ABNode * node = (ABNode *)malloc(sizeof(ABNode));
+    ABNode * node = (ABNode *)arenaAlloc(&abArena, sizeof(ABNode));
     
     node->alpha = ALPHA_MIN;
     node->beta = BETA_MAX;
@@ -24,6 +381,7 @@ static ABNode * newABRootNode(const UnscoredState * rootState) {
     //node->numPotentialMoves = getFreeEdges(rootState, node->potentialMoves);
     node->parent = NULL;
     node->child = NULL;
+    node->lastChild = NULL;
     node->sibling = NULL;
     node->numChildren = 0;
 
@@ -34,7 +392,7 @@ static ABNode * newABRootNode(const UnscoredState * rootState) {
 }
 
 static ABNode * newABNode(ABNode * parent, Edge move, const UnscoredState * preMoveState) {
-    ABNode * node = (ABNode *)malloc(sizeof(ABNode));
+    ABNode * node = (ABNode *)arenaAlloc(&abArena, sizeof(ABNode));
 
     node->alpha = parent->alpha;
     node->beta = parent->beta;
@@ -47,6 +405,7 @@ static ABNode * newABNode(ABNode * parent, Edge move, const UnscoredState * preM
 
     node->parent = parent;
     node->child = NULL;
+    node->lastChild = NULL;
     node->sibling = NULL;
     node->numChildren = 0;
 
@@ -63,32 +422,14 @@ static ABNode * newABNode(ABNode * parent, Edge move, const UnscoredState * preM
     return node;
 }
 
-static void freeABNode(ABNode * node) {
-    if (node->numChildren != 0) { // recursively free it's children
-        ABNode * currentChild = node->child;
-        ABNode * nextChild;
-
-        do {
-            nextChild = currentChild->sibling;
-            freeABNode(currentChild);
-        } while ((currentChild = nextChild) != NULL);
-    }
-
-    free(node);
-}
-
 static void addChildToABNode(ABNode * parentNode, ABNode * childNode) {
+    // Nodes live in abArena so they are never freed one by one.
     if (parentNode->child == NULL)
         parentNode->child = childNode;
-    else {
-        ABNode * otherChild = parentNode->child;
-        // Walk to the end of the linked list
-        while(otherChild->sibling != NULL)
-            otherChild = otherChild->sibling;
-
-        otherChild->sibling = childNode;
-    }
+    else
+        parentNode->lastChild->sibling = childNode;
 
+    parentNode->lastChild = childNode;
     parentNode->numChildren += 1;
 }
 
@@ -107,31 +448,13 @@ static short doAlphaBeta(ABNode * node, UnscoredState * state, short depth, int
     *nodesVisitedCount += 1;
 
     short numFreeEdges = getNumFreeEdges(state);
-    if (depth == 0 || numFreeEdges == 0) { // Node is terminal
+    bool isSolved = !isRoot && numFreeEdges <= getTablebaseMaxFreeEdges(); // the tablebase knows the exact value
+    if (depth == 0 || numFreeEdges == 0 || isSolved) { // Node is terminal
         log_debug("Depth is 0...\n");
         short score = 0;
 
-        if (depth == 0 && numFreeEdges > 0) { // Compute a heuristic value for the node
-            SCGraph graph;
-            unscoredStateToSCGraph(&graph, state);
-
-            short initRemainingNodes = getNumNodesLeftToCapture(&graph);
-
-            // While urgent moves exist, make them.
-            Edge urgentMovesBuf[2];
-            while(getSuperGraphUrgentMoves(&graph, urgentMovesBuf) == 1)
-                removeConnectionEdge(&graph, urgentMovesBuf[0]);
-
-            short finalRemainingNodes = getNumNodesLeftToCapture(&graph);
-            short nodesTaken = initRemainingNodes - finalRemainingNodes;
-
-            if (node->isMaximizer)
-                score += nodesTaken;
-
-            // Then assume we get half of what's left
-            score += (int)finalRemainingNodes/2.0;
-            freeAdjLists(&graph);
-        }
+        if (numFreeEdges > 0) // Compute a heuristic value for the node
+            score += getHeuristicValue(state, node->isMaximizer);
 
         // Count up the tree the number of boxes that have been taken.
         do {
@@ -269,219 +592,250 @@ static short doAlphaBeta(ABNode * node, UnscoredState * state, short depth, int
         return node->value;
 }
 
-static short doAlphaBetaStack(UnscoredState * state, short depth, int * nodesVisitedCount, int * branchesPrunedCount, bool isRoot, double alpha, double beta, Edge move, short totalBoxesTaken, bool isMaximizer, short value) {
+static short searchABNode(UnscoredState * state, short depth, int * nodesVisitedCount, int * branchesPrunedCount, bool isRoot, double alpha, double beta, Edge move, short totalBoxesTaken, bool isMaximizer, short value) {
     // If isRoot, returns the best move. Else returns a score for the node.
    
     //printUnscoredState(state);
     //log_log("doAlphaBetaStack called with depth: %d, isRoot: %d, alpha: %G, beta: %G, move: %d, totalBoxesTaken: %d, isMaximizer: %d, value: %d\n", depth, isRoot, alpha, beta, move, totalBoxesTaken, isMaximizer, value);
     *nodesVisitedCount += 1;
 
+    short ply = min(abPly, AB_STATS_MAX_PLY - 1);
+    abSearchStats.nodesAtPly[ply]++;
+    abSearchStats.deepestPly = max(abSearchStats.deepestPly, ply);
 
-    short numFreeEdges = getNumFreeEdges(state);
-    if (depth == 0 || numFreeEdges == 0) { // Node is terminal
-        short score = totalBoxesTaken;
-
-        if (depth == 0 && numFreeEdges > 0) { // Compute a heuristic value for the node
-            SCGraph graph;
-            unscoredStateToSCGraph(&graph, state);
-
-            short initRemainingNodes = getNumNodesLeftToCapture(&graph);
+    short decidedValue;
+    if (!isRoot && getDecidedValue(state, totalBoxesTaken, &decidedValue))
+        return decidedValue;
 
-            // While urgent moves exist, make them.
-            Edge urgentMovesBuf[2];
-            while(getSuperGraphUrgentMoves(&graph, urgentMovesBuf) == 1)
-                removeConnectionEdge(&graph, urgentMovesBuf[0]);
+    short captureValue;
+    if (!isRoot && getCaptureSequenceValue(state, depth, nodesVisitedCount, branchesPrunedCount, alpha, beta, totalBoxesTaken, isMaximizer, &captureValue))
+        return captureValue;
 
-            short finalRemainingNodes = getNumNodesLeftToCapture(&graph);
-            short nodesTaken = initRemainingNodes - finalRemainingNodes;
-
-            if (isMaximizer)
-                score += nodesTaken;
+    short numFreeEdges = getNumFreeEdges(state);
+    bool isSolved = !isRoot && numFreeEdges <= getTablebaseMaxFreeEdges(); // the tablebase knows the exact value
+    if (depth == 0 || numFreeEdges == 0 || isSolved) { // Node is terminal
+        short score = totalBoxesTaken;
 
-            // Then assume we get half of what's left
-            score += (int)finalRemainingNodes/2.0;
-            freeAdjLists(&graph);
+        if (numFreeEdges > 0) { // Compute a heuristic value for the node
+            unsigned long long evalStartTime = getABStatsTimeMicros();
+            score += getHeuristicValue(state, isMaximizer);
+            abSearchStats.evalMicros += getABStatsTimeMicros() - evalStartTime;
         }
 
         //log_log("score for node: %d\n", score);
         return score;
     }
 
-    // Else enumerate the possible moves and try them.
-    SCGraph graph;
-    unscoredStateToSCGraph(&graph, state);
-
-    Edge potentialMoves[NUM_EDGES];
-    short numPotentialMoves = getGraphsPotentialMoves(&graph, potentialMoves);
-
-    { // Order the moves so those that give away boxes are considered last. Using a new scope like this saves memory.
-        Edge terribleMoves[NUM_EDGES];
-        Edge badMoves[NUM_EDGES];
-        Edge goodMoves[NUM_EDGES];
-        short numBadMoves = 0;
-        short numGoodMoves = 0;
-        short numTerribleMoves = 0;
-        for(short i=0; i < numPotentialMoves; i++) {
-            Edge edge = potentialMoves[i];
-            const Box * edgeBoxes = getEdgeBoxes(edge);
+    short probCutValue;
+    if (!isRoot && getProbCutValue(state, depth, nodesVisitedCount, branchesPrunedCount, alpha, beta, totalBoxesTaken, isMaximizer, &probCutValue))
+        return probCutValue;
 
-            short node1, node2;
-            if(edgeBoxes[0] == NO_BOX)
-                node1 = 0;
-            else
-                node1 = graph.boxToNode[edgeBoxes[0]];
+    // Else enumerate the possible moves and try them.
+    ArenaMark nodeMark = getArenaMark(&abArena);
+    Edge bestMove = NO_EDGE;
+    ABMoveBucket bestMoveBucket = AB_BUCKET_GOOD;
+    short numMovesTried = 0;
+    bool hasMoveCutoff = false; // a move was good enough to stop the search here
+    bool isCutoff = false;
+    bool isForced = false; // only one move was worth trying
+
+    Bitboard board;
+    unscoredStateToBitboard(&board, state);
+
+    // Kept in case full generation finds the node forced after all, see below.
+    short unstagedValue = value;
+    double unstagedAlpha = alpha;
+    double unstagedBeta = beta;
+
+    // Staged generation: the best move from the last visit and a few safe moves are tried before any
+    // graph is built, since most nodes cut off on their first or second move. The root always generates in full.
+    Edge * stagedMoves = (Edge *)arenaAlloc(&abArena, (1 + AB_SAFE_MOVE_STAGE_SIZE) * sizeof(Edge));
+    short numStagedMoves = 0;
+    if (!isRoot) {
+        bool hasHashMove = false;
+        bool isHashMoveForced = false;
+        const BestMoveEntry * entry = &bestMoveTable[getBitboardHash(&board) & (BEST_MOVE_TABLE_SIZE - 1)];
+        abSearchStats.bestMoveProbes++;
+        if (entry->isValid && entry->board.lo == board.lo && entry->board.hi == board.hi) {
+            abSearchStats.bestMoveHits++;
+            stagedMoves[numStagedMoves++] = entry->move;
+            hasHashMove = true;
+            isHashMoveForced = entry->isForced;
+        }
 
-            if(edgeBoxes[1] == NO_BOX)
-                node2 = 0;
-            else
-                node2 = graph.boxToNode[edgeBoxes[1]];
+        // A forced move is the only one full generation would give, so there is nothing else to try.
+        if (!isHashMoveForced) {
+            unsigned long long moveGenStartTime = getABStatsTimeMicros();
+            numStagedMoves += getSafeMoves(&board, &stagedMoves[numStagedMoves], AB_SAFE_MOVE_STAGE_SIZE, numStagedMoves > 0 ? stagedMoves[0] : NO_EDGE);
+            abSearchStats.moveGenMicros += getABStatsTimeMicros() - moveGenStartTime;
+        }
 
-            short badness = 0;
-            if (getNodeValency(&graph, node1) == 2)
-                badness++;
-            if (getNodeValency(&graph, node2) == 2)
-                badness++;
+        for (short i=0; i < numStagedMoves && !isCutoff; i++) {
+            short v = searchABChild(state, stagedMoves[i], isHashMoveForced ? depth : depth - 1, nodesVisitedCount, branchesPrunedCount, alpha, beta, totalBoxesTaken, isMaximizer);
+            isCutoff = updateABNodeValue(isMaximizer, v, stagedMoves[i], &value, &bestMove, &alpha, &beta, branchesPrunedCount);
+            numMovesTried++;
 
-            switch(badness) {
-                case 0:
-                    goodMoves[numGoodMoves++] = edge;
-                    break;
-                case 1:
-                    badMoves[numBadMoves++] = edge;
-                    break;
-                case 2:
-                    terribleMoves[numTerribleMoves++] = edge;
-                    break;
+            if (bestMove == stagedMoves[i])
+                bestMoveBucket = hasHashMove && i == 0 ? AB_BUCKET_HASH : AB_BUCKET_SAFE;
+            if (isCutoff) {
+                recordABCutoff(numMovesTried - 1);
+                hasMoveCutoff = true;
             }
         }
 
-        for (short i=0; i < numGoodMoves; i++)
-            potentialMoves[i] = goodMoves[i];
+        if (isCutoff)
+            abMoveGenStats.stagedCutoffs++;
+        else if (isHashMoveForced) {
+            isCutoff = true; // searched everything already
+            isForced = true;
+        }
+    }
 
-        for (short i=0; i < numBadMoves; i++)
-            potentialMoves[numGoodMoves + i] = badMoves[i];
+    if (!isCutoff) {
+        abMoveGenStats.fullGenerations++;
+        unsigned long long moveGenStartTime = getABStatsTimeMicros();
+        Edge * potentialMoves = (Edge *)arenaAlloc(&abArena, NUM_EDGES * sizeof(Edge));
+        // The potential move each staged move is isomorphic to, which need not be the same edge.
+        Edge * stagedRepresentatives = (Edge *)arenaAlloc(&abArena, (1 + AB_SAFE_MOVE_STAGE_SIZE) * sizeof(Edge));
+
+        // The graph and the ordering buffers are only needed until the moves are ordered.
+        ArenaMark scratchMark = getArenaMark(&abArena);
+        SCGraph graph;
+        unscoredStateToArenaSCGraph(&graph, state, &abArena);
+
+        short numPotentialMoves = getGraphsPotentialMovesAndRepresentatives(&graph, potentialMoves, stagedMoves, numStagedMoves, stagedRepresentatives);
+        isForced = numPotentialMoves == 1;
+
+        if (isForced && numStagedMoves > 0) {
+            // The staged moves were searched a ply shallower than a forced move is, so the node is
+            // scored by its one move alone, as it would have been without staging.
+            value = unstagedValue;
+            alpha = unstagedAlpha;
+            beta = unstagedBeta;
+            bestMove = NO_EDGE;
+            bestMoveBucket = AB_BUCKET_GOOD;
+            numStagedMoves = 0;
+        }
 
-        for (short i=0; i < numTerribleMoves; i++)
-            potentialMoves[numGoodMoves + numBadMoves + i] = terribleMoves[i];
-    }
+        short numBadMoves = 0;
+        short numGoodMoves = 0;
+        { // Order the moves so those that give away boxes are considered last.
+            Edge * terribleMoves = (Edge *)arenaAlloc(&abArena, NUM_EDGES * sizeof(Edge));
+            Edge * badMoves = (Edge *)arenaAlloc(&abArena, NUM_EDGES * sizeof(Edge));
+            Edge * goodMoves = (Edge *)arenaAlloc(&abArena, NUM_EDGES * sizeof(Edge));
+            short numTerribleMoves = 0;
+            for(short i=0; i < numPotentialMoves; i++) {
+                Edge edge = potentialMoves[i];
+                const Box * edgeBoxes = getEdgeBoxes(edge);
+
+                short node1, node2;
+                if(edgeBoxes[0] == NO_BOX)
+                    node1 = 0;
+                else
+                    node1 = graph.boxToNode[edgeBoxes[0]];
 
-    unsigned long long endTime;
-    if (isRoot) // Limit the maximum turn time to 10 seconds
-        endTime = getTimeMillis() + 10000;
+                if(edgeBoxes[1] == NO_BOX)
+                    node2 = 0;
+                else
+                    node2 = graph.boxToNode[edgeBoxes[1]];
+
+                short badness = 0;
+                if (getNodeValency(&graph, node1) == 2)
+                    badness++;
+                if (getNodeValency(&graph, node2) == 2)
+                    badness++;
+
+                switch(badness) {
+                    case 0:
+                        goodMoves[numGoodMoves++] = edge;
+                        break;
+                    case 1:
+                        badMoves[numBadMoves++] = edge;
+                        break;
+                    case 2:
+                        terribleMoves[numTerribleMoves++] = edge;
+                        break;
+                }
+            }
 
-    Edge bestMove = NO_EDGE;
-    for(short i=0; i < numPotentialMoves; i++) {
-        //log_log("Trying move %d. (%d of %d)\n", potentialMoves[i], i+1, numPotentialMoves);
-        Edge untriedMove = potentialMoves[i];
-        // untriedMove might be a corner move in which case it may need to be converted
-        if (isEdgeTaken(state, untriedMove))
-            untriedMove = getCorrespondingCornerEdge(untriedMove);
+            for (short i=0; i < numGoodMoves; i++)
+                potentialMoves[i] = goodMoves[i];
+
+            for (short i=0; i < numBadMoves; i++)
+                potentialMoves[numGoodMoves + i] = badMoves[i];
 
-        //ABNode * child = createABNodeAndAddToParent(node, untriedMove, state);
+            for (short i=0; i < numTerribleMoves; i++)
+                potentialMoves[numGoodMoves + numBadMoves + i] = terribleMoves[i];
+        }
 
+        resetArenaToMark(&abArena, scratchMark);
+        abSearchStats.moveGenMicros += getABStatsTimeMicros() - moveGenStartTime;
 
-        short boxesTaken = howManyBoxesDoesMoveComplete(state, untriedMove);
-        setEdgeTaken(state, untriedMove); // now it's a postMoveState
+        unsigned long long endTime = isRoot ? getTimeMillis() + 10000 : 0; // Limit the maximum turn time to 10 seconds
 
-        short v = 0;
-        
-        {
-            UnscoredState * child_state = state;
-            short child_depth = numPotentialMoves == 1 ? depth : depth - 1; // don't decrease depth if an urgent move was played (helps with looking ahead at chains)
-            int * child_nodesVisitedCount = nodesVisitedCount;
-            int * child_branchesPrunedCount = branchesPrunedCount;
-            bool child_isRoot = false;
-            double child_alpha = alpha;
-            double child_beta = beta;
-            Edge child_move = untriedMove;
-
-            short child_totalBoxesTaken;
-            short child_isMaximizer;
-            short child_value;
-            if (isMaximizer) {
-                child_totalBoxesTaken = totalBoxesTaken + boxesTaken;
-
-                if (boxesTaken > 0) {
-                    child_isMaximizer = true;
-                }
-                else
-                    child_isMaximizer = false;
+        for(short i=0; i < numPotentialMoves; i++) {
+            //log_log("Trying move %d. (%d of %d)\n", potentialMoves[i], i+1, numPotentialMoves);
+            bool isStaged = false;
+            for (short j=0; j < numStagedMoves; j++) {
+                if (stagedRepresentatives[j] == potentialMoves[i])
+                    isStaged = true;
             }
-            else {
-                child_totalBoxesTaken = totalBoxesTaken;
 
-                if (boxesTaken > 0)
-                    child_isMaximizer = false;
-                else
-                    child_isMaximizer = true;
-            }
+            if (isStaged)
+                continue;
 
-            if (child_isMaximizer)
-                child_value = ALPHA_MIN;
+            Edge untriedMove = potentialMoves[i];
+            // untriedMove might be a corner move in which case it may need to be converted
+            if (isEdgeTaken(state, untriedMove))
+                untriedMove = getCorrespondingCornerEdge(untriedMove);
+
+            // don't decrease depth if an urgent move was played (helps with looking ahead at chains)
+            short childDepth = numPotentialMoves == 1 ? depth : depth - 1;
+            short v;
+            if (!isRoot && isLateMoveReducible(depth, i, numPotentialMoves))
+                v = searchABLateMove(state, untriedMove, childDepth, nodesVisitedCount, branchesPrunedCount, alpha, beta, totalBoxesTaken, isMaximizer);
             else
-                child_value = BETA_MAX;
-
-            v = doAlphaBetaStack(
-                    child_state,
-                    child_depth,
-                    child_nodesVisitedCount,
-                    child_branchesPrunedCount,
-                    child_isRoot,
-                    child_alpha,
-                    child_beta,
-                    child_move,
-                    child_totalBoxesTaken,
-                    child_isMaximizer,
-                    child_value
-                    );
-
-            //log_log("parent at %p: return value from child is %d\n", &depth, v);
-        }
+                v = searchABChild(state, untriedMove, childDepth, nodesVisitedCount, branchesPrunedCount, alpha, beta, totalBoxesTaken, isMaximizer);
 
-        setEdgeFree(state, untriedMove); // reset the state
+            if(isRoot)
+                log_log("Checked untried move %d. Score is: %d\n", untriedMove, v);
 
-        if(isRoot)
-            log_log("Checked untried move %d. Score is: %d\n", untriedMove, v);
+            hasMoveCutoff = updateABNodeValue(isMaximizer, v, untriedMove, &value, &bestMove, &alpha, &beta, branchesPrunedCount);
+            numMovesTried++;
 
-        if (isMaximizer) {
-            if (v > value) {
-                //log_log("node is maximizer. Setting value at %p to %d\n", &value, v);
-                value = v;
-                bestMove = untriedMove;
+            if (bestMove == untriedMove)
+                bestMoveBucket = i < numGoodMoves ? AB_BUCKET_GOOD : (i < numGoodMoves + numBadMoves ? AB_BUCKET_BAD : AB_BUCKET_TERRIBLE);
+            if (hasMoveCutoff) {
+                recordABCutoff(numMovesTried - 1);
+                break;
             }
-            alpha = max(alpha, v);
-            if (beta <= alpha) {
-                *branchesPrunedCount += 1;
-                log_debug("Pruned branch with beta cutoff!\n"); 
-                break; // beta cutoff
-            }
-        }
-        else { // node is minimizer
-            if (v < value) {
-                //log_log("node is minimizer. Setting value at %p to %d\n", &value, v);
-                value = v;
-                bestMove = untriedMove;
-            }
-            beta = min(beta, v);
 
-            if (beta <= alpha) {
-                *branchesPrunedCount += 1;
-                log_debug("Pruned branch with alpha cutoff!\n"); 
-                break; // alpha cutoff
+            if (isRoot && getTimeMillis() > endTime) {
+                log_log("Search has taken over 10 seconds. Returning best move found so far.\n");
+                // Fail safe: Ensure we return a move
+                if (bestMove == NO_EDGE)
+                    bestMove = potentialMoves[0];
+
+                break;
             }
         }
 
-        if (isRoot && getTimeMillis() > endTime) {
-            log_log("Search has taken over 10 seconds. Returning best move found so far.\n");
-            // Fail safe: Ensure we return a move
-            if (bestMove == NO_EDGE)
-                bestMove = potentialMoves[0];
+    }
 
-            break;
-        }
+    // A node with only one move to try says nothing about the ordering.
+    if (bestMove != NO_EDGE && (numMovesTried > 1 || hasMoveCutoff))
+        abSearchStats.bucketWins[bestMoveBucket]++;
+
+    if (!isRoot && bestMove != NO_EDGE) {
+        // Whatever was in the slot before is simply replaced.
+        BestMoveEntry * entry = &bestMoveTable[getBitboardHash(&board) & (BEST_MOVE_TABLE_SIZE - 1)];
+        entry->board = board;
+        entry->move = bestMove;
+        entry->isForced = isForced;
+        entry->isValid = true;
     }
 
-    freeAdjLists(&graph);
+    resetArenaToMark(&abArena, nodeMark);
 
     if (isRoot)
         return bestMove;
@@ -492,86 +846,388 @@ static short doAlphaBetaStack(UnscoredState * state, short depth, int * nodesVis
     }
 }
 
-Edge getABMove(const UnscoredState * state, short maxDepth, bool saveJSON) {
-    log_log("\nStarting getABMove with maxDepth %d\n", maxDepth);
+double getABEffectiveBranchingFactor(const ABSearchStats * stats) {
+    // The branching factor of a uniform tree with as many nodes, searched as deep. Capture sequences
+    // go beyond the nominal depth, and searches near the end of the game stop short of it.
+    short depth = min(stats->maxDepth, stats->deepestPly);
+    if (depth <= 0)
+        return 0.0;
+
+    return pow(stats->nodesVisited, 1.0 / depth);
+}
+
+static short getNumABCounts(const int * counts, short maxCounts) {
+    // Leaves off the zeros at the end.
+    short numCounts = maxCounts;
+    while (numCounts > 1 && counts[numCounts - 1] == 0)
+        numCounts--;
+
+    return numCounts;
+}
+
+static void formatABCounts(char * buffer, size_t size, const int * counts, short numCounts, const char * separator) {
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    for (short i=0; i < numCounts && length < size; i++)
+        length += snprintf(buffer + length, size - length, "%s%d", i > 0 ? separator : "", counts[i]);
+}
+
+static void logABSearchStats(const ABSearchStats * stats) {
+    char nodesAtPly[AB_STATS_MAX_PLY * 12];
+    formatABCounts(nodesAtPly, sizeof(nodesAtPly), stats->nodesAtPly, stats->deepestPly + 1, " ");
+    log_log("Nodes by ply: %s. Effective branching factor: %.2f\n", nodesAtPly, getABEffectiveBranchingFactor(stats));
+
+    char cutoffsAtMoveIndex[AB_STATS_MAX_MOVE_INDEX * 12];
+    formatABCounts(cutoffsAtMoveIndex, sizeof(cutoffsAtMoveIndex), stats->cutoffsAtMoveIndex,
+        getNumABCounts(stats->cutoffsAtMoveIndex, AB_STATS_MAX_MOVE_INDEX), " ");
+    log_log("Cutoffs: %d (%.1f%% by the first move), by move index: %s\n",
+        stats->cutoffs, stats->cutoffs > 0 ? 100.0 * stats->cutoffsAtMoveIndex[0] / stats->cutoffs : 0.0, cutoffsAtMoveIndex);
+
+    if (abStatsPath != NULL)
+        log_log("Move generation: %.1fms, evaluation: %.1fms\n", stats->moveGenMicros / 1000.0, stats->evalMicros / 1000.0);
+    log_log("Best move table hits: %d/%d, tablebase hits: %d/%d\n",
+        stats->bestMoveHits, stats->bestMoveProbes, stats->tablebaseHits, stats->tablebaseProbes);
+
+    log_log("Best moves found among hash moves: %d, safe moves: %d, good moves: %d, bad moves: %d, terrible moves: %d\n",
+        stats->bucketWins[AB_BUCKET_HASH], stats->bucketWins[AB_BUCKET_SAFE], stats->bucketWins[AB_BUCKET_GOOD],
+        stats->bucketWins[AB_BUCKET_BAD], stats->bucketWins[AB_BUCKET_TERRIBLE]);
+}
+
+static void appendABSearchStatsJSON(const ABSearchStats * stats, const UnscoredState * rootState, const char * filePath) {
+    // One line per search, so a run over the position corpus can be read back a record at a time.
+    FILE * file = fopen(filePath, "a");
+    if (file == NULL) {
+        log_error("[ERROR] appendABSearchStatsJSON: Could not open %s.\n", filePath);
+        return;
+    }
+
+    char stateString[NUM_EDGES+1];
+    for(short i=0; i<NUM_EDGES; i++)
+        stateString[i] = isEdgeTaken(rootState, i) ? '1' : '0';
+    stateString[NUM_EDGES] = '\0';
+
+    char nodesAtPly[AB_STATS_MAX_PLY * 12];
+    formatABCounts(nodesAtPly, sizeof(nodesAtPly), stats->nodesAtPly, stats->deepestPly + 1, ",");
+
+    char cutoffsAtMoveIndex[AB_STATS_MAX_MOVE_INDEX * 12];
+    formatABCounts(cutoffsAtMoveIndex, sizeof(cutoffsAtMoveIndex), stats->cutoffsAtMoveIndex,
+        getNumABCounts(stats->cutoffsAtMoveIndex, AB_STATS_MAX_MOVE_INDEX), ",");
+
+    fprintf(file, "{\"state\":\"%s\",\"maxDepth\":%d,\"bestMove\":%d,\"timeMillis\":%ld,\"nodesVisited\":%d,"
+            "\"nodesAtPly\":[%s],\"effectiveBranchingFactor\":%.3f,\"cutoffs\":%d,\"cutoffsAtMoveIndex\":[%s],"
+            "\"moveGenMicros\":%llu,\"evalMicros\":%llu,"
+            "\"bestMoveTable\":{\"probes\":%d,\"hits\":%d},\"leafCache\":{\"probes\":%d,\"hits\":%d},\"tablebase\":{\"probes\":%d,\"hits\":%d},"
+            "\"bucketWins\":{\"hash\":%d,\"safe\":%d,\"good\":%d,\"bad\":%d,\"terrible\":%d},"
+            "\"stagedCutoffs\":%d,\"fullGenerations\":%d,"
+            "\"lmr\":{\"reductions\":%d,\"nodes\":%d,\"reSearches\":%d,\"reSearchNodes\":%d},"
+            "\"probCut\":{\"tries\":%d,\"cutoffs\":%d,\"nodes\":%d}}\n",
+        stateString, stats->maxDepth, stats->bestMove, stats->timeMillis, stats->nodesVisited,
+        nodesAtPly, getABEffectiveBranchingFactor(stats), stats->cutoffs, cutoffsAtMoveIndex,
+        stats->moveGenMicros, stats->evalMicros,
+        stats->bestMoveProbes, stats->bestMoveHits, leafCacheStats.lookups, leafCacheStats.hits, stats->tablebaseProbes, stats->tablebaseHits,
+        stats->bucketWins[AB_BUCKET_HASH], stats->bucketWins[AB_BUCKET_SAFE], stats->bucketWins[AB_BUCKET_GOOD],
+        stats->bucketWins[AB_BUCKET_BAD], stats->bucketWins[AB_BUCKET_TERRIBLE],
+        abMoveGenStats.stagedCutoffs, abMoveGenStats.fullGenerations,
+        abSelectiveStats.lmrReductions, abSelectiveStats.lmrNodes, abSelectiveStats.lmrReSearches, abSelectiveStats.lmrReSearchNodes,
+        abSelectiveStats.probCutTries, abSelectiveStats.probCutCutoffs, abSelectiveStats.probCutNodes);
+
+    fclose(file);
+}
+
+static short doAlphaBetaStack(UnscoredState * state, short depth, int * nodesVisitedCount, int * branchesPrunedCount, bool isRoot, double alpha, double beta, Edge move, short totalBoxesTaken, bool isMaximizer, short value) {
+    // Searches the node with searchABNode, writing it to the tree file afterwards if one is open.
+    if (abTreeWriter.file == NULL)
+        return searchABNode(state, depth, nodesVisitedCount, branchesPrunedCount, isRoot, alpha, beta, move, totalBoxesTaken, isMaximizer, value);
+
+    int parentId = abTreeParentId;
+    int id = getNewTreeNodeId(&abTreeWriter);
+    abTreeParentId = id;
+    abTreeDepth++;
+    short result = searchABNode(state, depth, nodesVisitedCount, branchesPrunedCount, isRoot, alpha, beta, move, totalBoxesTaken, isMaximizer, value);
+    abTreeDepth--;
+    abTreeParentId = parentId;
+
+    if (isTreeNodeSampled(&abTreeWriter, abTreeDepth, 0)) {
+        Bitboard board;
+        unscoredStateToBitboard(&board, state);
+
+        beginTreeNode(&abTreeWriter, id, parentId, abTreeDepth, move, &board);
+        writeTreeNodeBool(&abTreeWriter, "isMaximizer", isMaximizer);
+        writeTreeNodeInt(&abTreeWriter, "alpha", (long)alpha);
+        writeTreeNodeInt(&abTreeWriter, "beta", (long)beta);
+        writeTreeNodeInt(&abTreeWriter, "depthLeft", depth);
+        writeTreeNodeInt(&abTreeWriter, "totalBoxesTaken", totalBoxesTaken);
+        writeTreeNodeInt(&abTreeWriter, isRoot ? "bestMove" : "value", result);
+        endTreeNode(&abTreeWriter);
+    }
+
+    return result;
+}
+
+Edge getABMove(const ScoredState * state, short maxDepth, bool saveJSON) {
+    // score_p1 of state belongs to the player to move.
+    log_log("\nStarting getABMove with maxDepth %d at score %d - %d\n", maxDepth, state->score_p1, state->score_p2);
 
     unsigned long long startTime = getTimeMillis();
     int nodesVisitedCount = 0;
     int branchesPrunedCount = 0;
+    if (abArena.first == NULL)
+        initArena(&abArena, AB_ARENA_BLOCK_SIZE);
+    resetArena(&abArena);
+    leafCacheStats.lookups = 0;
+    leafCacheStats.hits = 0;
+    leafCacheStats.missMicros = 0;
+    abMoveGenStats.stagedCutoffs = 0;
+    abMoveGenStats.fullGenerations = 0;
+    abSelectiveStats = (ABSelectiveStats){0};
+    abSearchStats = (ABSearchStats){0};
+    abSearchStats.maxDepth = maxDepth;
+    abPly = 0;
     
     //ABNode * rootNode = newABRootNode(state);
-    UnscoredState rootState = *state;
+    UnscoredState rootState;
+    scoredStateToUnscoredState(&rootState, state);
+
+    abGameScore.maximizerScore = state->score_p1;
+    abGameScore.minimizerScore = state->score_p2;
+    abGameScore.rootBoxesLeft = getNumBoxesLeft(&rootState);
+    abGameScore.isUndecided = !isScoredStateDecided(state);
 
     printUnscoredState(&rootState);
 
+    abTreeParentId = -1;
+    abTreeDepth = 0;
+    if (saveJSON)
+        openTreeWriter(&abTreeWriter, &abTreeSettings, "alpha_beta", &rootState);
+
     //Edge bestMove = doAlphaBeta(rootNode, &rootState, maxDepth, &nodesVisitedCount, &branchesPrunedCount, true);
 //static short doAlphaBetaStack(UnscoredState * state, short depth, int * nodesVisitedCount, int * branchesPrunedCount, bool isRoot, double alpha, double beta, Edge move, short totalBoxesTaken, bool isMaximizer, bool value) {
     Edge bestMove = doAlphaBetaStack(&rootState, maxDepth, &nodesVisitedCount, &branchesPrunedCount, true, ALPHA_MIN, BETA_MAX, NO_EDGE, 0, true, ALPHA_MIN);
 
     log_log("getABMove: Best move is %d.\n", bestMove);
 
-    //freeABNode(rootNode);
+    if (saveJSON)
+        closeTreeWriter(&abTreeWriter);
+
+    // rootNode would be released with abArena
 
     unsigned long long endTime = getTimeMillis();
     long timeSpent = endTime - startTime;
     
-    log_log("Time spent: %ld, Nodes visited: %d, Branches pruned: %d\n", timeSpent, nodesVisitedCount, branchesPrunedCount);
+    // Every hit saved roughly the average cost of a miss.
+    int leafCacheMisses = leafCacheStats.lookups - leafCacheStats.hits;
+    double leafCacheHitRate = leafCacheStats.lookups > 0 ? 100.0 * leafCacheStats.hits / leafCacheStats.lookups : 0.0;
+    double leafCacheMillisSaved = leafCacheMisses > 0 ? leafCacheStats.hits * (leafCacheStats.missMicros / (double)leafCacheMisses) / 1000.0 : 0.0;
+
+    log_log("Time spent: %ld, Nodes visited: %d, Branches pruned: %d, Leaf cache hits: %d/%d (%.1f%%), saving ~%.1fms, Peak scratch memory: %luKB, Staged cutoffs: %d, Full move generations: %d\n",
+            timeSpent, nodesVisitedCount, branchesPrunedCount,
+            leafCacheStats.hits, leafCacheStats.lookups, leafCacheHitRate, leafCacheMillisSaved,
+            (unsigned long)abArena.peakBytesUsed / 1024,
+            abMoveGenStats.stagedCutoffs, abMoveGenStats.fullGenerations);
+    log_log("LMR: %d reductions (%d nodes), %d re-searches (%d nodes). ProbCut: %d/%d cutoffs (%d nodes)\n",
+            abSelectiveStats.lmrReductions, abSelectiveStats.lmrNodes,
+            abSelectiveStats.lmrReSearches, abSelectiveStats.lmrReSearchNodes,
+            abSelectiveStats.probCutCutoffs, abSelectiveStats.probCutTries, abSelectiveStats.probCutNodes);
+
+    abSearchStats.bestMove = bestMove;
+    abSearchStats.timeMillis = timeSpent;
+    abSearchStats.nodesVisited = nodesVisitedCount;
+    logABSearchStats(&abSearchStats);
+
+    if (abStatsPath != NULL)
+        appendABSearchStatsJSON(&abSearchStats, &rootState, abStatsPath);
 
     return bestMove;
 }
 
-static json_t * ABNodeToJSON(const ABNode * node, UnscoredState state) {
-    json_t * j;
-
-    if (node->move != NO_EDGE)
-        setEdgeTaken(&state, node->move);
+void runAlphaBetaTests() {
+    log_log("RUNNING ALPHA BETA TESTS\n");
 
-    char stateString[NUM_EDGES+1];
-    for(short i=0; i<NUM_EDGES; i++) {
-        if(isEdgeTaken(&state, i))
-            stateString[i] = '1';
-        else
-            stateString[i] = '0';
+    UnscoredState state;
+    Bitboard board;
+
+    log_log("Testing getCachedStaticEvaluation...\n");
+    log_debug("It should agree with the static evaluator and hit on the second lookup.\n");
+    stringToUnscoredState(&state, "111111110000000001111111100000000011111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    leafCacheStats.lookups = 0;
+    leafCacheStats.hits = 0;
+    assert(getCachedStaticEvaluation(&board) == getBitboardStaticEvaluation(&board));
+    assert(getCachedStaticEvaluation(&board) == getBitboardStaticEvaluation(&board));
+    assert(leafCacheStats.lookups == 2);
+    assert(leafCacheStats.hits == 1);
+
+    log_debug("It should not return the value of a different position which shares the slot.\n");
+    LeafCacheEntry * entry = &leafCache[getBitboardHash(&board) & (LEAF_CACHE_SIZE - 1)];
+    entry->board.lo ^= 1ULL << 20;
+    entry->moverBoxes = 27;
+    assert(getCachedStaticEvaluation(&board) == getBitboardStaticEvaluation(&board));
+    assert(leafCacheStats.hits == 1);
+
+    log_log("Testing getHeuristicValue...\n");
+    log_debug("It should give the minimizer's share as the boxes the maximizer doesn't get.\n");
+    assert(getHeuristicValue(&state, true) == 2);
+    assert(getHeuristicValue(&state, false) == 14);
+
+    log_log("Testing getDecidedValue...\n");
+    // state has 16 boxes left, 4 were taken by the minimizer since the root.
+    short decidedValue;
+    abGameScore.maximizerScore = 8;
+    abGameScore.minimizerScore = 0;
+    abGameScore.rootBoxesLeft = 20;
+    abGameScore.isUndecided = true;
+
+    log_debug("It should not cut off while neither player has a majority of the boxes.\n");
+    assert(!getDecidedValue(&state, 0, &decidedValue));
+
+    log_debug("It should give a won node a value above any undecided node's.\n");
+    abGameScore.maximizerScore = 15;
+    assert(getDecidedValue(&state, 0, &decidedValue));
+    assert(decidedValue == 21);
+
+    log_debug("It should rank a win above an undecided sibling with a higher box estimate.\n");
+    // Won with 1 box taken and 16 left, so at most 17 boxes, against a sibling which took none and
+    // is estimated to get all 20 boxes left at the root.
+    abGameScore.maximizerScore = 14;
+    assert(getDecidedValue(&state, 1, &decidedValue));
+    short undecidedSiblingValue = 0 + abGameScore.rootBoxesLeft;
+    assert(decidedValue > undecidedSiblingValue && decidedValue < BETA_MAX);
+
+    log_debug("It should rank the bigger of two wins higher.\n");
+    short smallerWinValue = decidedValue;
+    assert(getDecidedValue(&state, 2, &decidedValue));
+    assert(decidedValue > smallerWinValue);
+
+    log_debug("It should give a lost node a value below any undecided node's.\n");
+    abGameScore.maximizerScore = 8;
+    abGameScore.minimizerScore = 11;
+    assert(getDecidedValue(&state, 0, &decidedValue));
+    assert(decidedValue == -5);
+    assert(decidedValue < 0 && decidedValue > ALPHA_MIN);
+
+    log_debug("It should never cut off when the game was decided before the search started.\n");
+    abGameScore.isUndecided = false;
+    assert(!getDecidedValue(&state, 0, &decidedValue));
+
+    log_log("Testing unscoredStateToArenaSCGraph...\n");
+    log_debug("It should give the same moves as a graph on the heap.\n");
+    if (abArena.first == NULL)
+        initArena(&abArena, AB_ARENA_BLOCK_SIZE);
+    resetArena(&abArena);
+
+    SCGraph heapGraph, arenaGraph;
+    unscoredStateToSCGraph(&heapGraph, &state);
+    unscoredStateToArenaSCGraph(&arenaGraph, &state, &abArena);
+    assert(arenaGraph.arena == &abArena);
+
+    Edge heapMoves[NUM_EDGES], arenaMoves[NUM_EDGES];
+    short numHeapMoves = getGraphsPotentialMoves(&heapGraph, heapMoves);
+    assert(getGraphsPotentialMoves(&arenaGraph, arenaMoves) == numHeapMoves);
+    for (short i=0; i < numHeapMoves; i++)
+        assert(heapMoves[i] == arenaMoves[i]);
+    freeAdjLists(&heapGraph);
+    freeAdjLists(&arenaGraph); // does nothing for arena graphs
+
+    log_log("Testing getSafeMoves...\n");
+    Edge safeMoves[AB_SAFE_MOVE_STAGE_SIZE];
+    log_debug("It should find nothing safe when every box left is in a chain.\n");
+    assert(getSafeMoves(&board, safeMoves, AB_SAFE_MOVE_STAGE_SIZE, NO_EDGE) == 0);
+
+    log_debug("It should skip the move it is told to.\n");
+    Bitboard emptyBoard = {0, 0};
+    assert(getSafeMoves(&emptyBoard, safeMoves, AB_SAFE_MOVE_STAGE_SIZE, 0) == AB_SAFE_MOVE_STAGE_SIZE);
+    assert(safeMoves[0] == 1 && safeMoves[1] == 2);
+
+    log_log("Testing getABMove...\n");
+    log_debug("It should give back all of its scratch memory when the search ends.\n");
+    ScoredState scoredState;
+    initScoredState(&scoredState);
+    updateScoredState(&scoredState, &state, 1);
+    getABMove(&scoredState, 3, false);
+    assert(abArena.bytesUsed == 0);
+    assert(abArena.peakBytesUsed > 0);
+
+    log_debug("It should build fewer graphs when it searches the same position again.\n");
+    stringToUnscoredState(&state, "111111111000010100111000000001111111100000101100000010110000001011011111");
+    initScoredState(&scoredState);
+    updateScoredState(&scoredState, &state, 1);
+    getABMove(&scoredState, 3, false);
+    int firstFullGenerations = abMoveGenStats.fullGenerations;
+    getABMove(&scoredState, 3, false);
+    assert(abMoveGenStats.fullGenerations < firstFullGenerations);
+
+    log_debug("It should only reduce and cut off selectively when told to.\n");
+    getABMove(&scoredState, 5, false);
+    assert(abSelectiveStats.lmrReductions == 0 && abSelectiveStats.probCutTries == 0);
+
+    ABSelectiveSettings defaultSettings = abSelectiveSettings;
+    abSelectiveSettings.isLMREnabled = true;
+    abSelectiveSettings.isProbCutEnabled = true;
+    Edge selectiveMove = getABMove(&scoredState, 5, false);
+    assert(abSelectiveStats.lmrReductions > 0 && abSelectiveStats.probCutTries > 0);
+    assert(!isEdgeTaken(&state, selectiveMove));
+    abSelectiveSettings = defaultSettings;
+
+    log_log("Testing abSearchStats...\n");
+    log_debug("It should count every node at some ply and every cutoff at some move index.\n");
+    getABMove(&scoredState, 5, false);
+    int plyTotal = 0;
+    for (short i=0; i < AB_STATS_MAX_PLY; i++)
+        plyTotal += abSearchStats.nodesAtPly[i];
+    int cutoffTotal = 0;
+    for (short i=0; i < AB_STATS_MAX_MOVE_INDEX; i++)
+        cutoffTotal += abSearchStats.cutoffsAtMoveIndex[i];
+    assert(plyTotal == abSearchStats.nodesVisited && abSearchStats.nodesAtPly[0] == 1);
+    assert(cutoffTotal == abSearchStats.cutoffs && abSearchStats.cutoffs > 0);
+    assert(getABEffectiveBranchingFactor(&abSearchStats) > 1.0);
+
+    log_debug("It should only time move generation and evaluation when the statistics are written out.\n");
+    assert(abSearchStats.moveGenMicros == 0 && abSearchStats.evalMicros == 0);
+
+    log_debug("It should append a line of JSON for every search when given a file.\n");
+    const char * statsPath = "/tmp/deepbox_test_abstats.json";
+    remove(statsPath);
+    abStatsPath = statsPath;
+    getABMove(&scoredState, 3, false);
+    getABMove(&scoredState, 3, false);
+    abStatsPath = NULL;
+
+    FILE * statsFile = fopen(statsPath, "r");
+    assert(statsFile != NULL);
+    char line[4096];
+    short numLines = 0;
+    while (fgets(line, sizeof(line), statsFile) != NULL) {
+        assert(line[0] == '{' && strstr(line, "}\n") != NULL);
+        numLines++;
     }
-    stateString[NUM_EDGES] = '\0';
-
-    char parentPointerString[32];
-    sprintf(parentPointerString, "%p", (void *)node->parent);
-
-    char nodePointerString[32];
-    sprintf(nodePointerString, "%p", (void *)node);
-
-
-    json_t * children_array = json_array();
-    ABNode * child = node->child;
-    while(child != NULL) {
-        json_array_append_new(children_array, ABNodeToJSON(child, state));
-        child = child->sibling;
+    fclose(statsFile);
+    remove(statsPath);
+    assert(numLines == 2);
+
+    log_debug("It should write the nodes down to the sampled depth when saving its tree.\n");
+    TreeWriterSettings defaultTreeSettings = abTreeSettings;
+    abTreeSettings.filePath = "/tmp/deepbox_test_ab_tree.json";
+    abTreeSettings.maxDepth = 2;
+    getABMove(&scoredState, 3, true);
+
+    FILE * treeFile = fopen(abTreeSettings.filePath, "r");
+    assert(treeFile != NULL);
+    assert(fgets(line, sizeof(line), treeFile) != NULL && strstr(line, "\"search\":\"alpha_beta\"") != NULL);
+    bool hasRoot = false;
+    short deepestTreeDepth = 0;
+    while (fgets(line, sizeof(line), treeFile) != NULL) {
+        int id, parentId, treeDepth;
+        assert(sscanf(line, "{\"id\":%d,\"parent\":%d,\"depth\":%d,", &id, &parentId, &treeDepth) == 3);
+        assert(treeDepth <= 2 && (parentId == -1) == (treeDepth == 0));
+        if (parentId == -1)
+            hasRoot = strstr(line, "\"bestMove\":") != NULL;
+        deepestTreeDepth = max(deepestTreeDepth, treeDepth);
     }
+    fclose(treeFile);
+    remove(abTreeSettings.filePath);
+    abTreeSettings = defaultTreeSettings;
+    assert(hasRoot && deepestTreeDepth == 2);
 
-    j = json_pack("{s:s, s:s, s:s, s:f, s:f, s:i, s:i, s:i, s:o, s:b, s:f}",
-            "state", stateString,
-            "address", nodePointerString,
-            "parent", parentPointerString,
-            "alpha", node->alpha,
-            "beta", node->beta,
-            "move", node->move,
-            "numBoxesTakenByMove", node->numBoxesTakenByMove,
-            "numChildren", node->numChildren,
-            "children", children_array,
-            "isMaximizer", node->isMaximizer,
-            "value", node->value);
-
-    return j;
-}
-
-static void saveABNodeJSON(const ABNode * node, UnscoredState rootState, const char * filePath) {
-    json_t * j = ABNodeToJSON(node, rootState);
-    json_dump_file(j, filePath, 0);
-    json_decref(j);
-}
-
-void runAlphaBetaTests() {
-    log_log("RUNNING ALPHA BETA TESTS\n");
     log_log("ALPHA BETA TESTS COMPLETED\n\n");
 }
@@ -1,6 +1,8 @@
 #ifndef ALPHABETA_H
 #define ALPHABETA_H
 
+#include "treewriter.h"
+
 typedef struct ABNode {
     double alpha;
     double beta;
@@ -12,6 +14,7 @@ typedef struct ABNode {
 
     struct ABNode * parent;
     struct ABNode * child;
+    struct ABNode * lastChild; // so that children can be appended without walking the siblings
     struct ABNode * sibling;
     short numChildren; // R
 
@@ -19,7 +22,61 @@ typedef struct ABNode {
     double value;
 } ABNode;
 
-Edge getABMove(const UnscoredState * state, short maxDepth, bool saveJSON);
+// Selective search settings, which can be tuned before calling getABMove. Both features are off
+// unless -c turns them on.
+typedef struct ABSelectiveSettings {
+    bool isLMREnabled;
+    short lmrMinDepth;      // only reduce at nodes with at least this much depth left
+    short lmrMinMoveIndex;  // moves ordered before this one are never reduced
+    short lmrReduction;     // plies taken off a late move on top of the usual one
+
+    bool isProbCutEnabled;
+    short probCutMinDepth;  // only try ProbCut at nodes with at least this much depth left
+    short probCutDepth;     // depth of the shallow search
+    short probCutMargin;    // boxes by which the shallow search must clear the bound
+} ABSelectiveSettings;
+
+extern ABSelectiveSettings abSelectiveSettings;
+
+// Where the move a node ended up choosing came from in the move ordering.
+typedef enum ABMoveBucket {
+    AB_BUCKET_HASH,     // the best move table
+    AB_BUCKET_SAFE,     // staged safe moves
+    AB_BUCKET_GOOD,     // generated moves which give nothing away
+    AB_BUCKET_BAD,      // generated moves which open up one box
+    AB_BUCKET_TERRIBLE, // generated moves which open up two boxes
+    NUM_AB_MOVE_BUCKETS
+} ABMoveBucket;
+
+#define AB_STATS_MAX_PLY 48         // nodes deeper than this are counted in the last ply
+#define AB_STATS_MAX_MOVE_INDEX 16  // cutoffs by later moves are counted in the last index
+
+// Statistics of the last getABMove call, for measuring search changes on the position corpus.
+typedef struct ABSearchStats {
+    short maxDepth;
+    Edge bestMove;
+    long timeMillis;
+    int nodesVisited;
+    int nodesAtPly[AB_STATS_MAX_PLY];
+    short deepestPly;
+    int cutoffs;
+    int cutoffsAtMoveIndex[AB_STATS_MAX_MOVE_INDEX]; // how many moves a node tried before cutting off, less one
+    unsigned long long moveGenMicros; // only timed while abStatsPath is set
+    unsigned long long evalMicros;    // likewise
+    int bestMoveProbes;
+    int bestMoveHits;
+    int tablebaseProbes;
+    int tablebaseHits;
+    int bucketWins[NUM_AB_MOVE_BUCKETS];
+} ABSearchStats;
+
+extern ABSearchStats abSearchStats;
+extern TreeWriterSettings abTreeSettings; // where and how much of the tree getABMove saves when asked to
+extern const char * abStatsPath; // when set, getABMove appends its statistics to this file as a line of JSON
+
+double getABEffectiveBranchingFactor(const ABSearchStats * stats);
+
+Edge getABMove(const ScoredState * state, short maxDepth, bool saveJSON);
 void runAlphaBetaTests();
 
 #endif
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "util.h"
+#include "arena.h"
+
+static const size_t ARENA_ALIGNMENT = 16;
+
+static ArenaBlock * newArenaBlock(size_t capacity) {
+    ArenaBlock * block = (ArenaBlock *)malloc(sizeof(ArenaBlock));
+    block->data = (char *)malloc(capacity);
+    block->capacity = capacity;
+    block->used = 0;
+    block->next = NULL;
+
+    if (block->data == NULL) {
+        log_error("[ERROR] newArenaBlock: Could not allocate %lu bytes.\n", (unsigned long)capacity);
+        exit(1);
+    }
+
+    return block;
+}
+
+void initArena(Arena * arena, size_t blockSize) {
+    arena->blockSize = blockSize;
+    arena->first = newArenaBlock(blockSize);
+    arena->current = arena->first;
+    arena->bytesUsed = 0;
+    arena->peakBytesUsed = 0;
+}
+
+void freeArena(Arena * arena) {
+    ArenaBlock * block = arena->first;
+
+    while (block != NULL) {
+        ArenaBlock * next = block->next;
+        free(block->data);
+        free(block);
+        block = next;
+    }
+
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+void * arenaAlloc(Arena * arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    ArenaBlock * block = arena->current;
+    if (block->used + size > block->capacity) {
+        // Move on to the next block, reusing one left over from before if it's big enough.
+        if (block->next == NULL || block->next->capacity < size) {
+            ArenaBlock * newBlock = newArenaBlock(size > arena->blockSize ? size : arena->blockSize);
+            newBlock->next = block->next;
+            block->next = newBlock;
+        }
+
+        block = block->next;
+        block->used = 0;
+        arena->current = block;
+    }
+
+    void * memory = block->data + block->used;
+    block->used += size;
+
+    arena->bytesUsed += size;
+    if (arena->bytesUsed > arena->peakBytesUsed)
+        arena->peakBytesUsed = arena->bytesUsed;
+
+    return memory;
+}
+
+ArenaMark getArenaMark(const Arena * arena) {
+    ArenaMark mark;
+    mark.block = arena->current;
+    mark.used = arena->current->used;
+    mark.bytesUsed = arena->bytesUsed;
+
+    return mark;
+}
+
+void resetArenaToMark(Arena * arena, ArenaMark mark) {
+    // Releases everything allocated since mark was taken.
+    arena->current = mark.block;
+    arena->current->used = mark.used;
+    arena->bytesUsed = mark.bytesUsed;
+}
+
+void resetArena(Arena * arena) {
+    // Releases everything and starts counting the peak again.
+    arena->current = arena->first;
+    arena->current->used = 0;
+    arena->bytesUsed = 0;
+    arena->peakBytesUsed = 0;
+}
+
+void runArenaTests() {
+    log_log("RUNNING ARENA TESTS\n");
+
+    Arena arena;
+    initArena(&arena, 256);
+
+    log_log("Testing arenaAlloc...\n");
+    log_debug("It should hand out aligned memory one allocation after another.\n");
+    char * a = (char *)arenaAlloc(&arena, 10);
+    char * b = (char *)arenaAlloc(&arena, 10);
+    assert((size_t)a % ARENA_ALIGNMENT == 0);
+    assert(b == a + ARENA_ALIGNMENT);
+    assert(arena.bytesUsed == 2 * ARENA_ALIGNMENT);
+
+    log_debug("It should start a new block when the current one is full.\n");
+    char * c = (char *)arenaAlloc(&arena, 1000);
+    assert(arena.current != arena.first);
+    assert(arena.current->capacity >= 1000);
+    c[999] = 'x'; // the whole allocation must be usable
+    assert(arena.peakBytesUsed == arena.bytesUsed);
+
+    log_log("Testing resetArenaToMark...\n");
+    log_debug("It should give back everything allocated after the mark.\n");
+    resetArena(&arena);
+    arenaAlloc(&arena, 32);
+    ArenaMark mark = getArenaMark(&arena);
+    char * d = (char *)arenaAlloc(&arena, 64);
+    arenaAlloc(&arena, 512);
+    resetArenaToMark(&arena, mark);
+    assert(arena.bytesUsed == 32);
+    assert(arenaAlloc(&arena, 64) == d);
+
+    log_debug("It should reuse blocks that were handed out before.\n");
+    ArenaBlock * secondBlock = arena.first->next;
+    resetArena(&arena);
+    arenaAlloc(&arena, 200);
+    arenaAlloc(&arena, 200);
+    assert(arena.current == secondBlock);
+
+    log_log("Testing resetArena...\n");
+    resetArena(&arena);
+    assert(arena.current == arena.first);
+    assert(arena.bytesUsed == 0);
+    assert(arena.peakBytesUsed == 0);
+
+    freeArena(&arena);
+
+    log_log("ARENA TESTS COMPLETED\n\n");
+}
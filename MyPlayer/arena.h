@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// A bump allocator. Nothing allocated from an arena is freed on its own: it is all
+// released at once, either back to an earlier mark or completely with resetArena.
+// Blocks are kept when released so that later searches don't allocate again.
+typedef struct ArenaBlock {
+    struct ArenaBlock * next;
+    char * data;
+    size_t capacity;
+    size_t used;
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock * first;
+    ArenaBlock * current;
+    size_t blockSize;
+    size_t bytesUsed;
+    size_t peakBytesUsed;
+} Arena;
+
+typedef struct ArenaMark {
+    ArenaBlock * block;
+    size_t used;
+    size_t bytesUsed;
+} ArenaMark;
+
+void initArena(Arena * arena, size_t blockSize);
+void freeArena(Arena * arena);
+void * arenaAlloc(Arena * arena, size_t size);
+ArenaMark getArenaMark(const Arena * arena);
+void resetArenaToMark(Arena * arena, ArenaMark mark);
+void resetArena(Arena * arena);
+void runArenaTests();
+
+#endif
@@ -0,0 +1,585 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "game_board.h"
+#include "util.h"
+#include "bitboard.h"
+
+// PiSquare board: the edges of each box as a mask, generated from getBoxEdgesTable.
+static const Bitboard boxEdgeMasks[NUM_BOXES] = {
+    {0x0000000000020301ULL, 0x00ULL}, {0x0000000000040602ULL, 0x00ULL},
+    {0x0000000000080c04ULL, 0x00ULL}, {0x0000000000101808ULL, 0x00ULL},
+    {0x0000000000203010ULL, 0x00ULL}, {0x0000000000406020ULL, 0x00ULL},
+    {0x000000000080c040ULL, 0x00ULL}, {0x0000000001018080ULL, 0x00ULL},
+    {0x0000000406020000ULL, 0x00ULL}, {0x000000080c040000ULL, 0x00ULL},
+    {0x0000001018080000ULL, 0x00ULL}, {0x0000002030100000ULL, 0x00ULL},
+    {0x0000004060200000ULL, 0x00ULL}, {0x00000080c0400000ULL, 0x00ULL},
+    {0x0000010180800000ULL, 0x00ULL}, {0x0000020301000000ULL, 0x00ULL},
+    {0x00010c0800000000ULL, 0x00ULL}, {0x0002181000000000ULL, 0x00ULL},
+    {0x0004608000000000ULL, 0x00ULL}, {0x0008c10000000000ULL, 0x00ULL},
+    {0x0431000000000000ULL, 0x00ULL}, {0x0862000000000000ULL, 0x00ULL},
+    {0x1184000000000000ULL, 0x00ULL}, {0x2308000000000000ULL, 0x00ULL},
+    {0xc400000000000000ULL, 0x10ULL}, {0x8800000000000000ULL, 0x21ULL},
+    {0x1000000000000000ULL, 0x46ULL}, {0x2000000000000000ULL, 0x8cULL}
+};
+
+void unscoredStateToBitboard(Bitboard * board, const UnscoredState * state) {
+    board->lo = 0;
+    board->hi = 0;
+
+    for (Edge e=0; e < NUM_EDGES; e++) {
+        if (isEdgeTaken(state, e))
+            setBitboardEdgeTaken(board, e);
+    }
+}
+
+void bitboardToUnscoredState(UnscoredState * state, const Bitboard * board) {
+    for (Edge e=0; e < NUM_EDGES; e++) {
+        if (isBitboardEdgeTaken(board, e))
+            setEdgeTaken(state, e);
+        else
+            setEdgeFree(state, e);
+    }
+}
+
+unsigned long long getBitboardHash(const Bitboard * board) {
+    // The splitmix64 finaliser applied to both words, so that nearby positions end up far apart.
+    unsigned long long h = board->lo ^ (board->hi * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+
+    return h;
+}
+
+short getBitboardNumFreeEdges(const Bitboard * board) {
+    return NUM_EDGES - countBits(board->lo) - countBits(board->hi);
+}
+
+short getBitboardFreeEdges(const Bitboard * board, Edge * freeEdges) {
+    // Fills freeEdges in ascending order and returns how many there are, visiting only the free bits.
+    short numFreeEdges = 0;
+
+    for (unsigned long long freeBits = ~board->lo; freeBits != 0; freeBits &= freeBits - 1)
+        freeEdges[numFreeEdges++] = __builtin_ctzll(freeBits);
+    for (unsigned long long freeBits = ~board->hi & BITBOARD_HI_MASK; freeBits != 0; freeBits &= freeBits - 1)
+        freeEdges[numFreeEdges++] = 64 + __builtin_ctzll(freeBits);
+
+    return numFreeEdges;
+}
+
+short getBitboardBoxNumTakenEdges(const Bitboard * board, Box b) {
+    const Bitboard * mask = &boxEdgeMasks[b];
+    return countBits(board->lo & mask->lo) + countBits(board->hi & mask->hi);
+}
+
+bool isBitboardBoxCapturable(const Bitboard * board, Box b) {
+    // Exactly one edge of b is free, found from its mask without counting bits.
+    const Bitboard * mask = &boxEdgeMasks[b];
+    unsigned long long freeLo = mask->lo & ~board->lo;
+    unsigned long long freeHi = mask->hi & ~board->hi;
+    return (freeLo == 0) != (freeHi == 0) && (freeLo & (freeLo - 1)) == 0 && (freeHi & (freeHi - 1)) == 0;
+}
+
+static unsigned int getCapturableBoxes(const Bitboard * board) {
+    // Bit b is set when box b can be captured.
+    unsigned int boxes = 0;
+
+    for (Box b=0; b < NUM_BOXES; b++) {
+        if (isBitboardBoxCapturable(board, b))
+            boxes |= 1U << b;
+    }
+
+    return boxes;
+}
+
+static short getBoxDegree(const Bitboard * board, Box b) {
+    // The number of free edges around the box.
+    return 4 - getBitboardBoxNumTakenEdges(board, b);
+}
+
+short getBitboardNumBoxesLeft(const Bitboard * board) {
+    short numBoxesLeft = 0;
+
+    for (Box b=0; b < NUM_BOXES; b++) {
+        if (getBoxDegree(board, b) > 0)
+            numBoxesLeft++;
+    }
+
+    return numBoxesLeft;
+}
+
+short makeBitboardMove(Bitboard * board, Edge e) {
+    // Takes the edge and returns how many boxes it completed.
+    setBitboardEdgeTaken(board, e);
+
+    short numCompleted = 0;
+    const Box * edgeBoxes = getEdgeBoxes(e);
+    for (short i=0; i < 2; i++) {
+        if (edgeBoxes[i] != NO_BOX && getBoxDegree(board, edgeBoxes[i]) == 0)
+            numCompleted++;
+    }
+
+    return numCompleted;
+}
+
+static Edge getOtherFreeEdge(const Bitboard * board, Box b, Edge from) {
+    // Returns the first free edge of b which isn't 'from'.
+    const Edge * boxEdges = getBoxEdges(b);
+
+    for (short i=0; i < 4; i++) {
+        if (boxEdges[i] != from && !isBitboardEdgeTaken(board, boxEdges[i]))
+            return boxEdges[i];
+    }
+
+    return NO_EDGE;
+}
+
+static Box getBoxAcrossEdge(Edge e, Box b) {
+    // NO_BOX means the edge leads off the board.
+    const Box * edgeBoxes = getEdgeBoxes(e);
+    return edgeBoxes[0] == b ? edgeBoxes[1] : edgeBoxes[0];
+}
+
+short captureAllBitboardBoxes(Bitboard * board) {
+    // Greedily takes every box with 3 taken edges until none are left.
+    // Returns the number of boxes captured. The player who captured them is still to move.
+    short numCaptured = 0;
+    bool foundCapture = true;
+
+    while (foundCapture) {
+        foundCapture = false;
+
+        for (unsigned int boxes = getCapturableBoxes(board); boxes != 0; boxes &= boxes - 1) {
+            Box b = __builtin_ctz(boxes);
+            if (isBitboardBoxCapturable(board, b)) {
+                numCaptured += makeBitboardMove(board, getOtherFreeEdge(board, b, NO_EDGE));
+                foundCapture = true;
+            }
+        }
+    }
+
+    return numCaptured;
+}
+
+static Edge getDecliningMove(const Bitboard * board, Box b) {
+    // b can be captured. If b is one of the last 2 boxes of a chain, or one of the last 4 of an
+    // opened loop, returns the move which hands them to the opponent (a double-dealing move).
+    // Otherwise taking b gives nothing up, and NO_EDGE is returned.
+    Edge e = getOtherFreeEdge(board, b, NO_EDGE);
+    Box c = getBoxAcrossEdge(e, b);
+    if (c == NO_BOX || getBoxDegree(board, c) != 2)
+        return NO_EDGE;
+
+    Edge f = getOtherFreeEdge(board, c, e);
+    Box d = getBoxAcrossEdge(f, c);
+    if (d == NO_BOX || getBoxDegree(board, d) >= 3)
+        return f; // leaves b and c as a domino
+
+    if (getBoxDegree(board, d) == 2) {
+        Box end = getBoxAcrossEdge(getOtherFreeEdge(board, d, f), d);
+        if (end != NO_BOX && isBitboardBoxCapturable(board, end))
+            return f; // leaves two dominoes
+    }
+
+    return NO_EDGE;
+}
+
+short resolveBitboardCaptures(Bitboard * board, Edge * decliningMove) {
+    // Takes every box that can be taken without giving up a choice, and returns how many were taken.
+    // If decliningMove isn't NO_EDGE afterwards, the player to move (still the capturer) has to choose
+    // between taking the rest with captureAllBitboardBoxes and playing decliningMove.
+    // Only the last chain taken can be declined, so when several could be, all but one are taken.
+    short numCaptured = 0;
+    bool foundCapture = true;
+
+    while (foundCapture) {
+        foundCapture = false;
+        *decliningMove = NO_EDGE;
+        Box decisionBox = NO_BOX;
+        bool hasOtherDecision = false;
+
+        for (unsigned int boxes = getCapturableBoxes(board); boxes != 0; boxes &= boxes - 1) {
+            // Follow the chain from b: only the box across a captured edge can become capturable.
+            Box box = __builtin_ctz(boxes);
+            while (box != NO_BOX && isBitboardBoxCapturable(board, box)) {
+                Edge declining = getDecliningMove(board, box);
+                if (declining != NO_EDGE) {
+                    if (decisionBox == NO_BOX) {
+                        decisionBox = box;
+                        *decliningMove = declining;
+                    }
+                    else if (declining != *decliningMove) // both ends of an opened loop give the same move
+                        hasOtherDecision = true;
+                    break;
+                }
+
+                Edge e = getOtherFreeEdge(board, box, NO_EDGE);
+                numCaptured += makeBitboardMove(board, e);
+                foundCapture = true;
+                box = getBoxAcrossEdge(e, box);
+            }
+        }
+
+        // Without a decision nothing is left to take. Otherwise captures made after a decision was
+        // found may have changed it, so look again.
+        if (decisionBox == NO_BOX)
+            break;
+
+        if (!foundCapture && hasOtherDecision) {
+            numCaptured += makeBitboardMove(board, getOtherFreeEdge(board, decisionBox, NO_EDGE));
+            foundCapture = true;
+        }
+    }
+
+    return numCaptured;
+}
+
+short getBitboardMacroMoves(const Bitboard * board, MacroMove * moves) {
+    // Fills moves with the ways of playing out the captures available on board and returns how many there are.
+    // The first always takes everything. When the last chain can be declined, the second takes all
+    // but its last 2 (or 4) boxes and double-deals. Returns 0 when there is nothing to capture.
+    Bitboard resolved = *board;
+    Edge decliningMove;
+    short numCaptured = resolveBitboardCaptures(&resolved, &decliningMove);
+    if (numCaptured == 0 && decliningMove == NO_EDGE)
+        return 0;
+
+    Bitboard taken = resolved;
+    moves[0].numBoxes = numCaptured;
+    if (decliningMove != NO_EDGE)
+        moves[0].numBoxes += captureAllBitboardBoxes(&taken);
+    moves[0].edges.lo = taken.lo & ~board->lo;
+    moves[0].edges.hi = taken.hi & ~board->hi;
+    moves[0].keepsTurn = true;
+
+    if (decliningMove == NO_EDGE)
+        return 1;
+
+    setBitboardEdgeTaken(&resolved, decliningMove);
+    moves[1].numBoxes = numCaptured;
+    moves[1].edges.lo = resolved.lo & ~board->lo;
+    moves[1].edges.hi = resolved.hi & ~board->hi;
+    moves[1].keepsTurn = false;
+
+    return 2;
+}
+
+void getBitboardStructure(const Bitboard * board, BitboardStructure * structure) {
+    // Walks every run of boxes with exactly 2 free edges.
+    // A run which arrives back at its first box is a loop, anything else is a chain.
+    memset(structure, 0, sizeof(BitboardStructure));
+    unsigned int visited = 0;
+
+    for (Box b=0; b < NUM_BOXES; b++) {
+        if ((visited & (1u << b)) || getBoxDegree(board, b) != 2)
+            continue;
+
+        visited |= 1u << b;
+        short length = 1;
+        bool isLoop = false;
+
+        Edge ends[2];
+        ends[0] = getOtherFreeEdge(board, b, NO_EDGE);
+        ends[1] = getOtherFreeEdge(board, b, ends[0]);
+
+        for (short side=0; side < 2 && !isLoop; side++) {
+            Edge e = ends[side];
+            Box current = getBoxAcrossEdge(e, b);
+
+            while (current != NO_BOX && getBoxDegree(board, current) == 2) {
+                if (current == b) {
+                    isLoop = true;
+                    break;
+                }
+                if (visited & (1u << current))
+                    break;
+
+                visited |= 1u << current;
+                length++;
+
+                e = getOtherFreeEdge(board, current, e);
+                current = getBoxAcrossEdge(e, current);
+            }
+        }
+
+        if (isLoop) {
+            structure->numLoops++;
+            structure->loopBoxes += length;
+        }
+        else if (length >= 3) {
+            structure->numLongChains++;
+            structure->longChainBoxes += length;
+        }
+        else {
+            structure->numShortChains++;
+            structure->shortChainBoxes += length;
+        }
+    }
+}
+
+short getBitboardStaticEvaluation(const Bitboard * board) {
+    // Returns how many of the remaining boxes the player to move can expect to get.
+    //
+    // Forced captures are taken first. After that the generalised long chain rule decides
+    // who ends up in control: with F free edges, B boxes left and L long chains, the player
+    // to move makes the last move of the game when F - B + L is odd.
+    // The controller keeps the long chains and loops apart from the boxes it hands back to
+    // stay in control (2 per chain but the last, 4 per loop). Everything else is split evenly.
+    Bitboard tmpBoard = *board;
+    short numCaptured = captureAllBitboardBoxes(&tmpBoard);
+
+    short numBoxesLeft = getBitboardNumBoxesLeft(&tmpBoard);
+    if (numBoxesLeft == 0)
+        return numCaptured;
+
+    BitboardStructure structure;
+    getBitboardStructure(&tmpBoard, &structure);
+
+    if (structure.numLongChains + structure.numLoops == 0)
+        return numCaptured + numBoxesLeft/2;
+
+    short numFreeEdges = getBitboardNumFreeEdges(&tmpBoard);
+    bool moverHasControl = ((numFreeEdges - numBoxesLeft + structure.numLongChains) & 1) == 1;
+
+    short longBoxes = structure.longChainBoxes + structure.loopBoxes;
+    short sacrificed;
+    if (structure.numLongChains > 0)
+        sacrificed = 2 * (structure.numLongChains - 1) + 4 * structure.numLoops;
+    else
+        sacrificed = 4 * (structure.numLoops - 1);
+
+    // The controller can always give up control and settle for half.
+    short controllerLongBoxes = max(longBoxes - sacrificed, (longBoxes + 1)/2);
+    short controllerBoxes = controllerLongBoxes + (numBoxesLeft - longBoxes)/2;
+
+    if (moverHasControl)
+        return numCaptured + controllerBoxes;
+    else
+        return numCaptured + numBoxesLeft - controllerBoxes;
+}
+
+void runBitboardTests() {
+    log_log("RUNNING BITBOARD TESTS\n");
+
+    UnscoredState state;
+    Bitboard board;
+    BitboardStructure structure;
+
+    log_log("Testing unscoredStateToBitboard...\n");
+    log_debug("It should set exactly the taken edges.\n");
+    stringToUnscoredState(&state, "100000000000000000000000000000000000000000000000000000000000000000000001");
+    unscoredStateToBitboard(&board, &state);
+    assert(board.lo == 1ULL);
+    assert(board.hi == 1ULL << 7);
+    assert(isBitboardEdgeTaken(&board, 0));
+    assert(isBitboardEdgeTaken(&board, 71));
+    assert(!isBitboardEdgeTaken(&board, 70));
+    assert(getBitboardNumFreeEdges(&board) == NUM_EDGES - 2);
+
+    log_log("Testing countBits...\n");
+    log_debug("It should count the set bits of any word.\n");
+    assert(countBits(0ULL) == 0);
+    assert(countBits(~0ULL) == 64);
+    assert(countBits(0x8000000000000001ULL) == 2);
+    assert(countBits(0x00f0f0f0f0f0f0f0ULL) == 28);
+
+    log_log("Testing isBitboardFull...\n");
+    log_debug("It should only be true once all 72 edges are taken.\n");
+    Bitboard fullBoard = {~0ULL, BITBOARD_HI_MASK};
+    assert(isBitboardFull(&fullBoard));
+    assert(getBitboardNumFreeEdges(&fullBoard) == 0);
+    setBitboardEdgeFree(&fullBoard, 71);
+    assert(!isBitboardFull(&fullBoard));
+    assert(!isBitboardFull(&board));
+
+    log_log("Testing getBitboardFreeEdges...\n");
+    log_debug("It should list every free edge in order, in both words.\n");
+    Edge freeEdges[NUM_EDGES];
+    assert(getBitboardFreeEdges(&board, freeEdges) == NUM_EDGES - 2);
+    for (short i=0; i < NUM_EDGES - 2; i++)
+        assert(freeEdges[i] == i + 1);
+
+    log_debug("It should round trip through bitboardToUnscoredState.\n");
+    UnscoredState roundTripState;
+    bitboardToUnscoredState(&roundTripState, &board);
+    for (Edge e=0; e < NUM_EDGES; e++)
+        assert(isEdgeTaken(&roundTripState, e) == isEdgeTaken(&state, e));
+
+    log_log("Testing getBitboardHash...\n");
+    log_debug("It should be deterministic and tell apart positions which differ by one edge.\n");
+    Bitboard otherBoard = board;
+    assert(getBitboardHash(&board) == getBitboardHash(&otherBoard));
+    setBitboardEdgeTaken(&otherBoard, 70);
+    assert(getBitboardHash(&board) != getBitboardHash(&otherBoard));
+    setBitboardEdgeFree(&otherBoard, 70);
+    setBitboardEdgeFree(&otherBoard, 0);
+    assert(getBitboardHash(&board) != getBitboardHash(&otherBoard));
+
+    log_log("Testing getBitboardBoxNumTakenEdges...\n");
+    log_debug("It should agree with getBoxNumTakenEdges for every box.\n");
+    stringToUnscoredState(&state, "111011111011111010011011111101111010100110111111110101111110011111010010");
+    unscoredStateToBitboard(&board, &state);
+    for (Box b=0; b < NUM_BOXES; b++)
+        assert(getBitboardBoxNumTakenEdges(&board, b) == getBoxNumTakenEdges(&state, b));
+    assert(getBitboardNumBoxesLeft(&board) == getNumBoxesLeft(&state));
+
+    log_log("Testing isBitboardBoxCapturable...\n");
+    log_debug("It should be true exactly for the boxes with 3 taken edges.\n");
+    for (Box b=0; b < NUM_BOXES; b++)
+        assert(isBitboardBoxCapturable(&board, b) == (getBoxNumTakenEdges(&state, b) == 3));
+    log_debug("It should handle the box whose edges straddle both words.\n");
+    Bitboard straddlingBoard = {0, 0};
+    setBitboardEdgeTaken(&straddlingBoard, 58);
+    setBitboardEdgeTaken(&straddlingBoard, 62);
+    assert(!isBitboardBoxCapturable(&straddlingBoard, 24));
+    setBitboardEdgeTaken(&straddlingBoard, 63);
+    assert(isBitboardBoxCapturable(&straddlingBoard, 24));
+    setBitboardEdgeTaken(&straddlingBoard, 68);
+    assert(!isBitboardBoxCapturable(&straddlingBoard, 24));
+
+    log_log("Testing makeBitboardMove...\n");
+    stringToUnscoredState(&state, "110000001010000001100000000000000000000000000000000000000000000000000000");
+    unscoredStateToBitboard(&board, &state);
+    log_debug("It should report both boxes completed by a double-cross.\n");
+    assert(makeBitboardMove(&board, 9) == 2);
+    assert(isBitboardEdgeTaken(&board, 9));
+    log_debug("It should report no boxes for a quiet move.\n");
+    assert(makeBitboardMove(&board, 40) == 0);
+
+    log_log("Testing captureAllBitboardBoxes...\n");
+    log_debug("It should take a single capturable box.\n");
+    stringToUnscoredState(&state, "100000001000000001000000000000000000000000000000000000000000000000000000");
+    unscoredStateToBitboard(&board, &state);
+    assert(captureAllBitboardBoxes(&board) == 1);
+    assert(getBitboardNumBoxesLeft(&board) == NUM_BOXES - 1);
+
+    log_debug("It should take a whole opened chain.\n");
+    // The top row is a chain of 8 boxes which has been opened at the left hand end.
+    stringToUnscoredState(&state, "111111111000000001111111111111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(captureAllBitboardBoxes(&board) == 8);
+    assert(getBitboardNumFreeEdges(&board) == 0);
+
+    log_log("Testing resolveBitboardCaptures...\n");
+    Edge decliningMove;
+    log_debug("It should take a box which is captured into the ground.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111111110");
+    unscoredStateToBitboard(&board, &state);
+    assert(resolveBitboardCaptures(&board, &decliningMove) == 1);
+    assert(decliningMove == NO_EDGE);
+
+    log_debug("It should stop an opened chain at its last 2 boxes.\n");
+    stringToUnscoredState(&state, "111111111000000001111111111111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(resolveBitboardCaptures(&board, &decliningMove) == 6);
+    assert(decliningMove == 16);
+    assert(captureAllBitboardBoxes(&board) == 2);
+
+    log_debug("It should stop an opened loop at its last 4 boxes.\n");
+    // Boxes 0, 1, 8 and 9 form a loop which has been opened by taking edge 9.
+    stringToUnscoredState(&state, "111111111111111110011111110111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(resolveBitboardCaptures(&board, &decliningMove) == 0);
+    assert(decliningMove == 26);
+    assert(captureAllBitboardBoxes(&board) == 4);
+
+    log_debug("It should only leave one chain to decide on.\n");
+    // Rows 0 and 1 are both chains of 8 opened at their left hand ends.
+    stringToUnscoredState(&state, "111111111000000001111111110000000011111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(resolveBitboardCaptures(&board, &decliningMove) == 14);
+    assert(decliningMove != NO_EDGE);
+    assert(getBitboardNumBoxesLeft(&board) == 2);
+
+    log_log("Testing getBitboardMacroMoves...\n");
+    MacroMove macroMoves[MAX_MACRO_MOVES];
+    log_debug("It should find nothing to capture on an empty board.\n");
+    initUnscoredState(&state);
+    unscoredStateToBitboard(&board, &state);
+    assert(getBitboardMacroMoves(&board, macroMoves) == 0);
+
+    log_debug("It should offer taking a whole opened chain or double-dealing its last 2 boxes.\n");
+    stringToUnscoredState(&state, "111111111000000001111111111111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(getBitboardMacroMoves(&board, macroMoves) == 2);
+    assert(macroMoves[0].numBoxes == 8 && macroMoves[0].keepsTurn);
+    assert(macroMoves[1].numBoxes == 6 && !macroMoves[1].keepsTurn);
+    assert(isBitboardEdgeTaken(&macroMoves[1].edges, 16) && !isBitboardEdgeTaken(&macroMoves[1].edges, 15));
+
+    log_debug("It should make and unmake a macro-move in one step.\n");
+    Bitboard before = board;
+    makeMacroMove(&board, &macroMoves[0]);
+    assert(getBitboardNumFreeEdges(&board) == 0);
+    unmakeMacroMove(&board, &macroMoves[0]);
+    assert(board.lo == before.lo && board.hi == before.hi);
+
+    log_debug("It should only offer taking a box which can't be declined.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111111110");
+    unscoredStateToBitboard(&board, &state);
+    assert(getBitboardMacroMoves(&board, macroMoves) == 1);
+    assert(macroMoves[0].numBoxes == 1);
+
+    log_log("Testing getBitboardStructure...\n");
+    log_debug("It should find nothing on an empty board.\n");
+    initUnscoredState(&state);
+    unscoredStateToBitboard(&board, &state);
+    getBitboardStructure(&board, &structure);
+    assert(structure.numLongChains == 0 && structure.numShortChains == 0 && structure.numLoops == 0);
+
+    log_debug("It should find a long chain along the top row.\n");
+    stringToUnscoredState(&state, "111111110000000001111111111111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    getBitboardStructure(&board, &structure);
+    assert(structure.numLongChains == 1);
+    assert(structure.longChainBoxes == 8);
+    assert(structure.numLoops == 0);
+
+    log_debug("It should find a loop of 4 boxes.\n");
+    // Only the 4 edges inside the block of boxes 0, 1, 8 and 9 are free.
+    stringToUnscoredState(&state, "111111111011111110011111110111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    getBitboardStructure(&board, &structure);
+    assert(structure.numLoops == 1);
+    assert(structure.loopBoxes == 4);
+    assert(structure.numLongChains == 0);
+
+    log_log("Testing getBitboardStaticEvaluation...\n");
+    log_debug("It should split an empty board evenly.\n");
+    initUnscoredState(&state);
+    unscoredStateToBitboard(&board, &state);
+    assert(getBitboardStaticEvaluation(&board) == NUM_BOXES/2);
+
+    log_debug("It should return 0 for a finished board.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(getBitboardStaticEvaluation(&board) == 0);
+
+    log_debug("It should give a single long chain to the opponent of the player who must open it.\n");
+    stringToUnscoredState(&state, "111111110000000001111111111111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(getBitboardStaticEvaluation(&board) == 0);
+
+    log_debug("It should give a loop to the opponent of the player who must open it.\n");
+    stringToUnscoredState(&state, "111111111011111110011111110111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(getBitboardStaticEvaluation(&board) == 0);
+
+    log_debug("It should count the double-dealt boxes when two long chains are left.\n");
+    stringToUnscoredState(&state, "111111110000000001111111100000000011111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    getBitboardStructure(&board, &structure);
+    assert(structure.numLongChains == 2);
+    assert(getBitboardStaticEvaluation(&board) == 2);
+
+    log_debug("It should include forced captures in the player to move's share.\n");
+    stringToUnscoredState(&state, "111111111000000001111111111111111111111111111111111111111111111111111111");
+    unscoredStateToBitboard(&board, &state);
+    assert(getBitboardStaticEvaluation(&board) == 8);
+
+    log_log("BITBOARD TESTS COMPLETED\n\n");
+}
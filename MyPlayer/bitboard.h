@@ -0,0 +1,96 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdbool.h>
+#include "game_board.h"
+
+// The same information as an UnscoredState packed into two words.
+// Bit e is set when edge e is taken: edges 0-63 live in lo, edges 64-71 in hi.
+typedef struct Bitboard {
+    unsigned long long lo;
+    unsigned long long hi;
+} Bitboard;
+
+// Summary of the chains and loops formed by boxes with exactly two free edges.
+typedef struct BitboardStructure {
+    short numLongChains; // chains of 3 or more boxes
+    short numShortChains;
+    short numLoops;
+    short longChainBoxes;
+    short shortChainBoxes;
+    short loopBoxes;
+} BitboardStructure;
+
+// A whole capture sequence played as a single move. Every edge in edges is taken at once,
+// so making and unmaking it is one OR and one AND-NOT whatever the length of the chain.
+typedef struct MacroMove {
+    Bitboard edges;
+    short numBoxes; // boxes completed by the player making the move
+    bool keepsTurn; // false when the sequence ends by double-dealing
+} MacroMove;
+
+#define MAX_MACRO_MOVES 2
+#define BITBOARD_HI_MASK ((1ULL << (NUM_EDGES - 64)) - 1)
+
+static inline short countBits(unsigned long long x) {
+    // Without -mpopcnt (or a -march which has it) __builtin_popcountll is a call into libgcc, which
+    // costs more than the handful of shifts and masks it replaces here.
+#ifdef __POPCNT__
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (short)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static inline bool isBitboardFull(const Bitboard * board) {
+    return board->lo == ~0ULL && board->hi == BITBOARD_HI_MASK;
+}
+
+static inline bool isBitboardEdgeTaken(const Bitboard * board, Edge e) {
+    return e < 64 ? (board->lo >> e) & 1ULL : (board->hi >> (e - 64)) & 1ULL;
+}
+
+static inline void setBitboardEdgeTaken(Bitboard * board, Edge e) {
+    if (e < 64)
+        board->lo |= 1ULL << e;
+    else
+        board->hi |= 1ULL << (e - 64);
+}
+
+static inline void setBitboardEdgeFree(Bitboard * board, Edge e) {
+    if (e < 64)
+        board->lo &= ~(1ULL << e);
+    else
+        board->hi &= ~(1ULL << (e - 64));
+}
+
+static inline void makeMacroMove(Bitboard * board, const MacroMove * move) {
+    board->lo |= move->edges.lo;
+    board->hi |= move->edges.hi;
+}
+
+static inline void unmakeMacroMove(Bitboard * board, const MacroMove * move) {
+    board->lo &= ~move->edges.lo;
+    board->hi &= ~move->edges.hi;
+}
+
+void unscoredStateToBitboard(Bitboard * board, const UnscoredState * state);
+void bitboardToUnscoredState(UnscoredState * state, const Bitboard * board);
+unsigned long long getBitboardHash(const Bitboard * board);
+short getBitboardNumFreeEdges(const Bitboard * board);
+short getBitboardFreeEdges(const Bitboard * board, Edge * freeEdges);
+short getBitboardBoxNumTakenEdges(const Bitboard * board, Box b);
+short getBitboardNumBoxesLeft(const Bitboard * board);
+bool isBitboardBoxCapturable(const Bitboard * board, Box b);
+short makeBitboardMove(Bitboard * board, Edge e);
+short captureAllBitboardBoxes(Bitboard * board);
+short resolveBitboardCaptures(Bitboard * board, Edge * decliningMove);
+short getBitboardMacroMoves(const Bitboard * board, MacroMove * moves);
+void getBitboardStructure(const Bitboard * board, BitboardStructure * structure);
+short getBitboardStaticEvaluation(const Bitboard * board);
+void runBitboardTests();
+
+#endif
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "game_board.h"
+#include "util.h"
+#include "bitboard.h"
+#include "endgame.h"
+
+// Exact solver for small endgames. The free edges are renumbered 0 .. numEdges-1 so that a
+// position is a single word with one bit per taken edge, and every box left knows its edges as
+// a mask of those bits. Net scores are found by negamax alpha-beta over integer windows.
+#define ENDGAME_TABLE_SIZE (1 << 19) // must be a power of 2
+#define ENDGAME_NO_BOX -1
+#define ENDGAME_NO_EDGE -1
+
+typedef enum {
+    ENDGAME_BOUND_EXACT,
+    ENDGAME_BOUND_LOWER,
+    ENDGAME_BOUND_UPPER
+} EndgameBound;
+
+typedef struct EndgameBoard {
+    short numEdges;
+    Edge edges[ENDGAME_MAX_FREE_EDGES]; // the board edge behind each local edge
+    short numBoxes;
+    unsigned int boxMasks[NUM_BOXES];   // the local edges of each box left
+    signed char edgeBoxes[ENDGAME_MAX_FREE_EDGES][2]; // the local boxes of each local edge, ENDGAME_NO_BOX for the ground
+    unsigned int allEdges;
+} EndgameBoard;
+
+typedef struct EndgameEntry {
+    unsigned int taken;
+    unsigned short generation;
+    signed char value;
+    signed char bestMove;
+    unsigned char bound;
+} EndgameEntry;
+
+typedef struct EndgameSearch {
+    const EndgameBoard * board;
+    int nodesVisited;
+    int tableHits;
+} EndgameSearch;
+
+// Positions are only meaningful for the board they were solved on, so every solve gets a new
+// generation and entries from older ones are ignored rather than cleared.
+static EndgameEntry endgameTable[ENDGAME_TABLE_SIZE];
+static unsigned short endgameGeneration = 0;
+
+static void initEndgameBoard(EndgameBoard * board, const UnscoredState * state) {
+    short boxToLocal[NUM_BOXES];
+    board->numBoxes = 0;
+    for (Box b=0; b < NUM_BOXES; b++) {
+        boxToLocal[b] = ENDGAME_NO_BOX;
+
+        if (getBoxNumTakenEdges(state, b) < 4) {
+            boxToLocal[b] = board->numBoxes;
+            board->boxMasks[board->numBoxes++] = 0;
+        }
+    }
+
+    board->numEdges = 0;
+    for (Edge e=0; e < NUM_EDGES; e++) {
+        if (isEdgeTaken(state, e))
+            continue;
+
+        short local = board->numEdges++;
+        board->edges[local] = e;
+
+        const Box * edgeBoxes = getEdgeBoxes(e);
+        for (short i=0; i < 2; i++) {
+            short localBox = edgeBoxes[i] == NO_BOX ? ENDGAME_NO_BOX : boxToLocal[edgeBoxes[i]];
+            board->edgeBoxes[local][i] = localBox;
+
+            if (localBox != ENDGAME_NO_BOX)
+                board->boxMasks[localBox] |= 1u << local;
+        }
+    }
+
+    board->allEdges = (1u << board->numEdges) - 1;
+}
+
+static int getEndgameBoxDegree(const EndgameBoard * board, unsigned int taken, short box) {
+    return __builtin_popcount(board->boxMasks[box] & ~taken);
+}
+
+static short getEndgameBoxAcross(const EndgameBoard * board, short edge, short box) {
+    return board->edgeBoxes[edge][0] == box ? board->edgeBoxes[edge][1] : board->edgeBoxes[edge][0];
+}
+
+static short getEndgameOtherFreeEdge(const EndgameBoard * board, unsigned int taken, short box, short from) {
+    // box must have a free edge other than from.
+    return __builtin_ctz(board->boxMasks[box] & ~taken & ~(1u << from));
+}
+
+static short getEndgameDecliningMove(const EndgameBoard * board, unsigned int taken, short box, short edge) {
+    // The same test as the bitboard capture resolver: box can be captured through edge, and the
+    // capture gives something up only if box is one of the last 2 boxes of a chain or 4 of a loop.
+    short c = getEndgameBoxAcross(board, edge, box);
+    if (c == ENDGAME_NO_BOX || getEndgameBoxDegree(board, taken, c) != 2)
+        return ENDGAME_NO_EDGE;
+
+    short f = getEndgameOtherFreeEdge(board, taken, c, edge);
+    short d = getEndgameBoxAcross(board, f, c);
+    if (d == ENDGAME_NO_BOX || getEndgameBoxDegree(board, taken, d) >= 3)
+        return f;
+
+    if (getEndgameBoxDegree(board, taken, d) == 2) {
+        short end = getEndgameBoxAcross(board, getEndgameOtherFreeEdge(board, taken, d, f), d);
+        if (end != ENDGAME_NO_BOX && getEndgameBoxDegree(board, taken, end) == 1)
+            return f;
+    }
+
+    return ENDGAME_NO_EDGE;
+}
+
+static short getEndgameMoves(const EndgameBoard * board, unsigned int taken, short hashMove, signed char * moves) {
+    // A capture which gives nothing up is the only move worth trying. When the last chain can be
+    // declined, only taking it and double-dealing are. Otherwise every free edge is a move: the
+    // best move from the table first, then moves that give nothing away, then the rest.
+    short decisionMove = ENDGAME_NO_EDGE;
+    short decliningMove = ENDGAME_NO_EDGE;
+    bool hasOtherDecision = false;
+
+    for (short box=0; box < board->numBoxes; box++) {
+        if (getEndgameBoxDegree(board, taken, box) != 1)
+            continue;
+
+        short edge = __builtin_ctz(board->boxMasks[box] & ~taken);
+        short declining = getEndgameDecliningMove(board, taken, box, edge);
+        if (declining == ENDGAME_NO_EDGE) {
+            moves[0] = edge;
+            return 1;
+        }
+
+        if (decisionMove == ENDGAME_NO_EDGE) {
+            decisionMove = edge;
+            decliningMove = declining;
+        }
+        else if (declining != decliningMove) // both ends of an opened loop give the same move
+            hasOtherDecision = true;
+    }
+
+    if (decisionMove != ENDGAME_NO_EDGE) {
+        moves[0] = decisionMove;
+        if (hasOtherDecision) // only the last chain taken needs deciding on
+            return 1;
+
+        moves[1] = decliningMove;
+        return 2;
+    }
+
+    short numMoves = 0;
+    if (hashMove != ENDGAME_NO_EDGE)
+        moves[numMoves++] = hashMove;
+
+    signed char unsafeMoves[ENDGAME_MAX_FREE_EDGES];
+    short numUnsafeMoves = 0;
+    for (short edge=0; edge < board->numEdges; edge++) {
+        if ((taken >> edge) & 1u || edge == hashMove)
+            continue;
+
+        bool isSafe = true;
+        for (short i=0; i < 2; i++) {
+            short box = board->edgeBoxes[edge][i];
+            if (box != ENDGAME_NO_BOX && getEndgameBoxDegree(board, taken, box) <= 2)
+                isSafe = false;
+        }
+
+        if (isSafe)
+            moves[numMoves++] = edge;
+        else
+            unsafeMoves[numUnsafeMoves++] = edge;
+    }
+
+    for (short i=0; i < numUnsafeMoves; i++)
+        moves[numMoves++] = unsafeMoves[i];
+
+    return numMoves;
+}
+
+static EndgameEntry * getEndgameEntry(unsigned int taken) {
+    return &endgameTable[(taken * 0x9E3779B1u) >> (32 - 19)];
+}
+
+static int searchEndgame(EndgameSearch * search, unsigned int taken, int alpha, int beta) {
+    // Returns the net score of the rest of the game for the player to move.
+    const EndgameBoard * board = search->board;
+    if (taken == board->allEdges)
+        return 0;
+
+    search->nodesVisited++;
+
+    EndgameEntry * entry = getEndgameEntry(taken);
+    short hashMove = ENDGAME_NO_EDGE;
+    if (entry->generation == endgameGeneration && entry->taken == taken) {
+        search->tableHits++;
+        hashMove = entry->bestMove;
+
+        if (entry->bound == ENDGAME_BOUND_EXACT ||
+                (entry->bound == ENDGAME_BOUND_LOWER && entry->value >= beta) ||
+                (entry->bound == ENDGAME_BOUND_UPPER && entry->value <= alpha))
+            return entry->value;
+    }
+
+    signed char moves[ENDGAME_MAX_FREE_EDGES];
+    short numMoves = getEndgameMoves(board, taken, hashMove, moves);
+
+    int originalAlpha = alpha;
+    int bestValue = -NUM_BOXES - 1;
+    short bestMove = ENDGAME_NO_EDGE; // the first move always beats bestValue
+    for (short i=0; i < numMoves; i++) {
+        short move = moves[i];
+        unsigned int childTaken = taken | (1u << move);
+
+        int numCompleted = 0;
+        for (short j=0; j < 2; j++) {
+            short box = board->edgeBoxes[move][j];
+            if (box != ENDGAME_NO_BOX && (board->boxMasks[box] & ~childTaken) == 0)
+                numCompleted++;
+        }
+
+        // Completing a box means moving again.
+        int value;
+        if (numCompleted > 0)
+            value = numCompleted + searchEndgame(search, childTaken, alpha - numCompleted, beta - numCompleted);
+        else
+            value = -searchEndgame(search, childTaken, -beta, -alpha);
+
+        if (value > bestValue) {
+            bestValue = value;
+            bestMove = move;
+        }
+
+        if (value > alpha)
+            alpha = value;
+        if (alpha >= beta)
+            break;
+    }
+
+    // Whatever was in the slot before is simply replaced.
+    entry->taken = taken;
+    entry->generation = endgameGeneration;
+    entry->value = bestValue;
+    entry->bestMove = bestMove;
+    if (bestValue <= originalAlpha)
+        entry->bound = ENDGAME_BOUND_UPPER;
+    else if (bestValue >= beta)
+        entry->bound = ENDGAME_BOUND_LOWER;
+    else
+        entry->bound = ENDGAME_BOUND_EXACT;
+
+    return bestValue;
+}
+
+bool getEndgameSolution(const UnscoredState * state, Edge * move, short * netScore) {
+    // Solves positions with at most ENDGAME_MAX_FREE_EDGES free edges. Sets move to a best move and
+    // netScore to the boxes the player to move wins minus those it loses from here on.
+    // Returns false when the position is too big or already over.
+    short numFreeEdges = getNumFreeEdges(state);
+    if (numFreeEdges == 0 || numFreeEdges > ENDGAME_MAX_FREE_EDGES)
+        return false;
+
+    unsigned long long startTime = getTimeMillis();
+
+    EndgameBoard board;
+    initEndgameBoard(&board, state);
+
+    if (++endgameGeneration == 0) { // wrapped round, so old entries could look current
+        memset(endgameTable, 0, sizeof(endgameTable));
+        endgameGeneration = 1;
+    }
+
+    EndgameSearch search;
+    search.board = &board;
+    search.nodesVisited = 0;
+    search.tableHits = 0;
+
+    short numBoxesLeft = getNumBoxesLeft(state);
+    *netScore = searchEndgame(&search, 0, -numBoxesLeft - 1, numBoxesLeft + 1);
+
+    // The root is always the last entry written, so its best move is still there.
+    *move = board.edges[getEndgameEntry(0)->bestMove];
+
+    log_log("getEndgameSolution: Net score %d with move %d. Time spent: %llu, Nodes visited: %d, Table hits: %d\n",
+        *netScore, *move, getTimeMillis() - startTime, search.nodesVisited, search.tableHits);
+
+    return true;
+}
+
+Edge getEndgameMove(const UnscoredState * state) {
+    Edge move;
+    short netScore;
+    if (!getEndgameSolution(state, &move, &netScore))
+        return NO_EDGE;
+
+    return move;
+}
+
+static short solveEndgameByBruteForce(Bitboard * board) {
+    // Plain negamax over every move, used to check the solver.
+    short bestValue = -NUM_BOXES - 1;
+    bool hasMove = false;
+
+    for (Edge e=0; e < NUM_EDGES; e++) {
+        if (isBitboardEdgeTaken(board, e))
+            continue;
+
+        hasMove = true;
+        Bitboard childBoard = *board;
+        short numBoxesTaken = makeBitboardMove(&childBoard, e);
+        short childValue = solveEndgameByBruteForce(&childBoard);
+
+        short value = numBoxesTaken > 0 ? numBoxesTaken + childValue : -childValue;
+        if (value > bestValue)
+            bestValue = value;
+    }
+
+    return hasMove ? bestValue : 0;
+}
+
+void runEndgameTests() {
+    log_log("RUNNING ENDGAME TESTS\n");
+
+    UnscoredState state;
+    Edge move;
+    short netScore;
+
+    log_log("Testing getEndgameSolution...\n");
+    log_debug("It should take the last box.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111111110");
+    assert(getEndgameSolution(&state, &move, &netScore));
+    assert(move == 71 && netScore == 1);
+
+    log_debug("It should find that only 2 boxes can be had when two long chains must be opened.\n");
+    stringToUnscoredState(&state, "111111110000000001111111100000000011111111111111111111111111111111111111");
+    assert(getEndgameSolution(&state, &move, &netScore));
+    assert(netScore == 2 - 14);
+
+    log_debug("It should refuse positions that are over or too big.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111111111");
+    assert(!getEndgameSolution(&state, &move, &netScore));
+    initUnscoredState(&state);
+    assert(!getEndgameSolution(&state, &move, &netScore));
+    assert(getEndgameMove(&state) == NO_EDGE);
+
+    log_debug("It should agree with a brute force search on random positions with 8 free edges.\n");
+    for (short i=0; i < 20; i++) {
+        stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111111111");
+        for (short numFreed=0; numFreed < 8; ) {
+            Edge e = randomInRange(0, NUM_EDGES-1);
+            if (isEdgeTaken(&state, e)) {
+                setEdgeFree(&state, e);
+                numFreed++;
+            }
+        }
+
+        Bitboard board;
+        unscoredStateToBitboard(&board, &state);
+        assert(getEndgameSolution(&state, &move, &netScore));
+        assert(netScore == solveEndgameByBruteForce(&board));
+
+        // The move it gives must be worth the score it claims.
+        Bitboard childBoard = board;
+        short numBoxesTaken = makeBitboardMove(&childBoard, move);
+        short childValue = solveEndgameByBruteForce(&childBoard);
+        assert((numBoxesTaken > 0 ? numBoxesTaken + childValue : -childValue) == netScore);
+    }
+
+    log_log("ENDGAME TESTS COMPLETED\n\n");
+}
@@ -0,0 +1,14 @@
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include <stdbool.h>
+#include "game_board.h"
+
+// Positions with at most this many free edges are solved exactly by getEndgameSolution.
+#define ENDGAME_MAX_FREE_EDGES 24
+
+bool getEndgameSolution(const UnscoredState * state, Edge * move, short * netScore);
+Edge getEndgameMove(const UnscoredState * state);
+void runEndgameTests();
+
+#endif
@@ -148,6 +148,52 @@ void stringToUnscoredState(UnscoredState * state, const char * edge_data) {
     }
 }
 
+void initScoredState(ScoredState * state) {
+    for(Edge e=0; e<NUM_EDGES; e++)
+        state->edges[e] = FREE;
+
+    state->score_p1 = 0;
+    state->score_p2 = 0;
+}
+
+void scoredStateToUnscoredState(UnscoredState * state, const ScoredState * scoredState) {
+    for(Edge e=0; e<NUM_EDGES; e++)
+        state->edges[e] = scoredState->edges[e];
+}
+
+short updateScoredState(ScoredState * state, const UnscoredState * newState, PlayerNum player) {
+    // Moves state on to newState and gives player (1 or 2) every box completed in between.
+    // Returns the number of boxes given to player.
+    UnscoredState oldState;
+    scoredStateToUnscoredState(&oldState, state);
+
+    for(Edge e=0; e<NUM_EDGES; e++) {
+        if (isEdgeTaken(&oldState, e) && !isEdgeTaken(newState, e)) {
+            // Edges never become free during a game, so this must be a new one.
+            log_warn("[WARN] updateScoredState: Edge %d was taken and is now free. Starting a new game.\n", e);
+            initScoredState(state);
+            oldState = *newState; // the boxes on the board can't be given to anyone
+            break;
+        }
+    }
+
+    short numBoxesCompleted = getNumBoxesLeft(&oldState) - getNumBoxesLeft(newState);
+
+    if (player == 1)
+        state->score_p1 += numBoxesCompleted;
+    else
+        state->score_p2 += numBoxesCompleted;
+
+    for(Edge e=0; e<NUM_EDGES; e++)
+        state->edges[e] = newState->edges[e];
+
+    return numBoxesCompleted;
+}
+
+bool isScoredStateDecided(const ScoredState * state) {
+    return state->score_p1 >= WINNING_SCORE || state->score_p2 >= WINNING_SCORE;
+}
+
 void setEdgeTaken(UnscoredState * state, Edge e) {
     state->edges[e] = TAKEN;
 }
@@ -465,6 +511,31 @@ void runGameBoardTests() {
     stringToUnscoredState(&state, "100000001100000001000000000000000000000000000000000000000000000000000000");
     assert(getNumBoxesLeft(&state) == NUM_BOXES - 1);
 
+    log_log("Testing updateScoredState...\n");
+    ScoredState scoredState;
+    initScoredState(&scoredState);
+
+    log_debug("It should give the boxes completed since the last update to the given player.\n");
+    assert(updateScoredState(&scoredState, &state, 2) == 1);
+    assert(scoredState.score_p1 == 0 && scoredState.score_p2 == 1);
+
+    stringToUnscoredState(&state, "110000001110000001100000000000000000000000000000000000000000000000000000");
+    assert(updateScoredState(&scoredState, &state, 1) == 1);
+    assert(scoredState.score_p1 == 1 && scoredState.score_p2 == 1);
+    assert(isEdgeTaken(&state, 10) && scoredState.edges[10] == TAKEN);
+
+    log_debug("It should start again when an edge has been freed.\n");
+    stringToUnscoredState(&state, "100000001100000001000000000000000000000000000000000000000000000000000000");
+    assert(updateScoredState(&scoredState, &state, 1) == 0);
+    assert(scoredState.score_p1 == 0 && scoredState.score_p2 == 0);
+
+    log_log("Testing isScoredStateDecided...\n");
+    assert(!isScoredStateDecided(&scoredState));
+    scoredState.score_p1 = NUM_BOXES / 2;
+    scoredState.score_p2 = NUM_BOXES / 2 - 1;
+    assert(!isScoredStateDecided(&scoredState));
+    scoredState.score_p2 = WINNING_SCORE;
+    assert(isScoredStateDecided(&scoredState));
 
     log_log("GAME_BOARD TESTS COMPLETED\n\n");
 }
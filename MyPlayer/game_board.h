@@ -15,6 +15,8 @@
 // #define NUM_BOXES 9
 // #define NUM_EDGES 24
 
+#define WINNING_SCORE (NUM_BOXES / 2 + 1) // more than half of the boxes can't be caught up with
+
 #define NO_BOX 100
 #define NO_EDGE 100
 #define NO_PLAYER 100
@@ -45,6 +47,10 @@ typedef struct {
 Edge getCorrespondingCornerEdge(Edge e);
 void initUnscoredState(UnscoredState *);
 void stringToUnscoredState(UnscoredState *, const char *);
+void initScoredState(ScoredState *);
+void scoredStateToUnscoredState(UnscoredState *, const ScoredState *);
+short updateScoredState(ScoredState *, const UnscoredState *, PlayerNum);
+bool isScoredStateDecided(const ScoredState *);
 void setEdgeTaken(UnscoredState *, Edge);
 void setEdgeFree(UnscoredState *, Edge);
 short getNumFreeEdges(const UnscoredState * state);
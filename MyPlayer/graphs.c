@@ -6,19 +6,24 @@
 #include <math.h>
 #include <string.h>
 #include <bliss_C.h>
+#include <pthread.h>
 #include "game_board.h"
 #include "util.h"
+#include "arena.h"
+#include "bitboard.h"
 #include "graphs.h"
+#include "ucb.h"
+#include "mcts.h"
 
 static const short SUB_GRAPH_MAX = 20; // the largest number of sub graphs a single board can be split up into
 static const short URGENT_MOVE_MAX = 2; // the maximum number of urgent moves that can be returned
-static const short NEIGHBOUR_MAX = 24; // the maximum number of neighbours a node can have (the imaginary node can have up to 24) (the imaginary node can have up to 24)
+static const short NEIGHBOUR_MAX = 32; // the maximum number of neighbours a node can have (the imaginary node touches all 32 outer edges)
 
 void newAdjLists(SCGraph * graph);
 void freeAdjLists(SCGraph * graph);
 
-static AdjListNode * addAdjListNode(AdjList * list, short dest);
-static void removeAdjListNode(AdjList * list, short dest);
+static AdjListNode * addAdjListNode(Arena * arena, AdjList * list, short dest);
+static void removeAdjListNode(Arena * arena, AdjList * list, short dest);
 
 static void addConnection(SCGraph * graph, short node1, short node2);
 static void removeConnection(SCGraph * graph, short node1, short node2);
@@ -32,11 +37,17 @@ static bool areNodesConnected(const SCGraph * graph, short node1, short node2);
 static short getConnectedNodes(const SCGraph * graph, short node, short * nodeBuffer);
 
 static short getUrgentMoves(const SCGraph * graph, Edge * potentialMoves);
-static short getNonIsomorphicMoves(const SCGraph * graph, Edge * potentialMoves);
+static short getNonIsomorphicMoves(const SCGraph * graph, Edge * potentialMoves, const Edge * knownMoves, short numKnownMoves, Edge * knownRepresentatives);
 static short getSubGraphs(const SCGraph * superGraph, SCGraph *subGraphBuffer);
 
 void unscoredStateToSCGraph(SCGraph * graph, const UnscoredState * state) {
     // This function will malloc space for the graph's adjacency matrix
+    unscoredStateToArenaSCGraph(graph, state, NULL);
+}
+
+void unscoredStateToArenaSCGraph(SCGraph * graph, const UnscoredState * state, Arena * arena) {
+    // Like unscoredStateToSCGraph, but the adjacency lists come from arena (or the heap if it's NULL).
+    // Graphs in an arena don't need freeAdjLists, they are released with the arena.
     
     Box remainingBoxes[NUM_BOXES];
     short numRemainingBoxes = getRemainingBoxes(state, remainingBoxes);
@@ -50,7 +61,7 @@ void unscoredStateToSCGraph(SCGraph * graph, const UnscoredState * state) {
     graph->numArcs = 0;
     
     // Now we know how many nodes there are we can allocate space for the adjacency matrix.
-    newAdjLists(graph);
+    newArenaAdjLists(graph, arena);
     log_debug("Initialized adjacency lists.\n");
 
     graph->nodeToBox[0] = NO_BOX;
@@ -112,8 +123,25 @@ static BlissGraph * scGraphToBlissGraph(const SCGraph * scGraph) {
     return bGraph;
 }
 
+static void * allocGraphMemory(Arena * arena, size_t size) {
+    if (arena != NULL)
+        return arenaAlloc(arena, size);
+    else
+        return malloc(size);
+}
+
+static void freeGraphMemory(Arena * arena, void * memory) {
+    if (arena == NULL) // arena memory is given back all at once
+        free(memory);
+}
+
 void newAdjLists(SCGraph * graph) {
-    graph->adjLists = (AdjList *)malloc(graph->numNodes * sizeof(AdjList));
+    newArenaAdjLists(graph, NULL);
+}
+
+void newArenaAdjLists(SCGraph * graph, Arena * arena) {
+    graph->arena = arena;
+    graph->adjLists = (AdjList *)allocGraphMemory(arena, graph->numNodes * sizeof(AdjList));
 
     for(short i=0; i < graph->numNodes; i++) {
         graph->adjLists[i].length = 0;
@@ -122,6 +150,9 @@ void newAdjLists(SCGraph * graph) {
 }
 
 void freeAdjLists(SCGraph * graph) {
+    if (graph->arena != NULL)
+        return;
+
     for(short i=0; i < graph->numNodes; i++) {
         AdjList * al = &(graph->adjLists[i]);
 
@@ -137,12 +168,12 @@ void freeAdjLists(SCGraph * graph) {
 }
 
 void copySCGraph(SCGraph * destGraph, const SCGraph * srcGraph) {
-    // Will also malloc new adjLists in destGraph, so careful for memory leaks.
+    // Will also malloc new adjLists in destGraph (in the same arena as srcGraph, if it has one), so careful for memory leaks.
     
     destGraph->numNodes = srcGraph->numNodes;
     destGraph->numArcs = 0; // will be incremented when arcs are added
 
-    newAdjLists(destGraph);
+    newArenaAdjLists(destGraph, srcGraph->arena);
 
     for (short i=0; i < srcGraph->numNodes; i++) {
         destGraph->nodeToBox[i] = srcGraph->nodeToBox[i];
@@ -175,11 +206,11 @@ static void printSCGraph(const SCGraph * graph) {
     }
 }
 
-static AdjListNode * addAdjListNode(AdjList * list, short dest) {
+static AdjListNode * addAdjListNode(Arena * arena, AdjList * list, short dest) {
     AdjListNode * newNode;
 
     if (list->head == NULL) {
-        list->head = (AdjListNode *)malloc(sizeof(AdjListNode));
+        list->head = (AdjListNode *)allocGraphMemory(arena, sizeof(AdjListNode));
         newNode = list->head;
     }
     else {
@@ -188,7 +219,7 @@ static AdjListNode * addAdjListNode(AdjList * list, short dest) {
             connectedNode = connectedNode->next;
         }
 
-        connectedNode->next = (AdjListNode *)malloc(sizeof(AdjListNode));
+        connectedNode->next = (AdjListNode *)allocGraphMemory(arena, sizeof(AdjListNode));
         newNode = connectedNode->next;
     }
 
@@ -200,12 +231,12 @@ static AdjListNode * addAdjListNode(AdjList * list, short dest) {
     return newNode;
 }
 
-static void removeAdjListNode(AdjList * list, short dest) {
+static void removeAdjListNode(Arena * arena, AdjList * list, short dest) {
     if (list->head == NULL)
         return;
     else if (list->head->dest == dest) {
         AdjListNode * next = list->head->next;
-        free(list->head);
+        freeGraphMemory(arena, list->head);
         list->head = next;
         list->length--;
         return;
@@ -226,7 +257,7 @@ static void removeAdjListNode(AdjList * list, short dest) {
 
         // Else remove the link
         prevNode->next = currentNode->next;
-        free(currentNode); 
+        freeGraphMemory(arena, currentNode);
         list->length--;
     }
 }
@@ -236,8 +267,8 @@ static void addConnection(SCGraph * graph, short node1, short node2) {
     AdjList * node1List = &(graph->adjLists[node1]);
     AdjList * node2List = &(graph->adjLists[node2]);
 
-    addAdjListNode(node1List, node2);
-    addAdjListNode(node2List, node1);
+    addAdjListNode(graph->arena, node1List, node2);
+    addAdjListNode(graph->arena, node2List, node1);
 
     graph->numArcs++;
 }
@@ -280,8 +311,8 @@ static void removeConnection(SCGraph * graph, short node1, short node2) {
     AdjList * node1List = &(graph->adjLists[node1]);
     AdjList * node2List = &(graph->adjLists[node2]);
 
-    removeAdjListNode(node1List, node2);
-    removeAdjListNode(node2List, node1);
+    removeAdjListNode(graph->arena, node1List, node2);
+    removeAdjListNode(graph->arena, node2List, node1);
 
     graph->numArcs--;
 }
@@ -418,7 +449,7 @@ static short getSubGraphs(const SCGraph * superGraph, SCGraph *subGraphBuffer) {
     // Returns the number of sub-graphs found.
     short label = 0;
     short numAlreadyLabelled = 1; // let 0 be labelled
-    BTree * alreadyLabelled = newBTree(0);
+    bool isLabelled[NUM_BOXES+1] = {true}; // node 0 starts off labelled
     short nodeToLabel[superGraph->numNodes];
     nodeToLabel[0] = 0; // node 0 (the imaginary node) is labelled with the unique label 0
 
@@ -438,7 +469,7 @@ static short getSubGraphs(const SCGraph * superGraph, SCGraph *subGraphBuffer) {
             for(short node=1; node < superGraph->numNodes; node++) {
                 //log_debug("getSubGraphs: considering node %d\n", node);
 
-                if(!doesBTreeContain(alreadyLabelled, node)) {
+                if(!isLabelled[node]) {
                     if (getNodeValency(superGraph, node) == 0) // it's isolated so don't consider it
                         nodeToLabel[node] = -1;
                     else {
@@ -446,9 +477,12 @@ static short getSubGraphs(const SCGraph * superGraph, SCGraph *subGraphBuffer) {
                         currentLabelStack[++currentLabelStackHead] = node;
                     }
 
-                    insertBTree(alreadyLabelled, node);
+                    isLabelled[node] = true;
                     numAlreadyLabelled++;
                     log_debug("getSubGraphs: labelled %d.\n", node);
+
+                    if (currentLabelStackHead != -1) // the rest of this label is found from here
+                        break;
                 }
                 else {
                     //log_debug("getSubGraphs: node is already labelled.\n");
@@ -470,9 +504,9 @@ static short getSubGraphs(const SCGraph * superGraph, SCGraph *subGraphBuffer) {
                 short neighbour = neighbours[i];
                 //log_debug("Considering neighbour: %d\n", neighbour);
 
-                if(!doesBTreeContain(alreadyLabelled, neighbour)) {
+                if(!isLabelled[neighbour]) {
                     nodeToLabel[neighbour] = label;
-                    insertBTree(alreadyLabelled, neighbour);
+                    isLabelled[neighbour] = true;
                     numAlreadyLabelled++;
 
                     currentLabelStack[++currentLabelStackHead] = neighbour;
@@ -487,7 +521,6 @@ static short getSubGraphs(const SCGraph * superGraph, SCGraph *subGraphBuffer) {
     }
     assert(numAlreadyLabelled == superGraph->numNodes);
     log_debug("getSubGraphs: All nodes have been labelled!\n");
-    freeBTree(alreadyLabelled);
 
     short labelMax = label;
     log_debug("labelMax: %d\n", labelMax);
@@ -501,7 +534,7 @@ static short getSubGraphs(const SCGraph * superGraph, SCGraph *subGraphBuffer) {
         subGraph->numNodes = 0;
         subGraph->nodeToBox[0] = NO_BOX;
 
-        short subToSup[NUM_BOXES]; // the node indexed e.g. 4 in the superGraph might be indexed 1 in the subGraph. So this maps the two.
+        short subToSup[NUM_BOXES+1]; // the node indexed e.g. 4 in the superGraph might be indexed 1 in the subGraph. So this maps the two.
         subToSup[0] = 0;
         short subNodeCounter = 1;
         for(short superN=1; superN < superGraph->numNodes; superN++) {
@@ -517,7 +550,7 @@ static short getSubGraphs(const SCGraph * superGraph, SCGraph *subGraphBuffer) {
 
         subGraph->numNodes = subNodeCounter;
 
-        newAdjLists(subGraph);
+        newArenaAdjLists(subGraph, superGraph->arena);
 
         //log_debug("subGraph->numNodes = %d\n", subNodeCounter);
 
@@ -681,13 +714,13 @@ short getUrgentMoves(const SCGraph * graph, Edge * movesBuf) {
             short joints[NUM_BOXES];
             joints[0] = 0; // joints are nodes with valency 3 or 4
             short numJoints = 1;
-            BTree * visitedNodes = newBTree(0);
+            bool isVisited[NUM_BOXES+1] = {true}; // node 0 counts as visited
 
             for(short i=1; i < graph->numNodes; i++) {
                 short valency = getNodeValency(graph, i);
                 if (valency == 3 || valency == 4) {
                     joints[numJoints++] = i;
-                    insertBTree(visitedNodes, i);
+                    isVisited[i] = true;
                 }
             }
 
@@ -704,10 +737,10 @@ short getUrgentMoves(const SCGraph * graph, Edge * movesBuf) {
                 for(short j=0; j < numJointNeighbours; j++) {
                     short jointNeighbour = jointNeighbours[j];
 
-                    if (doesBTreeContain(visitedNodes, jointNeighbour))
+                    if (isVisited[jointNeighbour])
                         continue;
                     else
-                        insertBTree(visitedNodes, jointNeighbour);
+                        isVisited[jointNeighbour] = true;
 
                     log_debug("Considering joint neighbour %d with valency %d.\n", jointNeighbour, getNodeValency(graph, jointNeighbour));
 
@@ -732,10 +765,10 @@ short getUrgentMoves(const SCGraph * graph, Edge * movesBuf) {
                             currentNeighbour = chainNeighbours[0];
                         }
 
-                        if (doesBTreeContain(visitedNodes, currentNeighbour))
+                        if (isVisited[currentNeighbour])
                             break;
                         else
-                            insertBTree(visitedNodes, currentNeighbour);
+                            isVisited[currentNeighbour] = true;
 
                         chainLength++;
                     }
@@ -767,7 +800,6 @@ short getUrgentMoves(const SCGraph * graph, Edge * movesBuf) {
                     break;
             } // end iterating joints
 
-            freeBTree(visitedNodes);
         } // end looking for open chains
     } // end if(!foundMoves)
 
@@ -825,8 +857,9 @@ static unsigned int getGraphCanonicalHash(const SCGraph * graph) {
 }
 
 
-static short getNonIsomorphicMoves(const SCGraph * graph, Edge * movesBuf) {
+static short getNonIsomorphicMoves(const SCGraph * graph, Edge * movesBuf, const Edge * knownMoves, short numKnownMoves, Edge * knownRepresentatives) {
     // Return all moves which don't lead to isomorphic positions.
+    // Any of the knownMoves found in the graph gets the returned move it is isomorphic to in knownRepresentatives.
     log_debug("getNonIsomorphicMoves: Running for:\n");
     //printSCGraph(graph);
 
@@ -857,6 +890,7 @@ static short getNonIsomorphicMoves(const SCGraph * graph, Edge * movesBuf) {
 
         // Iterate through already-seen graphs
         bool isomorphic = false;
+        short representative = 0; // the child graphs line up with movesBuf
         for (short j=0; j < numChildGraphs; j++) {
             SCGraph * otherGraph = &childGraphs[j];
 
@@ -865,12 +899,18 @@ static short getNonIsomorphicMoves(const SCGraph * graph, Edge * movesBuf) {
                     childGraphHash == childGraphsHashes[j]) {
                 log_debug("getNonIsomorphicMoves: Graphs are isomorphic!\n");
                 isomorphic = true;
+                representative = j;
                 break;
             }
         }
 
+        Edge move = boxPairToEdge(graph->nodeToBox[node1], graph->nodeToBox[node2]);
+        for (short k=0; k < numKnownMoves; k++) {
+            if (knownMoves[k] == move)
+                knownRepresentatives[k] = isomorphic ? movesBuf[representative] : move;
+        }
+
         if (!isomorphic) {
-            Edge move = boxPairToEdge(graph->nodeToBox[node1], graph->nodeToBox[node2]);
             movesBuf[numMoves++] = move;
             childGraphsHashes[numChildGraphs] = childGraphHash;
             childGraphs[numChildGraphs++] = childGraph;
@@ -891,96 +931,246 @@ static short getNonIsomorphicMoves(const SCGraph * graph, Edge * movesBuf) {
 } 
 
 short getGraphsPotentialMoves(const SCGraph * graph, Edge * potentialMoves) {
+    return getGraphsPotentialMovesAndRepresentatives(graph, potentialMoves, NULL, 0, NULL);
+}
+
+short getGraphsPotentialMovesAndRepresentatives(const SCGraph * graph, Edge * potentialMoves, const Edge * moves, short numMoves, Edge * representatives) {
+    // As getGraphsPotentialMoves, but also maps each of the given board moves to the returned move
+    // which leads to an isomorphic position. Moves with no such potential move get NO_EDGE.
+    Edge knownMoves[numMoves + 1];
+    for (short k=0; k < numMoves; k++) {
+        // A corner box's two outer edges are one arc, which the graph names by the box's first such edge
+        const Box * edgeBoxes = getEdgeBoxes(moves[k]);
+        knownMoves[k] = boxPairToEdge(edgeBoxes[0], edgeBoxes[1]);
+        representatives[k] = NO_EDGE;
+    }
+
     SCGraph subGraphs[SUB_GRAPH_MAX];
     short numSubGraphs = getSubGraphs(graph, subGraphs);
     log_debug("getGraphsPotentialMoves: %d subgraphs found for given graph.\n", numSubGraphs);
-    short numMoves = 0;
+    short numPotentialMoves = 0;
 
     bool foundUrgentMoves = false;
     // First check for urgent moves. If a subgraph has some, return them.
     for(short i=0; i < numSubGraphs; i++) {
-        numMoves = getUrgentMoves(&subGraphs[i], potentialMoves);
+        numPotentialMoves = getUrgentMoves(&subGraphs[i], potentialMoves);
 
-        if (numMoves > 0) {
+        if (numPotentialMoves > 0) {
             foundUrgentMoves = true;
             break;
         }
     }
 
-    if (!foundUrgentMoves) {
+    if (foundUrgentMoves) {
+        for (short k=0; k < numMoves; k++) {
+            for (short i=0; i < numPotentialMoves; i++) {
+                if (potentialMoves[i] == knownMoves[k])
+                    representatives[k] = knownMoves[k];
+            }
+        }
+    }
+    else {
         // Else return all non urgent moves
         for(short i=0; i < numSubGraphs; i++) {
-            numMoves += getNonIsomorphicMoves(&subGraphs[i], &(potentialMoves[numMoves]));
+            numPotentialMoves += getNonIsomorphicMoves(&subGraphs[i], &(potentialMoves[numPotentialMoves]), knownMoves, numMoves, representatives);
         }
     }
 
     for(short i=0; i < numSubGraphs; i++)
         freeAdjLists(&subGraphs[i]);
 
-    log_debug("getGraphsPotentialMoves: Returning %d moves. urgent=%d\n", numMoves, foundUrgentMoves);
+    log_debug("getGraphsPotentialMoves: Returning %d moves. urgent=%d\n", numPotentialMoves, foundUrgentMoves);
 
-    return numMoves;
+    return numPotentialMoves;
 }
 
-void freeGMCTSNode(GMCTSNode * node) {
-    for (short i=0; i < node->numChildren; i++) 
-        freeGMCTSNode(node->children[i]);
+static Edge getGMCTSBoardEdge(const Bitboard * board, Edge move) {
+    // The move might be a corner move in which case it may need to be converted
+    return isBitboardEdgeTaken(board, move) ? getCorrespondingCornerEdge(move) : move;
+}
 
-    free(node);
+static void makeGMCTSBitboardMove(Bitboard * board, Edge move) {
+    setBitboardEdgeTaken(board, getGMCTSBoardEdge(board, move));
 }
 
-Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime) {
-    unsigned long long endTime = getTimeMillis() + maxRuntime;
+// Every GMCTS node and its child arrays come from the arena of the thread which created it, which is
+// reset when a search starts instead of freeing the tree node by node before replying. Its blocks
+// are kept between moves.
+//
+// When threads share one tree, it is changed as the plain MCTS shared tree is (see mcts.c): selection
+// adds virtual losses to the visits, backpropagation adds scores with compare-and-swap, a move is
+// claimed by a compare-and-swap on nextPotentialMoveIndex and its child is published into the
+// parent's children once it is set up. Children not published yet are NULL and are skipped.
+#define GMCTS_ARENA_BLOCK_SIZE (4 * 1024 * 1024)
+
+static Arena gmctsArenas[GMCTS_MAX_THREADS];
+
+// What the last search left for the next one to carry on from (see keepReusableGMCTSTrees).
+static GMCTSNode * lastGMCTSRoots[GMCTS_MAX_THREADS];
+static short numLastGMCTSRoots = 0;
+static Bitboard lastGMCTSRootBoard;
+static short lastGMCTSRootNumBoxesLeft;
+
+// The kept trees are copied in here while the arenas are reset, then it takes the first arena's place.
+static Arena gmctsSpareArena;
+
+typedef struct GMCTSWorker {
+    Arena * arena;
+    bool shareTree;
+    const SCGraph * rootGraph; // shared by every thread, which only copy it
+    const Bitboard * rootBoard;
+    short rootNumBoxesLeft;
+    unsigned long long endTime;
+    unsigned long long seed; // drawn by the calling thread, so a seeded client repeats its searches
+    GMCTSNode * rootNode;
+    int iterationCount;
+    int nodesCreated;
+    MCTSContention contention;
+} GMCTSWorker;
+
+static GMCTSNode * newGMCTSNode(Arena * arena, GMCTSNode * parent, short indexInParent, Edge move, short numBoxesTakenByMove) {
+    // The node is added to its parent by publishGMCTSNode once it is set up.
+    GMCTSNode * node = (GMCTSNode *)arenaAlloc(arena, sizeof(GMCTSNode));
+    node->parent = parent;
+    node->indexInParent = indexInParent;
+    node->visits = 0;
+    node->move = move;
+    node->numBoxesTakenByMove = numBoxesTakenByMove;
+    node->potentialMoves = NULL;
+    node->numPotentialMoves = 0;
+    node->nextPotentialMoveIndex = 0;
+    node->children = NULL;
+    node->childVisits = NULL;
+    node->childScores = NULL;
+    node->numChildren = 0;
+
+    return node;
+}
 
-    short rootNumBoxesLeft = getNumBoxesLeft(rootState);
-    log_log("getGraphsMonteCarloMove: Starting... Running for max %d milliseconds. Boxes left: %d.\n", maxRuntime, rootNumBoxesLeft);
+static void publishGMCTSNode(GMCTSNode * node, bool shareTree) {
+    GMCTSNode * parent = node->parent;
+    short i = node->indexInParent;
 
-    SCGraph rootGraph;
-    unscoredStateToSCGraph(&rootGraph, rootState);
+    if (!shareTree) {
+        parent->children[i] = node;
+        parent->numChildren++;
+        return;
+    }
 
-    GMCTSNode * rootNode = (GMCTSNode *)malloc(sizeof(GMCTSNode));
-    rootNode->parent = NULL;
-    rootNode->visits = 0;
-    rootNode->score = 0.0;
-    rootNode->move = NO_EDGE;
-    rootNode->numBoxesTakenByMove = 0;
-    // Use the expensive full isormorphism check for just the root node?
-    rootNode->numPotentialMoves = getGraphsPotentialMoves(&rootGraph, rootNode->potentialMoves);
-    rootNode->nextPotentialMoveIndex = 0;
-    rootNode->numChildren = 0;
+    // The node's first visit is added as a virtual loss before other threads can select it.
+    node->visits = 1;
+    __atomic_fetch_add(&parent->childVisits[i], 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&parent->children[i], node, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&parent->numChildren, 1, __ATOMIC_RELAXED);
+}
+
+static short claimGMCTSMove(GMCTSNode * node, bool shareTree, MCTSContention * contention) {
+    // Returns the index of the node's next untried move, or -1 when every move has been tried.
+    if (!shareTree)
+        return node->nextPotentialMoveIndex < node->numPotentialMoves ? node->nextPotentialMoveIndex++ : -1;
+
+    short i = __atomic_load_n(&node->nextPotentialMoveIndex, __ATOMIC_RELAXED);
+    while (i < node->numPotentialMoves) {
+        if (__atomic_compare_exchange_n(&node->nextPotentialMoveIndex, &i, i + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return i;
+        contention->claimRetries++;
+    }
+
+    return -1;
+}
+
+static short getBestSharedGMCTSChild(const GMCTSNode * node, MCTSContention * contention) {
+    // UCB1 as in getBestUCB1Index, reading each child atomically and skipping children which
+    // haven't been published yet. Returns -1 when there are none.
+    float parentTerm = getUCB1ParentTerm(__atomic_load_n(&node->visits, __ATOMIC_RELAXED), 0.7);
+
+    short bestIndex = -1;
+    float bestValue = -INFINITY;
+    for (short i=0; i < node->numPotentialMoves; i++) {
+        if (__atomic_load_n(&node->children[i], __ATOMIC_ACQUIRE) == NULL) {
+            contention->unvisitedChildren++;
+            continue;
+        }
+
+        float score;
+        __atomic_load(&node->childScores[i], &score, __ATOMIC_RELAXED);
+        float inverseVisits = 1.0f / (float)__atomic_load_n(&node->childVisits[i], __ATOMIC_RELAXED);
+        float value = score * inverseVisits + parentTerm * sqrtf(inverseVisits);
+
+        if (value > bestValue) {
+            bestValue = value;
+            bestIndex = i;
+        }
+    }
+
+    return bestIndex;
+}
+
+static void setGMCTSNodePotentialMoves(Arena * arena, GMCTSNode * node, const Edge * potentialMoves, short numPotentialMoves) {
+    // Sizes the node's arrays to the moves it actually has, rather than to every edge.
+    node->numPotentialMoves = numPotentialMoves;
+    if (numPotentialMoves == 0)
+        return;
+
+    node->potentialMoves = (Edge *)arenaAlloc(arena, numPotentialMoves * sizeof(Edge));
+    node->children = (GMCTSNode **)arenaAlloc(arena, numPotentialMoves * sizeof(GMCTSNode *));
+    node->childVisits = (int *)arenaAlloc(arena, numPotentialMoves * sizeof(int));
+    node->childScores = (float *)arenaAlloc(arena, numPotentialMoves * sizeof(float));
+    memcpy(node->potentialMoves, potentialMoves, numPotentialMoves * sizeof(Edge));
+    memset(node->children, 0, numPotentialMoves * sizeof(GMCTSNode *));
+    memset(node->childVisits, 0, numPotentialMoves * sizeof(int));
+    memset(node->childScores, 0, numPotentialMoves * sizeof(float));
+}
+
+static void * runGMCTSWorker(void * arg) {
+    GMCTSWorker * worker = (GMCTSWorker *)arg;
+    seedRandom(worker->seed);
+
+    Arena * arena = worker->arena;
+    bool shareTree = worker->shareTree;
+    GMCTSNode * rootNode = worker->rootNode;
+    short rootNumBoxesLeft = worker->rootNumBoxesLeft;
+
+    Edge potentialMoves[NUM_EDGES];
 
-    int iterationCount = 0;
-    int nodesCreated = 0;
     while(true) {
-        log_debug("Iteration: %d\n", iterationCount);
-        iterationCount++;
-        if (iterationCount % 100 == 0 && getTimeMillis() > endTime)
+        log_debug("Iteration: %d\n", worker->iterationCount);
+        worker->iterationCount++;
+        if (worker->iterationCount % 100 == 0 && getTimeMillis() > worker->endTime)
             break;
 
         GMCTSNode * node = rootNode;
         SCGraph tmpGraph;
-        copySCGraph(&tmpGraph, &rootGraph);
+        copySCGraph(&tmpGraph, worker->rootGraph);
+        Bitboard tmpBoard = *worker->rootBoard;
         short simulationBoxesTaken = 0;
         short currentPlayer = 1;
 
-        while (node->numPotentialMoves > 0 && node->numChildren == node->numPotentialMoves) { // node is fully expanded and non-terminal
+        if (shareTree)
+            __atomic_fetch_add(&rootNode->visits, 1, __ATOMIC_RELAXED);
+
+        // node is fully expanded and non-terminal
+        while (node->numPotentialMoves > 0 && __atomic_load_n(&node->nextPotentialMoveIndex, __ATOMIC_RELAXED) == node->numPotentialMoves) {
             // select the most interesting child
             log_debug("Getting leaf node. Went down a level...\n");
-            float bestUCB = -1.0;
-            GMCTSNode * bestChild;
-            for (short i=0; i < node->numChildren; i++) {
-                GMCTSNode * child = node->children[i];
-
-                // Uses UCB1 formula
-                float ucb = child->score / (float)child->visits + 0.7 * sqrt(2*log(child->parent->visits)/child->visits);
-                if (ucb > bestUCB) {
-                    bestUCB = ucb;
-                    bestChild = child;
-                }
+            short bestIndex;
+            if (shareTree) {
+                bestIndex = getBestSharedGMCTSChild(node, &worker->contention);
+                if (bestIndex == -1) // every child is still being set up, so simulate from here
+                    break;
+            }
+            else
+                bestIndex = getBestUCB1Index(node->childScores, node->childVisits, node->numChildren, node->visits, 0.7);
+
+            GMCTSNode * bestChild = node->children[bestIndex];
+            if (shareTree) {
+                __atomic_fetch_add(&node->childVisits[bestIndex], 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&bestChild->visits, 1, __ATOMIC_RELAXED);
             }
 
             // make bestChild's move on tmpGraph
             removeConnectionEdge(&tmpGraph, bestChild->move);
+            makeGMCTSBitboardMove(&tmpBoard, bestChild->move);
 
             // Update simulationBoxesTaken and currentPlayer if the node's move took boxes
             if (bestChild->numBoxesTakenByMove == 0) {
@@ -994,22 +1184,16 @@ Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime) {
         
         // expand if the node is not terminal
         log_debug("Expanding...\n");
-        if (node->numPotentialMoves > 0) {
-            GMCTSNode * child = (GMCTSNode *)malloc(sizeof(GMCTSNode));
-            nodesCreated++;
-            node->children[node->numChildren++] = child;
-            child->parent = node;
-            child->visits = 0;
-            child->score = 0.0;
-
-            Edge move = node->potentialMoves[node->nextPotentialMoveIndex++];
-            child->move = move;
-
+        short moveIndex = node->numPotentialMoves > 0 ? claimGMCTSMove(node, shareTree, &worker->contention) : -1;
+        if (moveIndex != -1) {
+            Edge move = node->potentialMoves[moveIndex];
             short numBoxesTaken = getNumNodesTakenByMove(&tmpGraph, move);
-            child->numBoxesTakenByMove = numBoxesTaken;
+            GMCTSNode * child = newGMCTSNode(arena, node, moveIndex, move, numBoxesTaken);
+            worker->nodesCreated++;
 
             // Update the state
             removeConnectionEdge(&tmpGraph, move);
+            makeGMCTSBitboardMove(&tmpBoard, move);
             if (numBoxesTaken == 0)
                 currentPlayer = 3 - currentPlayer;
             else if (currentPlayer == 1)
@@ -1039,11 +1223,8 @@ Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime) {
                 child->numPotentialMoves = numUrgentMoves;
             }
             */
-            child->numPotentialMoves = getGraphsPotentialMoves(&tmpGraph, child->potentialMoves);
-
-            child->nextPotentialMoveIndex = 0;
-
-            child->numChildren = 0;
+            setGMCTSNodePotentialMoves(arena, child, potentialMoves, getGraphsPotentialMoves(&tmpGraph, potentialMoves));
+            publishGMCTSNode(child, shareTree);
 
             node = child;
         }
@@ -1057,6 +1238,26 @@ Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime) {
             }
 
             //printSCGraph(&tmpGraph);
+            // Captures are played out in one go, choosing at random whether to double-deal.
+            MacroMove macroMoves[MAX_MACRO_MOVES];
+            short numMacroMoves = getBitboardMacroMoves(&tmpBoard, macroMoves);
+            if (numMacroMoves > 0) {
+                const MacroMove * macroMove = &macroMoves[randomInRange(0, numMacroMoves-1)];
+                for (Edge e=0; e < NUM_EDGES; e++) {
+                    if (isBitboardEdgeTaken(&macroMove->edges, e))
+                        removeConnectionEdge(&tmpGraph, e);
+                }
+                makeMacroMove(&tmpBoard, macroMove);
+
+                if (currentPlayer == 1)
+                    simulationBoxesTaken += macroMove->numBoxes;
+                if (!macroMove->keepsTurn)
+                    currentPlayer = 3 - currentPlayer;
+
+                log_debug("Made a macro-move taking %d boxes.\n", macroMove->numBoxes);
+                continue;
+            }
+
             Edge moveChoice;
 
             Edge urgentMoves[URGENT_MOVE_MAX];
@@ -1079,6 +1280,7 @@ Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime) {
 
             log_debug("Making move %d.\n", moveChoice);
             removeConnectionEdge(&tmpGraph, moveChoice);
+            makeGMCTSBitboardMove(&tmpBoard, moveChoice);
         }
         
         // backpropagate
@@ -1087,32 +1289,389 @@ Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime) {
         log_debug("Simulation finished! %d of %d boxes taken. %f.\n", simulationBoxesTaken, rootNumBoxesLeft, simulationScore);
 
         do {
-            node->visits++;
-            node->score += simulationScore;
+            if (shareTree) { // the visits were added on the way down
+                if (node->parent != NULL)
+                    addSharedMCTSScore(&node->parent->childScores[node->indexInParent], simulationScore, &worker->contention);
+            }
+            else {
+                node->visits++;
+                if (node->parent != NULL) {
+                    node->parent->childVisits[node->indexInParent]++;
+                    node->parent->childScores[node->indexInParent] += simulationScore;
+                }
+            }
             node = node->parent;
         } while(node != NULL);
 
-        assert(rootNode->visits > 0);
+        assert(__atomic_load_n(&rootNode->visits, __ATOMIC_RELAXED) > 0);
         
         freeAdjLists(&tmpGraph);
     }
 
-    log_log("Simulation complete! Ran for %d iterations. Created %d nodes.\n", iterationCount, nodesCreated);
+    return NULL;
+}
+
+// REUSE
+// As in mcts.c, the trees of the last search are kept for the next. Every score in a GMCTS tree is the
+// proportion of the root's boxes left which player 1 ends up with, so a kept score is moved over to
+// the new root by taking off the boxes player 1 took on the way down and scaling to its boxes left.
+static GMCTSNode * findReusableGMCTSNode(GMCTSNode * node, Bitboard board, short currentPlayer, short boxesTaken, const Bitboard * targetBoard, short * bestBoxesTaken) {
+    // Looks below node, whose position is board, for targetBoard with player 1 to move, following
+    // only moves which targetBoard has taken. When the moves were tried in several orders the most
+    // visited node is returned, and bestBoxesTaken is set to the boxes player 1 took to get there.
+    if (board.lo == targetBoard->lo && board.hi == targetBoard->hi) {
+        if (currentPlayer != 1)
+            return NULL;
+        *bestBoxesTaken = boxesTaken;
+        return node;
+    }
+
+    GMCTSNode * bestNode = NULL;
+    for (short i=0; i < node->numPotentialMoves; i++) {
+        GMCTSNode * child = node->children[i];
+        if (child == NULL || !isBitboardEdgeTaken(targetBoard, getGMCTSBoardEdge(&board, child->move)))
+            continue;
+
+        Bitboard childBoard = board;
+        makeGMCTSBitboardMove(&childBoard, child->move);
+        short childPlayer = child->numBoxesTakenByMove == 0 ? 3 - currentPlayer : currentPlayer;
+        short childBoxesTaken = boxesTaken + (currentPlayer == 1 ? child->numBoxesTakenByMove : 0);
+
+        short foundBoxesTaken;
+        GMCTSNode * found = findReusableGMCTSNode(child, childBoard, childPlayer, childBoxesTaken, targetBoard, &foundBoxesTaken);
+        if (found != NULL && (bestNode == NULL || found->visits > bestNode->visits)) {
+            bestNode = found;
+            *bestBoxesTaken = foundBoxesTaken;
+        }
+    }
+
+    return bestNode;
+}
+
+static GMCTSNode * copyGMCTSSubtree(Arena * arena, const GMCTSNode * node, GMCTSNode * parent, float scoreScale, float scoreShift) {
+    // Copies node and everything below it, moving each child's score to newScore = score * scoreScale - visits * scoreShift.
+    GMCTSNode * copy = newGMCTSNode(arena, parent, node->indexInParent, node->move, node->numBoxesTakenByMove);
+    copy->visits = node->visits;
+    setGMCTSNodePotentialMoves(arena, copy, node->potentialMoves, node->numPotentialMoves);
+    copy->nextPotentialMoveIndex = node->nextPotentialMoveIndex;
+    copy->numChildren = node->numChildren;
+
+    for (short i=0; i < node->numPotentialMoves; i++) {
+        if (node->children[i] == NULL)
+            continue;
+
+        copy->children[i] = copyGMCTSSubtree(arena, node->children[i], copy, scoreScale, scoreShift);
+        copy->childVisits[i] = node->childVisits[i];
+        copy->childScores[i] = node->childScores[i] * scoreScale - node->childVisits[i] * scoreShift;
+    }
+
+    return copy;
+}
+
+static void keepReusableGMCTSTrees(const Bitboard * rootBoard, short rootNumBoxesLeft, GMCTSNode ** roots, short numTrees) {
+    // Sets roots[t] to a copy of the part of the last search's tree t which starts at rootBoard, or
+    // NULL. The copies go to the spare arena, every arena is reset, and the spare takes the first
+    // arena's place, so nothing else from the last search is kept.
+    if (gmctsSpareArena.first == NULL)
+        initArena(&gmctsSpareArena, GMCTS_ARENA_BLOCK_SIZE);
+    resetArena(&gmctsSpareArena);
+
+    bool isLaterPosition = numLastGMCTSRoots > 0 && rootNumBoxesLeft > 0 &&
+        (lastGMCTSRootBoard.lo & ~rootBoard->lo) == 0 && (lastGMCTSRootBoard.hi & ~rootBoard->hi) == 0;
+
+    for (short t=0; t < numTrees; t++) {
+        roots[t] = NULL;
+        if (!isLaterPosition || t >= numLastGMCTSRoots)
+            continue;
+
+        short boxesTaken = 0;
+        GMCTSNode * node = findReusableGMCTSNode(lastGMCTSRoots[t], lastGMCTSRootBoard, 1, 0, rootBoard, &boxesTaken);
+        if (node == NULL)
+            continue;
+
+        roots[t] = copyGMCTSSubtree(&gmctsSpareArena, node, NULL, lastGMCTSRootNumBoxesLeft / (float)rootNumBoxesLeft, boxesTaken / (float)rootNumBoxesLeft);
+        roots[t]->indexInParent = 0;
+        roots[t]->move = NO_EDGE;
+        roots[t]->numBoxesTakenByMove = 0;
+        log_log("Reusing %d visits of tree %d from the last search.\n", roots[t]->visits, t);
+    }
+
+    for (short t=0; t < GMCTS_MAX_THREADS; t++) {
+        if (gmctsArenas[t].first != NULL)
+            resetArena(&gmctsArenas[t]);
+    }
+
+    Arena arena = gmctsArenas[0];
+    gmctsArenas[0] = gmctsSpareArena;
+    gmctsSpareArena = arena;
+    numLastGMCTSRoots = 0;
+}
+
+Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime, short numThreads, bool shareTree) {
+    // Runs numThreads searches, the first on the calling thread. They either search a tree each (root
+    // parallelisation) or all search the same tree (tree parallelisation). A tree carried on from the
+    // last search may have its root moves in another order, so root children are merged by edge.
+    assert(numThreads >= 1 && numThreads <= GMCTS_MAX_THREADS);
+    unsigned long long startTime = getTimeMillis();
+
+    short rootNumBoxesLeft = getNumBoxesLeft(rootState);
+    log_log("getGraphsMonteCarloMove: Starting... Running for max %d milliseconds on %d threads, %s. Boxes left: %d.\n", maxRuntime, numThreads,
+        shareTree ? "sharing one tree" : "a tree each", rootNumBoxesLeft);
+
+    SCGraph rootGraph;
+    unscoredStateToSCGraph(&rootGraph, rootState);
+
+    // Kept alongside the graph during each iteration so that captures can be found as macro-moves.
+    Bitboard rootBoard;
+    unscoredStateToBitboard(&rootBoard, rootState);
+
+    Edge rootMoves[NUM_EDGES];
+    // Use the expensive full isormorphism check for just the root node?
+    short numRootMoves = getGraphsPotentialMoves(&rootGraph, rootMoves);
+
+    short numTrees = shareTree ? 1 : numThreads;
+    GMCTSNode * reusedRoots[numTrees];
+    keepReusableGMCTSTrees(&rootBoard, rootNumBoxesLeft, reusedRoots, numTrees);
+
+    GMCTSWorker workers[numThreads];
+    pthread_t threads[numThreads];
+    for (short t=0; t < numThreads; t++) {
+        Arena * arena = &gmctsArenas[t];
+        if (arena->first == NULL)
+            initArena(arena, GMCTS_ARENA_BLOCK_SIZE);
+
+        if (t < numTrees && reusedRoots[t] != NULL)
+            workers[t].rootNode = reusedRoots[t];
+        else if (t < numTrees) {
+            workers[t].rootNode = newGMCTSNode(arena, NULL, 0, NO_EDGE, 0);
+            setGMCTSNodePotentialMoves(arena, workers[t].rootNode, rootMoves, numRootMoves);
+        }
+        else
+            workers[t].rootNode = workers[0].rootNode;
+
+        workers[t].arena = arena;
+        workers[t].shareTree = shareTree;
+        workers[t].rootGraph = &rootGraph;
+        workers[t].rootBoard = &rootBoard;
+        workers[t].rootNumBoxesLeft = rootNumBoxesLeft;
+        workers[t].endTime = startTime + maxRuntime;
+        workers[t].seed = getRandom64();
+        workers[t].iterationCount = 0;
+        workers[t].nodesCreated = 0;
+        memset(&workers[t].contention, 0, sizeof(MCTSContention));
+    }
+
+    for (short t=1; t < numThreads; t++)
+        pthread_create(&threads[t], NULL, runGMCTSWorker, &workers[t]);
+    runGMCTSWorker(&workers[0]);
+    for (short t=1; t < numThreads; t++)
+        pthread_join(threads[t], NULL);
+
+    int iterationCount = 0;
+    int nodesCreated = 0;
+    size_t peakBytesUsed = 0;
+    MCTSContention contention = {0, 0, 0, 0, 0};
+    int rootVisits[NUM_EDGES] = {0};
+    for (short t=0; t < numThreads; t++) {
+        iterationCount += workers[t].iterationCount;
+        nodesCreated += workers[t].nodesCreated;
+        peakBytesUsed += gmctsArenas[t].peakBytesUsed;
+        addMCTSContention(&contention, &workers[t].contention);
+
+        if (t >= numTrees)
+            continue;
+
+        const GMCTSNode * rootNode = workers[t].rootNode;
+        for (short i=0; i < rootNode->numPotentialMoves; i++)
+            rootVisits[getGMCTSBoardEdge(&rootBoard, rootNode->potentialMoves[i])] += rootNode->childVisits[i];
+
+        lastGMCTSRoots[t] = workers[t].rootNode;
+    }
+    numLastGMCTSRoots = numTrees;
+    lastGMCTSRootBoard = rootBoard;
+    lastGMCTSRootNumBoxesLeft = rootNumBoxesLeft;
+
+    log_log("Simulation complete! Ran for %d iterations. Created %d nodes. Peak tree memory: %luKB\n", iterationCount, nodesCreated, (unsigned long)peakBytesUsed / 1024);
+    if (shareTree)
+        logMCTSContention(&contention, iterationCount);
 
-    short bestVisits = -1;
+    int bestVisits = -1;
     short move = NO_EDGE;
-    for (short i=0; i < rootNode->numChildren; i++) {
-        if (rootNode->children[i]->visits > bestVisits)
-            move = rootNode->children[i]->move;
+    for (short t=0; t < numTrees; t++) {
+        const GMCTSNode * rootNode = workers[t].rootNode;
+        for (short i=0; i < rootNode->numPotentialMoves; i++) {
+            Edge e = getGMCTSBoardEdge(&rootBoard, rootNode->potentialMoves[i]);
+            if (rootVisits[e] > bestVisits) {
+                bestVisits = rootVisits[e];
+                move = e;
+            }
+        }
     }
 
-    freeGMCTSNode(rootNode);
+    // The trees are released with their arenas when the next search starts, but for what it reuses
     freeAdjLists(&rootGraph);
 
     log_log("Move choice: %d\n", move);
     return move;
 }
 
+static void runPotentialMoveRepresentativeTests() {
+    log_log("Testing getGraphsPotentialMovesAndRepresentatives...\n");
+    UnscoredState state;
+    SCGraph graph;
+    Edge potentialMoves[NUM_EDGES];
+    stringToUnscoredState(&state, "000000000000000000000000000000000000000000000000000000000000000000000000");
+    unscoredStateToSCGraph(&graph, &state);
+
+    // Both outer edges of a corner box lead to the same position.
+    Edge cornerMoves[NUM_EDGES];
+    Edge representatives[NUM_EDGES];
+    short numCornerMoves = 0;
+    for (Edge e=0; e < NUM_EDGES; e++) {
+        if (getCorrespondingCornerEdge(e) != NO_EDGE)
+            cornerMoves[numCornerMoves++] = e;
+    }
+
+    short numPotentialMoves = getGraphsPotentialMovesAndRepresentatives(&graph, potentialMoves, cornerMoves, numCornerMoves, representatives);
+    assert(numPotentialMoves == getGraphsPotentialMoves(&graph, potentialMoves));
+
+    log_debug("It should map both edges of a corner to the same potential move.\n");
+    for (short k=0; k < numCornerMoves; k++) {
+        for (short l=0; l < numCornerMoves; l++) {
+            if (cornerMoves[l] == getCorrespondingCornerEdge(cornerMoves[k]))
+                assert(representatives[k] == representatives[l]);
+        }
+
+        bool isPotentialMove = false;
+        for (short i=0; i < numPotentialMoves; i++) {
+            if (potentialMoves[i] == representatives[k])
+                isPotentialMove = true;
+        }
+        assert(isPotentialMove);
+    }
+
+    log_debug("It should give NO_EDGE for moves which aren't potential moves.\n");
+    // A box with three sides taken leaves only its capture as a potential move.
+    const Edge * boxEdges = getBoxEdges(10);
+    for (short i=0; i < 3; i++)
+        setEdgeTaken(&state, boxEdges[i]);
+    freeAdjLists(&graph);
+    unscoredStateToSCGraph(&graph, &state);
+    Edge quietMove = getBoxEdges(0)[0];
+    numPotentialMoves = getGraphsPotentialMovesAndRepresentatives(&graph, potentialMoves, &quietMove, 1, representatives);
+    assert(numPotentialMoves == 1 && potentialMoves[0] == boxEdges[3]);
+    assert(representatives[0] == NO_EDGE);
+
+    freeAdjLists(&graph);
+}
+
+static void runGMCTSReuseTests() {
+    log_log("Testing keepReusableGMCTSTrees...\n");
+    UnscoredState state;
+    stringToUnscoredState(&state, "111111111000010100111000000001111111100000101100000010110000001011011111");
+    short numBoxesLeft = getNumBoxesLeft(&state);
+    Edge move = getGraphsMonteCarloMove(&state, 300, 1, false);
+    assert(move >= 0 && move < NUM_EDGES && !isEdgeTaken(&state, move));
+
+    // Follow the quiet move and quiet reply to it which were searched most.
+    GMCTSNode * ourNode = NULL;
+    for (short i=0; i < lastGMCTSRoots[0]->numPotentialMoves; i++) {
+        GMCTSNode * child = lastGMCTSRoots[0]->children[i];
+        if (child != NULL && child->numBoxesTakenByMove == 0 && child->numChildren > 0 && (ourNode == NULL || child->visits > ourNode->visits))
+            ourNode = child;
+    }
+    assert(ourNode != NULL);
+    GMCTSNode * replyNode = NULL;
+    for (short i=0; i < ourNode->numPotentialMoves; i++) {
+        GMCTSNode * child = ourNode->children[i];
+        if (child != NULL && child->numBoxesTakenByMove == 0 && (replyNode == NULL || child->visits > replyNode->visits))
+            replyNode = child;
+    }
+    assert(replyNode != NULL);
+
+    Bitboard rootBoard;
+    unscoredStateToBitboard(&rootBoard, &state);
+    Bitboard ourMoveBoard = rootBoard;
+    makeGMCTSBitboardMove(&ourMoveBoard, ourNode->move);
+    Bitboard board = ourMoveBoard;
+    makeGMCTSBitboardMove(&board, replyNode->move);
+
+    log_debug("It should find nothing for a position where the opponent is to move.\n");
+    short boxesTaken;
+    assert(findReusableGMCTSNode(lastGMCTSRoots[0], rootBoard, 1, 0, &ourMoveBoard, &boxesTaken) == NULL);
+
+    log_debug("It should find the most visited node after both moves.\n");
+    GMCTSNode * foundNode = findReusableGMCTSNode(lastGMCTSRoots[0], rootBoard, 1, 0, &board, &boxesTaken);
+    assert(foundNode != NULL && foundNode->visits >= replyNode->visits);
+    assert(boxesTaken == 0);
+    replyNode = foundNode;
+    int replyVisits = replyNode->visits;
+    short replyNumChildren = replyNode->numChildren;
+    float replyChildScores = 0;
+    for (short i=0; i < replyNode->numPotentialMoves; i++)
+        replyChildScores += replyNode->childScores[i];
+
+    log_debug("It should carry on from the node after both moves, as the root.\n");
+    GMCTSNode * reusedRoot;
+    keepReusableGMCTSTrees(&board, numBoxesLeft, &reusedRoot, 1);
+    assert(reusedRoot != NULL);
+    assert(reusedRoot->parent == NULL && reusedRoot->move == NO_EDGE);
+    assert(reusedRoot->visits == replyVisits);
+    assert(reusedRoot->numChildren == replyNumChildren);
+
+    log_debug("It should leave the scores alone when no boxes were taken on the way.\n");
+    float reusedChildScores = 0;
+    for (short i=0; i < reusedRoot->numPotentialMoves; i++)
+        reusedChildScores += reusedRoot->childScores[i];
+    assert(fabs(reusedChildScores - replyChildScores) < 1e-3);
+
+    log_debug("It should take off the boxes player 1 took on the way and rescale to the new boxes left.\n");
+    // The last root has a capture of box 0, whose node has two children of its own.
+    initUnscoredState(&state);
+    const Edge * boxEdges = getBoxEdges(0);
+    for (short i=0; i < 3; i++)
+        setEdgeTaken(&state, boxEdges[i]);
+    Edge captureMove = boxEdges[3];
+    Arena * arena = &gmctsArenas[0];
+    GMCTSNode * lastRoot = newGMCTSNode(arena, NULL, 0, NO_EDGE, 0);
+    setGMCTSNodePotentialMoves(arena, lastRoot, &captureMove, 1);
+    GMCTSNode * captureNode = newGMCTSNode(arena, lastRoot, 0, captureMove, 1);
+    lastRoot->children[0] = captureNode;
+    lastRoot->numChildren = 1;
+    lastRoot->childVisits[0] = lastRoot->visits = captureNode->visits = 10;
+    lastRoot->childScores[0] = 6.0;
+
+    Bitboard captureBoard;
+    unscoredStateToBitboard(&captureBoard, &state);
+    setBitboardEdgeTaken(&captureBoard, captureMove);
+    Edge captureChildMoves[NUM_EDGES];
+    getBitboardFreeEdges(&captureBoard, captureChildMoves); // the first two free edges will do
+    setGMCTSNodePotentialMoves(arena, captureNode, captureChildMoves, 2);
+    for (short i=0; i < 2; i++) {
+        captureNode->children[i] = newGMCTSNode(arena, captureNode, i, captureChildMoves[i], 0);
+        captureNode->childVisits[i] = captureNode->children[i]->visits = 4 + i;
+    }
+    captureNode->numChildren = captureNode->nextPotentialMoveIndex = 2;
+    captureNode->childScores[0] = 2.0;
+    captureNode->childScores[1] = 3.5;
+
+    unscoredStateToBitboard(&lastGMCTSRootBoard, &state);
+    lastGMCTSRootNumBoxesLeft = NUM_BOXES;
+    lastGMCTSRoots[0] = lastRoot;
+    numLastGMCTSRoots = 1;
+
+    assert(findReusableGMCTSNode(lastRoot, lastGMCTSRootBoard, 1, 0, &captureBoard, &boxesTaken) == captureNode);
+    assert(boxesTaken == 1);
+    keepReusableGMCTSTrees(&captureBoard, NUM_BOXES - 1, &reusedRoot, 1);
+    assert(reusedRoot != NULL && reusedRoot->visits == 10 && reusedRoot->numChildren == 2);
+    float scoreScale = NUM_BOXES / (float)(NUM_BOXES - 1);
+    float scoreShift = 1 / (float)(NUM_BOXES - 1);
+    assert(fabs(reusedRoot->childScores[0] - (2.0 * scoreScale - 4 * scoreShift)) < 1e-5);
+    assert(fabs(reusedRoot->childScores[1] - (3.5 * scoreScale - 5 * scoreShift)) < 1e-5);
+    assert(reusedRoot->childVisits[0] == 4 && reusedRoot->childVisits[1] == 5);
+    numLastGMCTSRoots = 0;
+}
+
 void runGraphsTests() {
     log_log("RUNNING GRAPHS TESTS\n");
 
@@ -1250,7 +1809,7 @@ void runGraphsTests() {
     assert(numPotentialMoves == 0);
 
     log_debug("getNonIsomorphicMoves should return one move for the subgraph...\n");
-    numPotentialMoves = getNonIsomorphicMoves(&subGraphs[1], potentialMoves);
+    numPotentialMoves = getNonIsomorphicMoves(&subGraphs[1], potentialMoves, NULL, 0, NULL);
     assert(numPotentialMoves == 1);
 
     freeAdjLists(&graph);
@@ -1309,7 +1868,7 @@ void runGraphsTests() {
     freeAdjLists(&childGraph);
 
     log_debug("getNonIsomorphicMoves should return the 2 sensible moves.\n");
-    numPotentialMoves = getNonIsomorphicMoves(&graph, potentialMoves);
+    numPotentialMoves = getNonIsomorphicMoves(&graph, potentialMoves, NULL, 0, NULL);
     assert(numPotentialMoves == 2);
 
     freeAdjLists(&graph);
@@ -1748,7 +2307,7 @@ void runGraphsTests() {
     assert(numPotentialMoves == 0);
 
     log_debug("getNonIsomorphicMoves should return 1 move since all others are isomorphic.\n");
-    numPotentialMoves = getNonIsomorphicMoves(&subGraphs[2], potentialMoves);
+    numPotentialMoves = getNonIsomorphicMoves(&subGraphs[2], potentialMoves, NULL, 0, NULL);
     assert(numPotentialMoves == 1);
 
     // Subgraph 4
@@ -1827,5 +2386,8 @@ void runGraphsTests() {
     freeAdjLists(&graph);
     log_log("Complex 28 box graph passed!\n\n");
 
+    runPotentialMoveRepresentativeTests();
+    runGMCTSReuseTests();
+
     log_log("GRAPHS TESTS COMPLETED\n\n");
 }
@@ -1,6 +1,8 @@
 #ifndef GRAPHS_H
 #define GRAPHS_H
 
+#define GMCTS_MAX_THREADS 64
+
 typedef struct AdjListNode {
     short dest;
     struct AdjListNode * next;
@@ -26,35 +28,43 @@ typedef struct SCGraph {
     // 1 -> 0
     // 2 -> 0
     AdjList * adjLists;
+    struct Arena * arena; // where adjLists live, NULL when they were malloc'd
 } SCGraph;
 
 typedef struct GMCTSNode {
     struct GMCTSNode * parent;
+    short indexInParent; // where the node's own visits and score are kept in its parent
 
     int visits;
-    float score;
 
     Edge move;
     short numBoxesTakenByMove;
 
-    Edge potentialMoves[NUM_EDGES];
+    // The arrays below are sized to numPotentialMoves and live in the same arena as the node.
+    Edge * potentialMoves;
     short numPotentialMoves;
     short nextPotentialMoveIndex;
 
-    struct GMCTSNode * children[NUM_EDGES];
+    // The children's visits and scores are kept here as arrays so UCB1 can sweep them at once.
+    struct GMCTSNode ** children;
+    int * childVisits;
+    float * childScores;
     short numChildren;
 } GMCTSNode;
 
 void unscoredStateToSCGraph(SCGraph * graph, const UnscoredState * state);
+void unscoredStateToArenaSCGraph(SCGraph * graph, const UnscoredState * state, struct Arena * arena);
 void newAdjLists(SCGraph * graph);
+void newArenaAdjLists(SCGraph * graph, struct Arena * arena);
 void freeAdjLists(SCGraph * graph);
 void copySCGraph(SCGraph * destGraph, const SCGraph * srcGraph);
 short getGraphsPotentialMoves(const SCGraph * graph, Edge * potentialMoves);
+short getGraphsPotentialMovesAndRepresentatives(const SCGraph * graph, Edge * potentialMoves, const Edge * moves, short numMoves, Edge * representatives);
 short getNodeValency(const SCGraph * graph, short node);
 short getSuperGraphUrgentMoves(const SCGraph * graph, Edge * movesBuf);
 void removeConnectionEdge(SCGraph * graph, Edge edge);
 short getNumNodesLeftToCapture(const SCGraph * graph);
 void runGraphsTests();
-Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime);
+Edge getGraphsMonteCarloMove(const UnscoredState * rootState, int maxRuntime, short numThreads, bool shareTree);
 
 #endif
@@ -2,38 +2,306 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
-// #include <jansson.h>
+#include <string.h>
 #include <sys/time.h>
+#include <pthread.h>
 #include "game_board.h"
 #include "mcts.h"
 #include "player_strategy.h"
 #include "util.h"
+#include "bitboard.h"
+#include "treewriter.h"
+#include "ucb.h"
+
+static void initMCTSTree(MCTSTree * tree, const UnscoredState * rootState);
+static void resetMCTSTree(MCTSTree * tree, const UnscoredState * rootState);
+static void freeMCTSTree(MCTSTree * tree);
+static void growMCTSTree(MCTSTree * tree, int minCapacity);
+static bool reuseMCTSTree(MCTSTree * tree, const UnscoredState * rootState);
+static int findReusableMCTSNode(const MCTSTree * tree, int node, Bitboard board, const Bitboard * targetBoard);
+static void rerootMCTSTree(MCTSTree * tree, int newRoot, const UnscoredState * rootState);
+static short getNumBoxesTakenUpTree(const MCTSTree * tree, int node, PlayerNum targetPlayer);
+static void initMCTSNode(MCTSTree * tree, int node, int parent, const UnscoredState * preMoveState, PlayerNum playerJustMoved, Edge move);
+static int applyTreePolicy(MCTSTree * tree, UnscoredState * state);
+static int getBestChildUCB1(const MCTSTree * tree, int node);
+static int getBestChildPUCT(const MCTSTree * tree, int node);
+static short getNumMCTSChildrenAllowed(const MCTSNode * n, int visits);
+static float getRAVEMean(double totalScore, int visits, double amafScore, int amafVisits);
+static int expandMCTSNode(MCTSTree * tree, int node, const UnscoredState * state);
+static void addChildrenToMCTSNode(MCTSTree * tree, int node, const UnscoredState * state);
+static void orderMCTSMoves(const UnscoredState * state, Edge * moves, float * priors, short numMoves);
+static float getMCTSMoveWeight(const Bitboard * board, short numBoxesCapturable, Edge move);
+static int addChildToMCTSNode(MCTSTree * tree, int node, const UnscoredState * state);
+static int applySharedTreePolicy(MCTSTree * tree, UnscoredState * state, MCTSContention * contention);
+static int getBestSharedChildUCB1(const MCTSTree * tree, int node, MCTSContention * contention);
+static int reserveSharedChildren(MCTSTree * tree, int node, const UnscoredState * state, MCTSContention * contention);
+static int claimSharedChild(MCTSTree * tree, int node, const UnscoredState * state, MCTSContention * contention);
+static int getRandomPlayoutBoxes(Bitboard board, short numPlayouts, Bitboard * moverEdges);
+static short playOutRandomly(Bitboard board, Edge * freeEdges, short numFreeEdges, Bitboard * moverEdges);
+static int playOutRandomlyInLanes(Bitboard board, const Edge * freeEdges, short numFreeEdges, short numLanes);
+static double applyDefaultPolicy(const MCTSTree * tree, int leafNode, const UnscoredState * leafState, short rootNumBoxesLeft, short numPlayouts, Bitboard * playoutEdges);
+static void backpropagateResult(MCTSTree * tree, int node, PlayerNum scoreFirstPlayer, double score, short numPlayouts, const Bitboard * playoutEdges);
+static void backpropagateSharedResult(MCTSTree * tree, int node, PlayerNum scoreFirstPlayer, double score, short numPlayouts, const Bitboard * playoutEdges, MCTSContention * contention);
+static void addMCTSAMAFScores(MCTSTree * tree, int node, const Bitboard * laterEdges, PlayerNum scoreFirstPlayer, double score, bool shareTree, MCTSContention * contention);
+static int getMostVisitedChild(const MCTSTree * tree, int node);
+static Edge getMergedMostVisitedMove(const MCTSTree * trees, short numTrees);
+static void saveMCTSTree(const MCTSTree * tree);
+static void initMCTSDAG(MCTSDAG * dag, const UnscoredState * rootState);
+static void resetMCTSDAG(MCTSDAG * dag, const UnscoredState * rootState);
+static void freeMCTSDAG(MCTSDAG * dag);
+static int findOrAddMCTSDAGNode(MCTSDAG * dag, const Bitboard * board);
+static void addEdgesToMCTSDAGNode(MCTSDAG * dag, int node);
+static int expandMCTSDAGNode(MCTSDAG * dag, int node);
+static float getMCTSDAGEdgeValue(const MCTSDAG * dag, int node, int edge);
+static int getBestMCTSDAGEdgeUCB1(const MCTSDAG * dag, int node);
+static short applyMCTSDAGPolicy(MCTSDAG * dag, int * pathNodes, int * pathEdges);
+static void backpropagateMCTSDAGResult(MCTSDAG * dag, const int * pathNodes, const int * pathEdges, short pathLength, int moverBoxes, short numPlayouts);
+static Edge getMergedMostVisitedDAGMove(const MCTSDAG * dags, short numDAGs);
+static void saveMCTSDAG(const MCTSDAG * dag);
+
+TreeWriterSettings mctsTreeSettings = { "mctsTree.json", 8, 10 };
+float mctsRaveEquivalence = 0.0;
+bool mctsProgressiveWidening = false;
+short mctsPlayoutBatchSize = 1;
+bool mctsGreedyPlayouts = false;
+
+#define MCTS_INITIAL_CAPACITY (1 << 16) // nodes, 2.25MB
+#define MCTS_SHARED_INITIAL_CAPACITY (1 << 21) // nodes, 72MB
+#define MCTS_PLAYOUT_LANES 64 // playouts of a batch played side by side, one bit of a word each
+
+// Weights of the moves a node's children are ordered by with progressive widening, before they are
+// scaled to priors summing to 1. A capture is weighed by its boxes and a sacrifice divided by them.
+static const float MCTS_CAPTURE_WEIGHT = 8.0;
+static const float MCTS_SAFE_WEIGHT = 4.0;
+static const float MCTS_SACRIFICE_WEIGHT = 2.0;
+static const float MCTS_PUCT_EXPLORATION = 1.0;
+
+// The trees getMCTSMove searches with, one per thread. Their arrays are kept between moves and only
+// grow, so once a game is under way searches hardly allocate or free, and starting a new tree is
+// just a reset, or a reroot when the last search already reached the new position (see REUSE).
+// A shared search uses the first tree.
+static MCTSTree mctsTrees[MCTS_MAX_THREADS];
+
+// Set when a shared search runs out of nodes, so the tree grows before the next search. It can't
+// grow during one since other threads are reading it.
+static bool sharedTreeWasFull = false;
+
+// Whether the trees were last searched by threads sharing one. A shared search sets up every child
+// it reserves, while a tree each only sets the move and leaves the rest until the child is taken into
+// use, so a tree is only carried on with by a search of the same kind.
+static bool mctsTreesWereShared = false;
+
+typedef struct MCTSWorker {
+    MCTSTree * tree;
+    MCTSDAG * dag; // instead of tree when transpositions are merged
+    bool shareTree;
+    const UnscoredState * rootState;
+    unsigned long long endTimeMillis;
+    unsigned long long seed; // drawn by the calling thread, so a seeded client repeats its searches
+    short numPlayouts; // from each leaf
+    int iterationCount;
+    MCTSContention contention;
+} MCTSWorker;
+
+static void initMCTSTree(MCTSTree * tree, const UnscoredState * rootState) {
+    tree->capacity = MCTS_INITIAL_CAPACITY;
+    tree->nodes = (MCTSNode *)malloc(tree->capacity * sizeof(MCTSNode));
+    tree->totalScores = (double *)malloc(tree->capacity * sizeof(double));
+    tree->visits = (int *)malloc(tree->capacity * sizeof(int));
+    tree->amafScores = (double *)malloc(tree->capacity * sizeof(double));
+    tree->amafVisits = (int *)malloc(tree->capacity * sizeof(int));
+    tree->priors = (float *)malloc(tree->capacity * sizeof(float));
+
+    if (tree->nodes == NULL || tree->totalScores == NULL || tree->visits == NULL || tree->amafScores == NULL || tree->amafVisits == NULL || tree->priors == NULL) {
+        log_error("[ERROR] initMCTSTree: Could not allocate %d nodes.\n", tree->capacity);
+        exit(1);
+    }
+
+    resetMCTSTree(tree, rootState);
+}
+
+static void resetMCTSTree(MCTSTree * tree, const UnscoredState * rootState) {
+    // Drops every node but a new root, keeping the arrays for reuse.
+    tree->rootState = *rootState;
+
+    // The root is always node 0.
+    tree->numNodes = 1;
+    initMCTSNode(tree, 0, MCTS_NO_NODE, rootState, NO_PLAYER, NO_EDGE);
+    tree->priors[0] = 1.0;
+}
+
+static void growMCTSTree(MCTSTree * tree, int minCapacity) {
+    if (tree->capacity >= minCapacity)
+        return;
+
+    tree->capacity = minCapacity;
+    tree->nodes = (MCTSNode *)realloc(tree->nodes, tree->capacity * sizeof(MCTSNode));
+    tree->totalScores = (double *)realloc(tree->totalScores, tree->capacity * sizeof(double));
+    tree->visits = (int *)realloc(tree->visits, tree->capacity * sizeof(int));
+    tree->amafScores = (double *)realloc(tree->amafScores, tree->capacity * sizeof(double));
+    tree->amafVisits = (int *)realloc(tree->amafVisits, tree->capacity * sizeof(int));
+    tree->priors = (float *)realloc(tree->priors, tree->capacity * sizeof(float));
+
+    if (tree->nodes == NULL || tree->totalScores == NULL || tree->visits == NULL || tree->amafScores == NULL || tree->amafVisits == NULL || tree->priors == NULL) {
+        log_error("[ERROR] growMCTSTree: Could not allocate %d nodes.\n", tree->capacity);
+        exit(1);
+    }
+}
+
+// REUSE
+// The tree of the last search is kept for the next one. Between the two the game has moved on by our
+// move and the opponent's reply, which may each be several moves when boxes were taken. If the tree
+// followed the same moves, the node for the new position becomes the root and the rest is dropped.
+static bool reuseMCTSTree(MCTSTree * tree, const UnscoredState * rootState) {
+    // Returns false, leaving the tree alone, when it has no node for rootState.
+    Bitboard oldBoard, newBoard;
+    unscoredStateToBitboard(&oldBoard, &tree->rootState);
+    unscoredStateToBitboard(&newBoard, rootState);
+    if ((oldBoard.lo & ~newBoard.lo) != 0 || (oldBoard.hi & ~newBoard.hi) != 0) // a new game
+        return false;
+
+    int newRoot = findReusableMCTSNode(tree, 0, oldBoard, &newBoard);
+    if (newRoot == MCTS_NO_NODE || getNumBoxesLeft(rootState) == 0)
+        return false;
+
+    int oldNumNodes = tree->numNodes;
+    rerootMCTSTree(tree, newRoot, rootState);
+    log_log("Reusing %d of %d nodes and %d visits from the last search.\n", tree->numNodes, oldNumNodes, tree->visits[0]);
+    return true;
+}
+
+static int findReusableMCTSNode(const MCTSTree * tree, int node, Bitboard board, const Bitboard * targetBoard) {
+    // Looks below node, whose position is board, for targetBoard with the root's player to move,
+    // following only moves which targetBoard has taken. When the moves were tried in several orders
+    // the most visited node is returned.
+    const MCTSNode * n = &tree->nodes[node];
+    if (board.lo == targetBoard->lo && board.hi == targetBoard->hi)
+        return n->nextPlayerToMove == tree->nodes[0].nextPlayerToMove ? node : MCTS_NO_NODE;
+
+    int bestNode = MCTS_NO_NODE;
+    if (n->firstChild == MCTS_NO_NODE)
+        return bestNode;
+
+    for (int c = n->firstChild; c < n->firstChild + n->numChildren; c++) {
+        Edge move = tree->nodes[c].move;
+        if (!isBitboardEdgeTaken(targetBoard, move))
+            continue;
+
+        Bitboard childBoard = board;
+        setBitboardEdgeTaken(&childBoard, move);
+        int found = findReusableMCTSNode(tree, c, childBoard, targetBoard);
+        if (found != MCTS_NO_NODE && (bestNode == MCTS_NO_NODE || tree->visits[found] > tree->visits[bestNode]))
+            bestNode = found;
+    }
+
+    return bestNode;
+}
+
+// Marks for rerootMCTSTree. Children reserved but not yet taken into use only have their move and
+// parent set, unless a shared search reserved them.
+#define MCTS_DROPPED 0
+#define MCTS_IN_USE 1
+#define MCTS_RESERVED 2
+
+static void rerootMCTSTree(MCTSTree * tree, int newRoot, const UnscoredState * rootState) {
+    // Moves newRoot and everything below it to the front of the arrays, keeping their order, and
+    // drops every other node. A node's children always come after it, so one pass forwards finds
+    // them all, and since no node moves up the arrays it can be copied in place.
+    int oldNumNodes = tree->numNodes;
+    int * newIndices = (int *)malloc(oldNumNodes * sizeof(int));
+    unsigned char * marks = (unsigned char *)calloc(oldNumNodes, sizeof(unsigned char));
+    if (newIndices == NULL || marks == NULL) {
+        log_error("[ERROR] rerootMCTSTree: Could not allocate %d marks.\n", oldNumNodes);
+        exit(1);
+    }
+
+    // The scores are shares of the old root's boxes left, which count the boxes taken on the way to
+    // newRoot, while new playouts count shares of the new root's. So each node's score is moved over
+    // to newScore = score * scoreScale - visits * scoreShift, the shift being for its player to move.
+    short numBoxesLeft = getNumBoxesLeft(rootState);
+    double scoreScale = getNumBoxesLeft(&tree->rootState) / (double)numBoxesLeft;
+    double scoreShifts[2];
+    for (PlayerNum p = 1; p <= 2; p++)
+        scoreShifts[p - 1] = getNumBoxesTakenUpTree(tree, newRoot, p) / (double)numBoxesLeft;
+
+    int numNodes = 0;
+    marks[newRoot] = MCTS_IN_USE;
+    for (int i = newRoot; i < oldNumNodes; i++) {
+        if (marks[i] == MCTS_DROPPED)
+            continue;
+
+        newIndices[i] = numNodes++;
+        const MCTSNode * n = &tree->nodes[i];
+        if (marks[i] == MCTS_IN_USE && n->firstChild != MCTS_NO_NODE) {
+            for (int c = n->firstChild; c < n->firstChild + n->numPotentialMoves; c++) {
+                marks[c] = c < n->firstChild + n->numChildren ? MCTS_IN_USE : MCTS_RESERVED;
+                tree->nodes[c].parent = i; // a shared search doesn't set it again when the child is taken into use
+            }
+        }
+    }
 
-static void initMCTSNode(MCTSNode * node, MCTSNode * parent, UnscoredState state, PlayerNum playerJustMoved, Edge move);
-static void freeMCTSNode(MCTSNode * node);
-static MCTSNode * applyTreePolicy(MCTSNode * root, UnscoredState * rootState);
-static MCTSNode * getBestChildUCB1(const MCTSNode * node);
-static MCTSNode * expandMCTSNode(MCTSNode * node);
-static short getUntriedMovesMCTSNode(MCTSNode * node, Edge * untriedMovesBuffer);
-static MCTSNode * addChildToMCTSNode(MCTSNode * parentNode, Edge move);
-static double applyDefaultPolicy(const MCTSNode * leafNode, short rootNumBoxesLeft);
-static void backpropagateResult(MCTSNode * node, PlayerNum scoreFirstPlayer, double score);
-static MCTSNode * getMostVisitedChild(MCTSNode * node);
-//static void saveMCTSNodeJSON(const MCTSNode * node, const char * filePath);
-//static json_t * MCTSNodeToJSON(const MCTSNode * node);
-
-
-static void initMCTSNode(MCTSNode * node, MCTSNode * parent, UnscoredState state, PlayerNum playerJustMoved, Edge move) {
+    for (int i = newRoot; i < oldNumNodes; i++) {
+        if (marks[i] == MCTS_DROPPED)
+            continue;
+
+        int j = newIndices[i];
+        tree->nodes[j] = tree->nodes[i];
+        tree->totalScores[j] = tree->totalScores[i];
+        tree->visits[j] = tree->visits[i];
+        tree->amafScores[j] = tree->amafScores[i];
+        tree->amafVisits[j] = tree->amafVisits[i];
+        tree->priors[j] = tree->priors[i];
+
+        MCTSNode * n = &tree->nodes[j];
+        n->parent = i == newRoot ? MCTS_NO_NODE : newIndices[n->parent];
+        if (marks[i] == MCTS_IN_USE && n->firstChild != MCTS_NO_NODE)
+            n->firstChild = newIndices[n->firstChild];
+
+        if (marks[i] == MCTS_IN_USE) { // reserved children have no scores yet, nor a player to move
+            double scoreShift = scoreShifts[n->nextPlayerToMove - 1];
+            tree->totalScores[j] = tree->totalScores[j] * scoreScale - tree->visits[j] * scoreShift;
+            tree->amafScores[j] = tree->amafScores[j] * scoreScale - tree->amafVisits[j] * scoreShift;
+        }
+    }
+
+    // The root's move belongs to the last search, and its boxes mustn't be counted again.
+    MCTSNode * root = &tree->nodes[0];
+    root->move = NO_EDGE;
+    root->playerJustMoved = NO_PLAYER;
+    root->numBoxesTakenByMove = 0;
+
+    tree->numNodes = numNodes;
+    tree->rootState = *rootState;
+
+    free(newIndices);
+    free(marks);
+}
+
+static void freeMCTSTree(MCTSTree * tree) {
+    free(tree->nodes);
+    free(tree->totalScores);
+    free(tree->visits);
+    free(tree->amafScores);
+    free(tree->amafVisits);
+    free(tree->priors);
+    tree->nodes = NULL;
+    tree->totalScores = NULL;
+    tree->visits = NULL;
+    tree->amafScores = NULL;
+    tree->amafVisits = NULL;
+    tree->priors = NULL;
+    tree->numNodes = 0;
+    tree->capacity = 0;
+}
+
+static void initMCTSNode(MCTSTree * tree, int nodeIndex, int parent, const UnscoredState * preMoveState, PlayerNum playerJustMoved, Edge move) {
+    MCTSNode * node = &tree->nodes[nodeIndex];
     node->parent = parent;
-    node->state = state;
     node->playerJustMoved = playerJustMoved;
 
     short numBoxesTakenByMove = 0;
-    if (move != NO_EDGE) {
-        UnscoredState preMoveState = state;
-        setEdgeFree(&preMoveState, move);
-        numBoxesTakenByMove = howManyBoxesDoesMoveComplete(&preMoveState, move);
-    }
+    if (move != NO_EDGE)
+        numBoxesTakenByMove = howManyBoxesDoesMoveComplete(preMoveState, move);
 
     if (playerJustMoved == NO_PLAYER)
         node->nextPlayerToMove = 1;
@@ -43,466 +311,1888 @@ static void initMCTSNode(MCTSNode * node, MCTSNode * parent, UnscoredState state
         node->nextPlayerToMove = 3 - playerJustMoved;
 
     node->move = move;
-    
+
     node->numBoxesTakenByMove = numBoxesTakenByMove;
-    node->visits = 0;
-    node->totalScore = 0.0; // from perspective of playerJustMoved
-    node->numPotentialMoves = getNumFreeEdges(&state);
+    tree->visits[nodeIndex] = 0;
+    tree->totalScores[nodeIndex] = 0.0;
+    tree->amafVisits[nodeIndex] = 0;
+    tree->amafScores[nodeIndex] = 0.0;
+    node->numPotentialMoves = getNumFreeEdges(preMoveState) - (move != NO_EDGE ? 1 : 0);
     node->numChildren = 0;
-    node->child = NULL;
-    node->sibling = NULL;
-}
-
-static void freeMCTSNode(MCTSNode * node) {
-    if (node->numChildren != 0) { // recursively free it's children
-        MCTSNode * currentChild = node->child;
-        MCTSNode * nextChild;
-
-        do {
-            nextChild = currentChild->sibling;
-            freeMCTSNode(currentChild);
-            currentChild = nextChild;
-        } while (currentChild != NULL);
-    }
-
-    free(node);
+    node->firstChild = MCTS_NO_NODE;
 }
 
 // SELECT
-static MCTSNode * applyTreePolicy(MCTSNode * root, UnscoredState * rootState) {
-    // Selects a node from the tree and expands it, modifying rootState.
+static int applyTreePolicy(MCTSTree * tree, UnscoredState * state) {
+    // Selects a node from the tree starting at the root and expands it.
+    // state must be the root state and is changed to the state of the node returned.
+    int node = 0;
 
-    MCTSNode * node = root;
-
-    while(node->numPotentialMoves > 0) { // node is non-terminal
-        log_debug("applyTreePolicy: Node at %p is non-terminal.\n", (void *)node);
-        bool fullyExpanded = node->numPotentialMoves == node->numChildren;
+    while(tree->nodes[node].numPotentialMoves > 0) { // node is non-terminal
+        log_debug("applyTreePolicy: Node %d is non-terminal.\n", node);
+        bool fullyExpanded = tree->nodes[node].numChildren >= getNumMCTSChildrenAllowed(&tree->nodes[node], tree->visits[node]);
 
         if(!fullyExpanded) {
-            log_debug("applyTreePolicy: Node at %p is not fully expanded. Expanding it and returning child...\n", (void *)node);
+            log_debug("applyTreePolicy: Node %d is not fully expanded. Expanding it and returning child...\n", node);
 
-            node = expandMCTSNode(node);
-            setEdgeTaken(rootState, node->move);
+            node = expandMCTSNode(tree, node, state);
+            setEdgeTaken(state, tree->nodes[node].move);
             return node;
         }
         else {
-            log_debug("applyTreePolicy: Node at %p is fully expanded. Choosing best child with UCT formula...\n", (void *)node);
-            node = getBestChildUCB1(node);
-            setEdgeTaken(rootState, node->move);
+            log_debug("applyTreePolicy: Node %d is fully expanded. Choosing best child with UCT formula...\n", node);
+            node = getBestChildUCB1(tree, node);
+            setEdgeTaken(state, tree->nodes[node].move);
         }
     }
 
     return node;
 }
 
-static MCTSNode * getBestChildUCB1(const MCTSNode * node) {
+static int getBestChildUCB1(const MCTSTree * tree, int node) {
     // Constant UCTK can be varied to change amount of exploration vs exploitation
-    // Uses score = (c.totalScore / c.visits)/numBoxesLeft + UCTK * sqrt(2*log(n.visits)/c.visits)
+    // Uses score = c.totalScore / c.visits + UCTK * sqrt(2*log(n.visits)/c.visits)
     // where c represents a child and n the node.
-    double UCTK = 0.7;
+    float UCTK = 0.7;
+
+    if (mctsProgressiveWidening)
+        return getBestChildPUCT(tree, node);
 
-    MCTSNode * bestChild;
-    double bestChildScore = -1.0;
+    const MCTSNode * n = &tree->nodes[node];
+    assert(n->numChildren > 0);
 
-    MCTSNode * c;
-    double cScore;
+    // The scores are added up in double, and only rounded to the kernel's float here.
+    float totalScores[NUM_EDGES];
+    for (int c = n->firstChild; c < n->firstChild + n->numChildren; c++) {
+        if (mctsRaveEquivalence > 0) // UCB1 goes on dividing by the child's own visits, so the RAVE blend is scaled back up by them
+            totalScores[c - n->firstChild] = getRAVEMean(tree->totalScores[c], tree->visits[c], tree->amafScores[c], tree->amafVisits[c]) * (float)tree->visits[c];
+        else
+            totalScores[c - n->firstChild] = (float)tree->totalScores[c];
+    }
 
-    assert(node->child != NULL);
+    int bestChild = n->firstChild + getBestUCB1Index(totalScores, &tree->visits[n->firstChild], n->numChildren, tree->visits[node], UCTK);
 
-    c = node->child;
-    while (c != NULL) {
-        cScore = c->totalScore / (double)c->visits + UCTK * sqrt(2*log((double)node->visits)/(double)c->visits);
+    log_debug("getBestChildUCB1: best child is: %d, move %d\n", bestChild, tree->nodes[bestChild].move);
+    return bestChild;
+}
 
-        if (cScore > bestChildScore) {
-            bestChildScore = cScore;
+static int getBestChildPUCT(const MCTSTree * tree, int node) {
+    // Uses score = mean + c * prior * sqrt(n.visits) / (1 + c.visits), so that a child's prior
+    // steers it while it has few visits of its own.
+    const MCTSNode * n = &tree->nodes[node];
+    assert(n->numChildren > 0);
+
+    float parentTerm = MCTS_PUCT_EXPLORATION * sqrtf((float)tree->visits[node]);
+    int bestChild = n->firstChild;
+    float bestValue = -INFINITY;
+    for (int c = n->firstChild; c < n->firstChild + n->numChildren; c++) {
+        float mean = mctsRaveEquivalence > 0 ?
+            getRAVEMean(tree->totalScores[c], tree->visits[c], tree->amafScores[c], tree->amafVisits[c]) :
+            (float)(tree->totalScores[c] / tree->visits[c]);
+        float value = mean + parentTerm * tree->priors[c] / (1.0f + (float)tree->visits[c]);
+
+        if (value > bestValue) {
+            bestValue = value;
             bestChild = c;
         }
-
-        c = c->sibling;
     }
 
-    log_debug("getBestChildUCB1: best child is: %p, UCT score: %G, move %d\n", (void *)bestChild, bestChildScore, bestChild->move);
+    log_debug("getBestChildPUCT: best child is: %d, move %d\n", bestChild, tree->nodes[bestChild].move);
     return bestChild;
 }
 
-static short getNumBoxesTakenUpTree(const MCTSNode * node, PlayerNum targetPlayer) {
+static short getNumMCTSChildrenAllowed(const MCTSNode * n, int visits) {
+    // With progressive widening a node takes one more child into use each time its visits pass a
+    // square: 1 child up to 1 visit, 2 up to 4, 3 up to 9 and so on.
+    if (!mctsProgressiveWidening)
+        return n->numPotentialMoves;
+
+    short numAllowed = (short)ceilf(sqrtf((float)visits));
+    return numAllowed < 1 ? 1 : min(numAllowed, n->numPotentialMoves);
+}
+
+static float getRAVEMean(double totalScore, int visits, double amafScore, int amafVisits) {
+    // Blends a child's mean score with its all-moves-as-first mean, which has many more samples early
+    // on but is biased, by beta = sqrt(k / (3 * visits + k)). The RAVE mean counts half when the child
+    // has k visits, and less and less after that.
+    float mean = (float)(totalScore / visits);
+    if (amafVisits == 0)
+        return mean;
+
+    float beta = sqrtf(mctsRaveEquivalence / (3.0f * (float)visits + mctsRaveEquivalence));
+    return (1.0f - beta) * mean + beta * (float)(amafScore / amafVisits);
+}
+
+static short getNumBoxesTakenUpTree(const MCTSTree * tree, int node, PlayerNum targetPlayer) {
     short numBoxes = 0;
 
     do {
-        if (node->playerJustMoved == targetPlayer)
-            numBoxes += node->numBoxesTakenByMove;
-        node = node->parent;
-    } while (node != NULL);
+        if (tree->nodes[node].playerJustMoved == targetPlayer)
+            numBoxes += tree->nodes[node].numBoxesTakenByMove;
+        node = tree->nodes[node].parent;
+    } while (node != MCTS_NO_NODE);
 
     return numBoxes;
 }
 
 // EXPAND
-static MCTSNode * expandMCTSNode(MCTSNode * node) {
-    log_debug("expandMCTSNode: Expanding node at %p...\n", (void *)node);
+static int expandMCTSNode(MCTSTree * tree, int node, const UnscoredState * state) {
+    // state is the node's state. Returns the new child.
+    log_debug("expandMCTSNode: Expanding node %d...\n", node);
 
-    Edge untriedMoves[node->numPotentialMoves - node->numChildren];
-    short numUntriedMoves = getUntriedMovesMCTSNode(node, untriedMoves);
+    if (tree->nodes[node].firstChild == MCTS_NO_NODE)
+        addChildrenToMCTSNode(tree, node, state);
 
-    Edge move = untriedMoves[randomInRange(0, numUntriedMoves-1)];
-    node = addChildToMCTSNode(node, move);
+    int child = addChildToMCTSNode(tree, node, state);
 
-    log_debug("Chose random (untried) move %d. Added child at %p. Move completes %d boxes.\n", move, (void *)node, node->numBoxesTakenByMove);
-    return node;
+    log_debug("Chose random (untried) move %d. Added child %d. Move completes %d boxes.\n", tree->nodes[child].move, child, tree->nodes[child].numBoxesTakenByMove);
+    return child;
+}
+
+static void addChildrenToMCTSNode(MCTSTree * tree, int node, const UnscoredState * state) {
+    // Reserves a child for every move the node has, in the order orderMCTSMoves gives, so that
+    // taking the children into use in order tries the untried moves at random or best prior first.
+    short numMoves = tree->nodes[node].numPotentialMoves;
+    if (tree->numNodes + numMoves > tree->capacity)
+        growMCTSTree(tree, tree->capacity * 2);
+
+    Edge moves[NUM_EDGES];
+    float priors[NUM_EDGES];
+    getFreeEdges(state, moves);
+    orderMCTSMoves(state, moves, priors, numMoves);
+
+    int firstChild = tree->numNodes;
+    for (short i=0; i < numMoves; i++) {
+        tree->nodes[firstChild + i].move = moves[i];
+        tree->priors[firstChild + i] = priors[i];
+    }
+
+    tree->nodes[node].firstChild = firstChild;
+    tree->numNodes += numMoves;
+}
+
+static void orderMCTSMoves(const UnscoredState * state, Edge * moves, float * priors, short numMoves) {
+    // Shuffles the moves. With progressive widening they are then sorted by weight, best first, which
+    // keeps the shuffled order among moves of the same weight, and priors[i] is moves[i]'s share of
+    // the total weight. Without it every prior is the same.
+    for (short i = numMoves - 1; i > 0; i--) {
+        short j = randomInRange(0, i);
+        Edge move = moves[i];
+        moves[i] = moves[j];
+        moves[j] = move;
+    }
+
+    if (!mctsProgressiveWidening) {
+        for (short i=0; i < numMoves; i++)
+            priors[i] = 1.0f / (float)numMoves;
+        return;
+    }
+
+    Bitboard board;
+    unscoredStateToBitboard(&board, state);
+    Bitboard capturedBoard = board;
+    short numBoxesCapturable = captureAllBitboardBoxes(&capturedBoard);
+
+    float totalWeight = 0.0;
+    for (short i=0; i < numMoves; i++) {
+        // An insertion sort, as there are at most NUM_EDGES moves and most share a weight.
+        Edge move = moves[i];
+        float weight = getMCTSMoveWeight(&board, numBoxesCapturable, move);
+        totalWeight += weight;
+
+        short j = i;
+        for (; j > 0 && priors[j-1] < weight; j--) {
+            moves[j] = moves[j-1];
+            priors[j] = priors[j-1];
+        }
+        moves[j] = move;
+        priors[j] = weight;
+    }
+
+    for (short i=0; i < numMoves; i++)
+        priors[i] /= totalWeight;
+}
+
+static float getMCTSMoveWeight(const Bitboard * board, short numBoxesCapturable, Edge move) {
+    // A capture comes first, then a move which gives nothing away, and last a sacrifice, which is
+    // worse the more boxes it lets the opponent take. numBoxesCapturable is what could be taken
+    // before the move.
+    Bitboard afterMove = *board;
+    short numBoxesTaken = makeBitboardMove(&afterMove, move);
+    if (numBoxesTaken > 0)
+        return MCTS_CAPTURE_WEIGHT * (float)numBoxesTaken;
+
+    short numBoxesGiven = captureAllBitboardBoxes(&afterMove) - numBoxesCapturable;
+    if (numBoxesGiven <= 0)
+        return MCTS_SAFE_WEIGHT;
+
+    return MCTS_SACRIFICE_WEIGHT / (float)numBoxesGiven;
+}
+
+static int addChildToMCTSNode(MCTSTree * tree, int node, const UnscoredState * state) {
+    // Takes the node's next reserved child into use. state is the node's state.
+    MCTSNode * parentNode = &tree->nodes[node];
+    assert(parentNode->firstChild != MCTS_NO_NODE && parentNode->numChildren < parentNode->numPotentialMoves);
+
+    int child = parentNode->firstChild + parentNode->numChildren;
+    initMCTSNode(tree, child, node, state, parentNode->nextPlayerToMove, tree->nodes[child].move);
+
+    parentNode->numChildren += 1;
+    return child;
+}
+
+// SHARED TREE
+// With tree parallelisation every thread searches the same tree, so nodes are changed with atomics:
+//  - Selection adds a visit to every node on its path straight away, before the result is known.
+//    Until the result is added this counts as a loss (a virtual loss), which steers the other
+//    threads to different children. Backpropagation then only adds the score.
+//  - A node's children are reserved and set up by whichever thread gets there first, and the range
+//    is published by a compare-and-swap on firstChild. A thread which loses the race leaves its
+//    range unused.
+//  - Children are taken into use by a compare-and-swap on numChildren.
+// The tree can't grow while it is shared, so once it's full leaves are simulated without expanding.
+
+void addSharedMCTSScore(float * totalScore, float score, MCTSContention * contention) {
+    float expected, desired;
+    __atomic_load(totalScore, &expected, __ATOMIC_RELAXED);
+
+    while (true) {
+        desired = expected + score;
+        if (__atomic_compare_exchange(totalScore, &expected, &desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return;
+        contention->scoreRetries++;
+    }
+}
+
+static void addSharedMCTSTotalScore(double * totalScore, double score, MCTSContention * contention) {
+    // As addSharedMCTSScore, for the plain tree's double scores.
+    double expected, desired;
+    __atomic_load(totalScore, &expected, __ATOMIC_RELAXED);
+
+    while (true) {
+        desired = expected + score;
+        if (__atomic_compare_exchange(totalScore, &expected, &desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return;
+        contention->scoreRetries++;
+    }
 }
 
-static short getUntriedMovesMCTSNode(MCTSNode * node, Edge * untriedMovesBuffer) {
-    MCTSNode * child = node->child;
-    if (child == NULL)
-        return getFreeEdges(&(node->state), untriedMovesBuffer);
-    else {
-        // Build a binary search tree with the already-tried child moves.
-        // This is far more efficient than using a list.
-        BTree * triedMoves = newBTree(child->move);
+static int applySharedTreePolicy(MCTSTree * tree, UnscoredState * state, MCTSContention * contention) {
+    // Like applyTreePolicy, but safe to run on several threads at once. Adds a virtual loss to
+    // every node returned or passed through.
+    int node = 0;
+    __atomic_fetch_add(&tree->visits[0], 1, __ATOMIC_RELAXED);
+
+    while(tree->nodes[node].numPotentialMoves > 0) { // node is non-terminal
+        const MCTSNode * n = &tree->nodes[node];
+
+        if (__atomic_load_n(&n->numChildren, __ATOMIC_RELAXED) < getNumMCTSChildrenAllowed(n, __atomic_load_n(&tree->visits[node], __ATOMIC_RELAXED))) {
+            int child = claimSharedChild(tree, node, state, contention);
+            if (child != MCTS_NO_NODE) {
+                __atomic_fetch_add(&tree->visits[child], 1, __ATOMIC_RELAXED);
+                setEdgeTaken(state, tree->nodes[child].move);
+                return child;
+            }
+            if (__atomic_load_n(&n->numChildren, __ATOMIC_RELAXED) == 0) // the tree is full
+                return node;
+        }
+
+        int child = getBestSharedChildUCB1(tree, node, contention);
+        if (child == MCTS_NO_NODE) // every child was only just taken into use
+            return node;
+
+        __atomic_fetch_add(&tree->visits[child], 1, __ATOMIC_RELAXED);
+        setEdgeTaken(state, tree->nodes[child].move);
+        node = child;
+    }
+
+    return node;
+}
 
-        while((child = child->sibling) != NULL) {
-            insertBTree(triedMoves, child->move);
+static int getBestSharedChildUCB1(const MCTSTree * tree, int node, MCTSContention * contention) {
+    // The same formula as getBestChildUCB1, or getBestChildPUCT with progressive widening, reading
+    // each child atomically. Children whose first visit hasn't been added yet are skipped.
+    float UCTK = 0.7;
+
+    const MCTSNode * n = &tree->nodes[node];
+    int firstChild = __atomic_load_n(&n->firstChild, __ATOMIC_ACQUIRE);
+    int numChildren = __atomic_load_n(&n->numChildren, __ATOMIC_RELAXED);
+    int parentVisits = __atomic_load_n(&tree->visits[node], __ATOMIC_RELAXED);
+    float parentTerm = mctsProgressiveWidening ?
+        MCTS_PUCT_EXPLORATION * sqrtf((float)parentVisits) :
+        getUCB1ParentTerm(parentVisits, UCTK);
+
+    int bestChild = MCTS_NO_NODE;
+    float bestValue = -INFINITY;
+    for (int c = firstChild; c < firstChild + numChildren; c++) {
+        int visits = __atomic_load_n(&tree->visits[c], __ATOMIC_RELAXED);
+        if (visits == 0) {
+            contention->unvisitedChildren++;
+            continue;
         }
 
-        Edge freeEdges[node->numPotentialMoves];
-        short numFreeEdges = getFreeEdges(&(node->state), freeEdges);
-        short numUntriedMoves = 0;
-        for(short i=0; i < numFreeEdges; i++) {
-            if (!doesBTreeContain(triedMoves, freeEdges[i]))
-                untriedMovesBuffer[numUntriedMoves++] = freeEdges[i];
+        double totalScore;
+        __atomic_load(&tree->totalScores[c], &totalScore, __ATOMIC_RELAXED);
+        float inverseVisits = 1.0f / (float)visits;
+        float mean = (float)(totalScore / visits);
+        if (mctsRaveEquivalence > 0) {
+            double amafScore;
+            __atomic_load(&tree->amafScores[c], &amafScore, __ATOMIC_RELAXED);
+            mean = getRAVEMean(totalScore, visits, amafScore, __atomic_load_n(&tree->amafVisits[c], __ATOMIC_RELAXED));
         }
+        float value = mctsProgressiveWidening ?
+            mean + parentTerm * tree->priors[c] / (1.0f + (float)visits) :
+            mean + parentTerm * sqrtf(inverseVisits);
 
-        return numUntriedMoves;
+        if (value > bestValue) {
+            bestValue = value;
+            bestChild = c;
+        }
     }
+
+    return bestChild;
 }
 
-static MCTSNode * addChildToMCTSNode(MCTSNode * parentNode, Edge move) {
-    // Init child
-    MCTSNode * newChild = (MCTSNode *)malloc( sizeof(MCTSNode) );
-    UnscoredState newChildState = parentNode->state;
-    setEdgeTaken(&newChildState, move);
+static int reserveSharedChildren(MCTSTree * tree, int node, const UnscoredState * state, MCTSContention * contention) {
+    // Sets up a child for every move of the node in a range of its own and tries to publish it.
+    // Returns the node's first child, whoever published it, or MCTS_NO_NODE when the tree is full.
+    MCTSNode * n = &tree->nodes[node];
+    short numMoves = n->numPotentialMoves;
 
-    initMCTSNode(newChild, parentNode, newChildState, parentNode->nextPlayerToMove, move);
+    int firstChild = __atomic_fetch_add(&tree->numNodes, numMoves, __ATOMIC_RELAXED);
+    if (firstChild + numMoves > tree->capacity) {
+        contention->fullTreeLeaves++;
+        return __atomic_load_n(&n->firstChild, __ATOMIC_ACQUIRE); // unless another thread got there first
+    }
 
-    // Add child to node
-    if (parentNode->child == NULL)
-        parentNode->child = newChild;
-    else {
-        MCTSNode * otherChild = parentNode->child;
+    Edge moves[NUM_EDGES];
+    float priors[NUM_EDGES];
+    getFreeEdges(state, moves);
+    orderMCTSMoves(state, moves, priors, numMoves);
 
-        // Walk to the end of the linked list
-        while(otherChild->sibling != NULL)
-            otherChild = otherChild->sibling;
+    for (short i=0; i < numMoves; i++) {
+        initMCTSNode(tree, firstChild + i, node, state, n->nextPlayerToMove, moves[i]);
+        tree->priors[firstChild + i] = priors[i];
+    }
 
-        otherChild->sibling = newChild;
+    int expected = MCTS_NO_NODE;
+    if (!__atomic_compare_exchange_n(&n->firstChild, &expected, firstChild, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        contention->expansionCollisions++;
+        return expected;
     }
 
-    parentNode->numChildren += 1;
-    return newChild;
+    return firstChild;
+}
+
+static int claimSharedChild(MCTSTree * tree, int node, const UnscoredState * state, MCTSContention * contention) {
+    // Takes the node's next reserved child into use. Returns MCTS_NO_NODE when every child allowed is
+    // in use already or the tree is full.
+    MCTSNode * n = &tree->nodes[node];
+    int firstChild = __atomic_load_n(&n->firstChild, __ATOMIC_ACQUIRE);
+    if (firstChild == MCTS_NO_NODE) {
+        firstChild = reserveSharedChildren(tree, node, state, contention);
+        if (firstChild == MCTS_NO_NODE)
+            return MCTS_NO_NODE;
+    }
+
+    short numAllowed = getNumMCTSChildrenAllowed(n, __atomic_load_n(&tree->visits[node], __ATOMIC_RELAXED));
+    unsigned char numChildren = __atomic_load_n(&n->numChildren, __ATOMIC_RELAXED);
+    while (numChildren < numAllowed) {
+        if (__atomic_compare_exchange_n(&n->numChildren, &numChildren, numChildren + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return firstChild + numChildren;
+        contention->claimRetries++;
+    }
+
+    return MCTS_NO_NODE;
+}
+
+static void backpropagateSharedResult(MCTSTree * tree, int node, PlayerNum scoreFirstPlayer, double score, short numPlayouts, const Bitboard * playoutEdges, MCTSContention * contention) {
+    // The first playout's visits were added by applySharedTreePolicy, and only the others' are added
+    // here. RAVE statistics are added as backpropagateResult does.
+    Bitboard laterEdges[2];
+    if (playoutEdges != NULL) {
+        laterEdges[0] = playoutEdges[0];
+        laterEdges[1] = playoutEdges[1];
+    }
+
+    while(node != MCTS_NO_NODE) {
+        const MCTSNode * n = &tree->nodes[node];
+        addSharedMCTSTotalScore(&tree->totalScores[node], n->nextPlayerToMove == scoreFirstPlayer ? score : numPlayouts - score, contention);
+        if (numPlayouts > 1)
+            __atomic_fetch_add(&tree->visits[node], numPlayouts - 1, __ATOMIC_RELAXED);
+
+        if (playoutEdges != NULL) {
+            addMCTSAMAFScores(tree, node, laterEdges, scoreFirstPlayer, score, true, contention);
+            if (n->move != NO_EDGE)
+                setBitboardEdgeTaken(&laterEdges[n->playerJustMoved - 1], n->move);
+        }
+
+        node = n->parent;
+    }
 }
 
 // SIMULATE
-static double applyDefaultPolicy(const MCTSNode * leafNode, short rootNumBoxesLeft) {
-    // Returns a value between 0.0 and 1.0 which is the proportion of boxes
-    // taken by the first player to move from the given leafNode.
-    if (rootNumBoxesLeft == 0)
-        return 0.0;
+static int getRandomPlayoutBoxes(Bitboard board, short numPlayouts, Bitboard * moverEdges) {
+    // Plays the position out at random numPlayouts times and returns how many of its boxes left went
+    // to the player to move, over all the playouts. Unless moverEdges is NULL, which it must be for
+    // more than one playout, it is set to the edges that player took.
+    // A batch is played out MCTS_PLAYOUT_LANES playouts at a time, side by side, with uniformly
+    // random moves: greedy playouts are only played one at a time.
+    assert(numPlayouts == 1 || (moverEdges == NULL && !mctsGreedyPlayouts));
+    Edge freeEdges[NUM_EDGES];
+    short numFreeEdges = getBitboardFreeEdges(&board, freeEdges);
+    if (numPlayouts == 1)
+        return playOutRandomly(board, freeEdges, numFreeEdges, moverEdges);
+
+    int boxesTaken = 0;
+    for (short i=0; i < numPlayouts; i += MCTS_PLAYOUT_LANES) {
+        short numLanes = numPlayouts - i < MCTS_PLAYOUT_LANES ? numPlayouts - i : MCTS_PLAYOUT_LANES;
+        boxesTaken += playOutRandomlyInLanes(board, freeEdges, numFreeEdges, numLanes);
+    }
+
+    return boxesTaken;
+}
+
+static int playOutRandomlyInLanes(Bitboard board, const Edge * freeEdges, short numFreeEdges, short numLanes) {
+    // Plays numLanes random playouts side by side for getRandomPlayoutBoxes and returns how many boxes
+    // the player to move took in them altogether. The board is bit-sliced: bit l of taken[k] is set
+    // once freeEdges[k] is taken in playout l, so a box is checked in every playout at once with a
+    // few ANDs. Each playout takes one edge a step, so they all end after numFreeEdges steps.
+    assert(numLanes >= 1 && numLanes <= MCTS_PLAYOUT_LANES);
+    unsigned long long lanes = numLanes == 64 ? ~0ULL : (1ULL << numLanes) - 1;
+    unsigned long long taken[NUM_EDGES+1] = {0};
+    taken[numFreeEdges] = ~0ULL;
+
+    // Boxes still open are checked through their free edges, the ones they lack pointing at
+    // taken[numFreeEdges], which is always set.
+    unsigned char edgeIndices[NUM_EDGES];
+    unsigned char allIndices[NUM_EDGES];
+    for (short k=0; k < numFreeEdges; k++) {
+        edgeIndices[freeEdges[k]] = (unsigned char)k;
+        allIndices[k] = (unsigned char)k;
+    }
+
+    unsigned char boxEdges[NUM_BOXES][4];
+    short numOpenBoxes = 0;
+    for (Box b=0; b < NUM_BOXES; b++) {
+        const Edge * edges = getBoxEdges(b);
+        short numBoxFreeEdges = 0;
+        for (short i=0; i < 4; i++) {
+            if (!isBitboardEdgeTaken(&board, edges[i]))
+                boxEdges[numOpenBoxes][numBoxFreeEdges++] = edgeIndices[edges[i]];
+        }
+        if (numBoxFreeEdges == 0)
+            continue;
+        while (numBoxFreeEdges < 4)
+            boxEdges[numOpenBoxes][numBoxFreeEdges++] = (unsigned char)numFreeEdges;
+        numOpenBoxes++;
+    }
+
+    // Each playout draws its moves from its own list of the edges it has left, which the drawn edge
+    // is swapped out of.
+    unsigned char edgesLeft[MCTS_PLAYOUT_LANES][NUM_EDGES];
+    for (short l=0; l < numLanes; l++)
+        memcpy(edgesLeft[l], allIndices, numFreeEdges);
+
+    unsigned long long moverToMove = lanes;
+    unsigned long long full[NUM_BOXES] = {0};
+    unsigned long long moverBoxes[NUM_BOXES] = {0};
+    for (short step=0; step < numFreeEdges; step++) {
+        short numLeft = numFreeEdges - step;
+        for (short l=0; l < numLanes; l++) {
+            unsigned char * left = edgesLeft[l] + step;
+            short i = randomInRange(0, numLeft-1);
+            taken[left[i]] |= 1ULL << l;
+            left[i] = left[0];
+        }
+
+        unsigned long long keepTurn = 0;
+        for (short b=0; b < numOpenBoxes; b++) {
+            const unsigned char * e = boxEdges[b];
+            unsigned long long isFull = taken[e[0]] & taken[e[1]] & taken[e[2]] & taken[e[3]];
+            unsigned long long completed = isFull & ~full[b];
+            full[b] = isFull;
+            moverBoxes[b] |= completed & moverToMove;
+            keepTurn |= completed;
+        }
+        moverToMove ^= lanes & ~keepTurn;
+    }
 
-    UnscoredState tmpState = leafNode->state;
+    int boxesTaken = 0;
+    for (short b=0; b < numOpenBoxes; b++)
+        boxesTaken += countBits(moverBoxes[b]);
+    return boxesTaken;
+}
 
+static short playOutRandomly(Bitboard board, Edge * freeEdges, short numFreeEdges, Bitboard * moverEdges) {
+    // Plays one playout for getRandomPlayoutBoxes, drawing moves from freeEdges, the board's free
+    // edges, which it shuffles. With mctsGreedyPlayouts, captures are taken as soon as they are offered.
+    Bitboard edges = {0, 0};
+    MacroMove macroMoves[MAX_MACRO_MOVES];
+
+    // Random moves are drawn from the list of free edges, swapping the last one into the gap, so
+    // each edge is looked at once in the whole playout rather than every edge once per move. Edges
+    // taken by captures stay in the list and are thrown away when they are drawn.
     short boxesTaken = 0;
-    short currentPlayer = leafNode->nextPlayerToMove;
-    short numPotentialMoves = getNumFreeEdges(&tmpState);
+    bool isMoverToMove = true;
+    bool mayCapture = true; // only the boxes next to the last move can have become capturable
+
+    while (!isBitboardFull(&board)) {
+        // Greedy captures are played out in one go, choosing at random whether to double-deal.
+        short numMacroMoves = mctsGreedyPlayouts && mayCapture ? getBitboardMacroMoves(&board, macroMoves) : 0;
+        if (numMacroMoves > 0) {
+            const MacroMove * macroMove = &macroMoves[randomInRange(0, numMacroMoves-1)];
+            makeMacroMove(&board, macroMove);
+
+            if (isMoverToMove) {
+                boxesTaken += macroMove->numBoxes;
+                makeMacroMove(&edges, macroMove);
+            }
+            if (!macroMove->keepsTurn)
+                isMoverToMove = !isMoverToMove;
+
+            mayCapture = !macroMove->keepsTurn; // a double-deal leaves boxes for the opponent
+            continue;
+        }
 
-    for(short i=0; i<numPotentialMoves; i++) {
-        Edge move = getRandomMove(&tmpState);
+        Edge move;
+        do {
+            assert(numFreeEdges > 0);
+            short i = randomInRange(0, numFreeEdges-1);
+            move = freeEdges[i];
+            freeEdges[i] = freeEdges[--numFreeEdges];
+        } while (isBitboardEdgeTaken(&board, move));
+
+        short boxesTakenByMove = makeBitboardMove(&board, move);
+        if (isMoverToMove)
+            setBitboardEdgeTaken(&edges, move);
+
+        const Box * moveBoxes = getEdgeBoxes(move);
+        mayCapture = false;
+        for (short i=0; i < 2; i++) {
+            if (moveBoxes[i] != NO_BOX && isBitboardBoxCapturable(&board, moveBoxes[i]))
+                mayCapture = true;
+        }
 
-        short boxesTakenByMove = howManyBoxesDoesMoveComplete(&tmpState, move);
         if(boxesTakenByMove == 0) {
             // It's the other player's turn
-            currentPlayer = 3 - currentPlayer;
+            isMoverToMove = !isMoverToMove;
         }
-        else if (currentPlayer == 1) {
+        else if (isMoverToMove) {
             boxesTaken += boxesTakenByMove;
         }
+    }
+
+    if (moverEdges != NULL)
+        *moverEdges = edges;
+    return boxesTaken;
+}
 
-        setEdgeTaken(&tmpState, move);
+static double applyDefaultPolicy(const MCTSTree * tree, int leafNode, const UnscoredState * leafState, short rootNumBoxesLeft, short numPlayouts, Bitboard * playoutEdges) {
+    // Returns a value between 0.0 and 1.0 which is the proportion of boxes
+    // taken by the first player to move from the given leafNode, added up over numPlayouts playouts.
+    // Unless playoutEdges is NULL, playoutEdges[p-1] is set to the edges player p took in the playout,
+    // of which there must then be one.
+    Bitboard board;
+    unscoredStateToBitboard(&board, leafState);
+    PlayerNum leafPlayer = tree->nodes[leafNode].nextPlayerToMove;
+
+    if (rootNumBoxesLeft == 0) {
+        if (playoutEdges != NULL)
+            playoutEdges[0] = playoutEdges[1] = (Bitboard){0, 0};
+        return 0.0;
     }
 
-    short boxesTakenUpTree = getNumBoxesTakenUpTree(leafNode, leafNode->nextPlayerToMove);
+    // The playout's boxes are counted for player 1.
+    Bitboard moverEdges;
+    int moverBoxes = getRandomPlayoutBoxes(board, numPlayouts, playoutEdges != NULL ? &moverEdges : NULL);
+    if (playoutEdges != NULL) {
+        // The playout goes on until the board is full, so the other player took every other free edge.
+        playoutEdges[leafPlayer - 1] = moverEdges;
+        playoutEdges[2 - leafPlayer].lo = ~(board.lo | moverEdges.lo);
+        playoutEdges[2 - leafPlayer].hi = ~(board.hi | moverEdges.hi) & BITBOARD_HI_MASK;
+    }
+
+    int boxesTaken = leafPlayer == 1 ? moverBoxes : getBitboardNumBoxesLeft(&board) * numPlayouts - moverBoxes;
+
+    int boxesTakenUpTree = getNumBoxesTakenUpTree(tree, leafNode, leafPlayer) * numPlayouts;
     return ((double)boxesTaken + (double)boxesTakenUpTree) / (double)rootNumBoxesLeft;
 }
 
 // BACKPROPAGATE
-static void backpropagateResult(MCTSNode * node, PlayerNum scoreFirstPlayer, double score) {
-    while(node != NULL) {
-        if (node->nextPlayerToMove == scoreFirstPlayer)
-            node->totalScore += score;
+static void backpropagateResult(MCTSTree * tree, int node, PlayerNum scoreFirstPlayer, double score, short numPlayouts, const Bitboard * playoutEdges) {
+    // score is added up over numPlayouts playouts.
+    // playoutEdges is NULL unless RAVE is on, when it is added to with each move on the way up.
+    Bitboard laterEdges[2];
+    if (playoutEdges != NULL) {
+        laterEdges[0] = playoutEdges[0];
+        laterEdges[1] = playoutEdges[1];
+    }
+
+    while(node != MCTS_NO_NODE) {
+        MCTSNode * n = &tree->nodes[node];
+        if (n->nextPlayerToMove == scoreFirstPlayer)
+            tree->totalScores[node] += score;
         else
-            node->totalScore += 1.0 - score;
+            tree->totalScores[node] += numPlayouts - score;
+
+        tree->visits[node] += numPlayouts;
 
-        node->visits += 1;
+        log_debug("Updated node %d. totalScore: %G, visits: %d\n", node, tree->totalScores[node], tree->visits[node]);
+
+        if (playoutEdges != NULL) {
+            addMCTSAMAFScores(tree, node, laterEdges, scoreFirstPlayer, score, false, NULL);
+            if (n->move != NO_EDGE)
+                setBitboardEdgeTaken(&laterEdges[n->playerJustMoved - 1], n->move);
+        }
 
-        log_debug("Updated node at %p. totalScore: %G, visits: %d\n", (void *)node, node->totalScore, node->visits);
+        node = n->parent;
+    }
+}
 
-        node = node->parent;
+static void addMCTSAMAFScores(MCTSTree * tree, int node, const Bitboard * laterEdges, PlayerNum scoreFirstPlayer, double score, bool shareTree, MCTSContention * contention) {
+    // Every child of the node whose move was made later in the iteration by the node's player to
+    // move gets the iteration's score, as if its move had been made first. laterEdges[p-1] holds the
+    // edges player p took after the node.
+    const MCTSNode * n = &tree->nodes[node];
+    const Bitboard * moverEdges = &laterEdges[n->nextPlayerToMove - 1];
+    int firstChild = shareTree ? __atomic_load_n(&n->firstChild, __ATOMIC_ACQUIRE) : n->firstChild;
+    int numChildren = shareTree ? __atomic_load_n(&n->numChildren, __ATOMIC_RELAXED) : n->numChildren;
+
+    for (int c = firstChild; c < firstChild + numChildren; c++) {
+        const MCTSNode * child = &tree->nodes[c];
+        if (!isBitboardEdgeTaken(moverEdges, child->move))
+            continue;
+
+        double childScore = child->nextPlayerToMove == scoreFirstPlayer ? score : 1.0 - score;
+        if (shareTree) {
+            __atomic_fetch_add(&tree->amafVisits[c], 1, __ATOMIC_RELAXED);
+            addSharedMCTSTotalScore(&tree->amafScores[c], childScore, contention);
+        }
+        else {
+            tree->amafVisits[c] += 1;
+            tree->amafScores[c] += childScore;
+        }
     }
 }
 
-static MCTSNode * getMostVisitedChild(MCTSNode * node) {
-    MCTSNode * mostVisited;
+static int getMostVisitedChild(const MCTSTree * tree, int node) {
+    const MCTSNode * n = &tree->nodes[node];
+    int mostVisited = MCTS_NO_NODE;
     int mostVisits = -1;
 
-    assert(node->child != NULL);
-    MCTSNode * child = node->child;
+    assert(n->numChildren > 0);
 
-    while(child != NULL) {
-        if(child->visits > mostVisits) {
-            mostVisited = child;
-            mostVisits = child->visits;
+    for (int c = n->firstChild; c < n->firstChild + n->numChildren; c++) {
+        if(tree->visits[c] > mostVisits) {
+            mostVisited = c;
+            mostVisits = tree->visits[c];
         }
-        child = child->sibling;
     }
 
     return mostVisited;
 }
 
-Edge getMCTSMove(UnscoredState * rootState, int runTimeMillis, bool saveTreeJSON) {
-    MCTSNode * rootNode = (MCTSNode *)malloc( sizeof(MCTSNode) );
-    initMCTSNode(rootNode, NULL, *rootState, NO_PLAYER, NO_EDGE);
+static Edge getMergedMostVisitedMove(const MCTSTree * trees, short numTrees) {
+    // Root parallel searches are combined by adding up the visits of each root move over every tree.
+    if (numTrees == 1)
+        return trees[0].nodes[getMostVisitedChild(&trees[0], 0)].move;
 
-    log_log("\ngetMCTSMove: STARTING. Root node at %p, numPotentialMoves: %d\n", (void *)rootNode, rootNode->numPotentialMoves);
+    int moveVisits[NUM_EDGES] = {0};
+    for (short t=0; t < numTrees; t++) {
+        const MCTSNode * root = &trees[t].nodes[0];
+        for (int c = root->firstChild; c < root->firstChild + root->numChildren; c++)
+            moveVisits[trees[t].nodes[c].move] += trees[t].visits[c];
+    }
 
-    assert(runTimeMillis > 0);
-    unsigned long long startTimeMillis = getTimeMillis();
-    unsigned long long endTimeMillis = startTimeMillis + (unsigned long long)runTimeMillis;
-    int iterationCount = 0;
+    Edge bestMove = NO_EDGE;
+    int mostVisits = 0;
+    for (Edge e=0; e < NUM_EDGES; e++) {
+        if (moveVisits[e] > mostVisits) {
+            bestMove = e;
+            mostVisits = moveVisits[e];
+        }
+    }
+
+    return bestMove;
+}
 
-    short rootNumBoxesLeft = getNumBoxesLeft(rootState);
+static void * runMCTSWorker(void * arg) {
+    MCTSWorker * worker = (MCTSWorker *)arg;
+    seedRandom(worker->seed);
 
-    MCTSNode * node;
+    MCTSTree * tree = worker->tree;
+    short rootNumBoxesLeft = getNumBoxesLeft(worker->rootState);
+
+    int node;
     UnscoredState nodeState;
+    Bitboard playoutEdges[2];
+    Bitboard * raveEdges = mctsRaveEquivalence > 0 ? playoutEdges : NULL;
 
-    while(getTimeMillis() < endTimeMillis) {
-        iterationCount++;
-        log_debug("getMCTSMove: Iteration %d\n", iterationCount);
+    while(getTimeMillis() < worker->endTimeMillis) {
+        worker->iterationCount++;
+        log_debug("runMCTSWorker: Iteration %d\n", worker->iterationCount);
 
-        node = rootNode;
-        nodeState = *rootState;
+        nodeState = *worker->rootState;
 
         // Select & expand (apply tree policy)
-        log_debug("getMCTSMove: Applying tree policy...\n");
-        node = applyTreePolicy(node, &nodeState);
+        log_debug("runMCTSWorker: Applying tree policy...\n");
+        if (worker->shareTree)
+            node = applySharedTreePolicy(tree, &nodeState, &worker->contention);
+        else
+            node = applyTreePolicy(tree, &nodeState);
 
         // Simulate (apply default policy)
-        log_debug("getMCTSMove: Applying default policy...\n");
-        double score = applyDefaultPolicy(node, rootNumBoxesLeft);
+        log_debug("runMCTSWorker: Applying default policy...\n");
+        double score = applyDefaultPolicy(tree, node, &nodeState, rootNumBoxesLeft, worker->numPlayouts, raveEdges);
 
         // Backpropagate
-        log_debug("getMCTSMove: Backpropagating...\n");
-        backpropagateResult(node, node->nextPlayerToMove, score);
+        log_debug("runMCTSWorker: Backpropagating...\n");
+        if (worker->shareTree)
+            backpropagateSharedResult(tree, node, tree->nodes[node].nextPlayerToMove, score, worker->numPlayouts, raveEdges, &worker->contention);
+        else
+            backpropagateResult(tree, node, tree->nodes[node].nextPlayerToMove, score, worker->numPlayouts, raveEdges);
     }
 
-    log_log("Simulation complete! Ran for %d iterations. Average iteration duration (millis): %G.\n", iterationCount, (double)runTimeMillis/(double)iterationCount);
-    log_log("Returning child with most visits...\n");
-Edge bestMove = getMostVisitedChild(rootNode)->move;
+    return NULL;
+}
+
+void addMCTSContention(MCTSContention * total, const MCTSContention * contention) {
+    total->claimRetries += contention->claimRetries;
+    total->scoreRetries += contention->scoreRetries;
+    total->expansionCollisions += contention->expansionCollisions;
+    total->unvisitedChildren += contention->unvisitedChildren;
+    total->fullTreeLeaves += contention->fullTreeLeaves;
+}
+
+void logMCTSContention(const MCTSContention * contention, int iterationCount) {
+    log_log("Contention over %d iterations: %d child claim retries, %d score retries, %d expansion collisions, %d unvisited children skipped, %d leaves not expanded in a full tree.\n",
+        iterationCount, contention->claimRetries, contention->scoreRetries, contention->expansionCollisions, contention->unvisitedChildren, contention->fullTreeLeaves);
+}
+
+// TRANSPOSITIONS
+// The DAG search (see MCTSDAG) goes through the same four steps as the tree search, with one DAG per
+// thread as threads can't share one. Selection remembers its path since a node has no single parent.
+#define MCTS_DAG_INITIAL_NODES (1 << 14)
+#define MCTS_DAG_INITIAL_EDGES (1 << 18)
+
+// Kept between moves and only grown, as mctsTrees are. Each search starts a new DAG though, since
+// positions the game has passed would otherwise stay in the table.
+static MCTSDAG mctsDAGs[MCTS_MAX_THREADS];
+
+static void initMCTSDAG(MCTSDAG * dag, const UnscoredState * rootState) {
+    dag->nodeCapacity = MCTS_DAG_INITIAL_NODES;
+    dag->edgeCapacity = MCTS_DAG_INITIAL_EDGES;
+    dag->tableSize = 2 * MCTS_DAG_INITIAL_NODES;
+    dag->nodes = (MCTSDAGNode *)malloc(dag->nodeCapacity * sizeof(MCTSDAGNode));
+    dag->edges = (MCTSDAGEdge *)malloc(dag->edgeCapacity * sizeof(MCTSDAGEdge));
+    dag->table = (int *)malloc(dag->tableSize * sizeof(int));
+
+    if (dag->nodes == NULL || dag->edges == NULL || dag->table == NULL) {
+        log_error("[ERROR] initMCTSDAG: Could not allocate %d nodes.\n", dag->nodeCapacity);
+        exit(1);
+    }
+
+    resetMCTSDAG(dag, rootState);
+}
+
+static void resetMCTSDAG(MCTSDAG * dag, const UnscoredState * rootState) {
+    // Drops every node but a new root, keeping the arrays for reuse.
+    dag->rootState = *rootState;
+    dag->numNodes = 0;
+    dag->numEdges = 0;
+    dag->numTranspositions = 0;
+    for (int slot=0; slot < dag->tableSize; slot++)
+        dag->table[slot] = MCTS_NO_NODE;
+
+    Bitboard rootBoard;
+    unscoredStateToBitboard(&rootBoard, rootState);
+    findOrAddMCTSDAGNode(dag, &rootBoard);
+}
+
+static void freeMCTSDAG(MCTSDAG * dag) {
+    free(dag->nodes);
+    free(dag->edges);
+    free(dag->table);
+    dag->nodes = NULL;
+    dag->edges = NULL;
+    dag->table = NULL;
+    dag->numNodes = 0;
+    dag->numEdges = 0;
+}
+
+static void growMCTSDAGTable(MCTSDAG * dag) {
+    // Doubles the table and puts every node back into it.
+    dag->tableSize *= 2;
+    dag->table = (int *)realloc(dag->table, dag->tableSize * sizeof(int));
+    if (dag->table == NULL) {
+        log_error("[ERROR] growMCTSDAGTable: Could not allocate %d slots.\n", dag->tableSize);
+        exit(1);
+    }
+
+    int mask = dag->tableSize - 1;
+    for (int slot=0; slot < dag->tableSize; slot++)
+        dag->table[slot] = MCTS_NO_NODE;
+    for (int node=0; node < dag->numNodes; node++) {
+        int slot = getBitboardHash(&dag->nodes[node].board) & mask;
+        while (dag->table[slot] != MCTS_NO_NODE)
+            slot = (slot + 1) & mask;
+        dag->table[slot] = node;
+    }
+}
+
+static int findOrAddMCTSDAGNode(MCTSDAG * dag, const Bitboard * board) {
+    // Returns the node for board, adding it if the DAG hasn't reached the position yet.
+    if (2 * (dag->numNodes + 1) > dag->tableSize)
+        growMCTSDAGTable(dag);
+
+    int mask = dag->tableSize - 1;
+    int slot = getBitboardHash(board) & mask;
+    while (dag->table[slot] != MCTS_NO_NODE) {
+        const Bitboard * nodeBoard = &dag->nodes[dag->table[slot]].board;
+        if (nodeBoard->lo == board->lo && nodeBoard->hi == board->hi)
+            return dag->table[slot];
+        slot = (slot + 1) & mask;
+    }
+
+    if (dag->numNodes == dag->nodeCapacity) {
+        dag->nodeCapacity *= 2;
+        dag->nodes = (MCTSDAGNode *)realloc(dag->nodes, dag->nodeCapacity * sizeof(MCTSDAGNode));
+        if (dag->nodes == NULL) {
+            log_error("[ERROR] findOrAddMCTSDAGNode: Could not allocate %d nodes.\n", dag->nodeCapacity);
+            exit(1);
+        }
+    }
+
+    int node = dag->numNodes++;
+    MCTSDAGNode * n = &dag->nodes[node];
+    n->board = *board;
+    n->firstEdge = MCTS_NO_NODE;
+    n->visits = 0;
+    n->totalScore = 0.0;
+    n->numEdges = 0;
+    n->numPotentialMoves = getBitboardNumFreeEdges(board);
+    n->numBoxesLeft = getBitboardNumBoxesLeft(board);
+
+    dag->table[slot] = node;
+    return node;
+}
+
+static void addEdgesToMCTSDAGNode(MCTSDAG * dag, int node) {
+    // Reserves an edge for every move in random order, as addChildrenToMCTSNode does.
+    short numMoves = dag->nodes[node].numPotentialMoves;
+    if (dag->numEdges + numMoves > dag->edgeCapacity) {
+        dag->edgeCapacity *= 2;
+        dag->edges = (MCTSDAGEdge *)realloc(dag->edges, dag->edgeCapacity * sizeof(MCTSDAGEdge));
+        if (dag->edges == NULL) {
+            log_error("[ERROR] addEdgesToMCTSDAGNode: Could not allocate %d edges.\n", dag->edgeCapacity);
+            exit(1);
+        }
+    }
+
+    Edge moves[NUM_EDGES];
+    getBitboardFreeEdges(&dag->nodes[node].board, moves);
+    for (short i = numMoves - 1; i > 0; i--) {
+        short j = randomInRange(0, i);
+        Edge move = moves[i];
+        moves[i] = moves[j];
+        moves[j] = move;
+    }
+
+    int firstEdge = dag->numEdges;
+    for (short i=0; i < numMoves; i++) {
+        MCTSDAGEdge * edge = &dag->edges[firstEdge + i];
+        edge->child = MCTS_NO_NODE;
+        edge->visits = 0;
+        edge->move = moves[i];
+        edge->numBoxesTakenByMove = 0;
+    }
+
+    dag->nodes[node].firstEdge = firstEdge;
+    dag->numEdges += numMoves;
+}
+
+static int expandMCTSDAGNode(MCTSDAG * dag, int node) {
+    // Takes the node's next reserved edge into use and returns it. The position it leads to may
+    // already be in the DAG.
+    if (dag->nodes[node].firstEdge == MCTS_NO_NODE)
+        addEdgesToMCTSDAGNode(dag, node);
+
+    MCTSDAGNode * n = &dag->nodes[node];
+    assert(n->numEdges < n->numPotentialMoves);
+    int edge = n->firstEdge + n->numEdges;
+    n->numEdges++;
+
+    Bitboard board = n->board;
+    dag->edges[edge].numBoxesTakenByMove = makeBitboardMove(&board, dag->edges[edge].move);
+
+    int numNodes = dag->numNodes;
+    dag->edges[edge].child = findOrAddMCTSDAGNode(dag, &board);
+    if (dag->numNodes == numNodes)
+        dag->numTranspositions++;
+
+    return edge;
+}
+
+static float getMCTSDAGEdgeValue(const MCTSDAG * dag, int node, int edge) {
+    // The share of the node's boxes left its player to move ends up with after the edge's move, going
+    // by what the search found from the position the move leads to. That position's score is for
+    // whoever moves there, who is still the same player only if the move took boxes.
+    const MCTSDAGEdge * e = &dag->edges[edge];
+    const MCTSDAGNode * child = &dag->nodes[e->child];
+    assert(child->visits > 0);
+
+    float childBoxes = (float)(child->totalScore / child->visits) * (float)child->numBoxesLeft;
+    if (e->numBoxesTakenByMove == 0)
+        childBoxes = (float)child->numBoxesLeft - childBoxes;
+
+    return ((float)e->numBoxesTakenByMove + childBoxes) / (float)dag->nodes[node].numBoxesLeft;
+}
+
+static int getBestMCTSDAGEdgeUCB1(const MCTSDAG * dag, int node) {
+    // UCB1 over the node's edges, with each edge's value from its child and its visits its own.
+    float UCTK = 0.7;
+
+    const MCTSDAGNode * n = &dag->nodes[node];
+    assert(n->numEdges > 0);
+
+    float totalScores[NUM_EDGES];
+    int visits[NUM_EDGES];
+    for (short i=0; i < n->numEdges; i++) {
+        visits[i] = dag->edges[n->firstEdge + i].visits;
+        totalScores[i] = getMCTSDAGEdgeValue(dag, node, n->firstEdge + i) * (float)visits[i];
+    }
+
+    return n->firstEdge + getBestUCB1Index(totalScores, visits, n->numEdges, n->visits, UCTK);
+}
+
+static short applyMCTSDAGPolicy(MCTSDAG * dag, int * pathNodes, int * pathEdges) {
+    // Selects a path from the root as applyTreePolicy does, ending with one new edge unless it reaches
+    // the end of the game. Returns the number of edges on the path: pathNodes has one more entry,
+    // the last being the leaf.
+    short pathLength = 0;
+    int node = 0;
+    pathNodes[0] = node;
+
+    while (dag->nodes[node].numPotentialMoves > 0) { // node is non-terminal
+        bool fullyExpanded = dag->nodes[node].numEdges == dag->nodes[node].numPotentialMoves;
+        int edge = fullyExpanded ? getBestMCTSDAGEdgeUCB1(dag, node) : expandMCTSDAGNode(dag, node);
+
+        node = dag->edges[edge].child;
+        pathEdges[pathLength++] = edge;
+        pathNodes[pathLength] = node;
+
+        if (!fullyExpanded)
+            break;
+    }
+
+    return pathLength;
+}
+
+static void backpropagateMCTSDAGResult(MCTSDAG * dag, const int * pathNodes, const int * pathEdges, short pathLength, int moverBoxes, short numPlayouts) {
+    // moverBoxes is how many of the leaf's boxes left its player to move took in numPlayouts playouts.
+    // On the way up, a move which took boxes keeps the same player to move and adds them to its
+    // boxes, once for each playout, and any other move hands the boxes counted so far to the other player.
+    int otherBoxes = dag->nodes[pathNodes[pathLength]].numBoxesLeft * numPlayouts - moverBoxes;
+
+    for (short i = pathLength; i >= 0; i--) {
+        MCTSDAGNode * n = &dag->nodes[pathNodes[i]];
+        n->visits += numPlayouts;
+        if (n->numBoxesLeft > 0)
+            n->totalScore += (double)moverBoxes / (double)n->numBoxesLeft;
+
+        if (i == 0)
+            break;
+
+        MCTSDAGEdge * edge = &dag->edges[pathEdges[i-1]];
+        edge->visits += numPlayouts;
+        if (edge->numBoxesTakenByMove > 0)
+            moverBoxes += edge->numBoxesTakenByMove * numPlayouts;
+        else {
+            int boxes = moverBoxes;
+            moverBoxes = otherBoxes;
+            otherBoxes = boxes;
+        }
+    }
+}
+
+static Edge getMergedMostVisitedDAGMove(const MCTSDAG * dags, short numDAGs) {
+    // As getMergedMostVisitedMove, adding up the visits of the root's edges.
+    int moveVisits[NUM_EDGES] = {0};
+    for (short t=0; t < numDAGs; t++) {
+        const MCTSDAGNode * root = &dags[t].nodes[0];
+        for (int e = root->firstEdge; e < root->firstEdge + root->numEdges; e++)
+            moveVisits[dags[t].edges[e].move] += dags[t].edges[e].visits;
+    }
+
+    Edge bestMove = NO_EDGE;
+    int mostVisits = 0;
+    for (Edge e=0; e < NUM_EDGES; e++) {
+        if (moveVisits[e] > mostVisits) {
+            bestMove = e;
+            mostVisits = moveVisits[e];
+        }
+    }
+
+    return bestMove;
+}
+
+static void * runMCTSDAGWorker(void * arg) {
+    MCTSWorker * worker = (MCTSWorker *)arg;
+    seedRandom(worker->seed);
+
+    MCTSDAG * dag = worker->dag;
+    int pathNodes[NUM_EDGES + 1];
+    int pathEdges[NUM_EDGES];
+
+    while(getTimeMillis() < worker->endTimeMillis) {
+        worker->iterationCount++;
+
+        short pathLength = applyMCTSDAGPolicy(dag, pathNodes, pathEdges);
+        int moverBoxes = getRandomPlayoutBoxes(dag->nodes[pathNodes[pathLength]].board, worker->numPlayouts, NULL);
+        backpropagateMCTSDAGResult(dag, pathNodes, pathEdges, pathLength, moverBoxes, worker->numPlayouts);
+    }
+
+    return NULL;
+}
+
+static Edge getMCTSDAGMove(const UnscoredState * rootState, int runTimeMillis, short numThreads, bool saveTreeJSON) {
+    unsigned long long startTimeMillis = getTimeMillis();
+    MCTSWorker workers[numThreads];
+    pthread_t threads[numThreads];
+
+    for (short t=0; t < numThreads; t++) {
+        MCTSDAG * dag = &mctsDAGs[t];
+        if (dag->nodes == NULL)
+            initMCTSDAG(dag, rootState);
+        else
+            resetMCTSDAG(dag, rootState);
+
+        workers[t].dag = dag;
+        workers[t].rootState = rootState;
+        workers[t].endTimeMillis = startTimeMillis + (unsigned long long)runTimeMillis;
+        workers[t].seed = getRandom64();
+        workers[t].numPlayouts = mctsPlayoutBatchSize;
+        workers[t].iterationCount = 0;
+    }
+
+    for (short t=1; t < numThreads; t++)
+        pthread_create(&threads[t], NULL, runMCTSDAGWorker, &workers[t]);
+    runMCTSDAGWorker(&workers[0]);
+    for (short t=1; t < numThreads; t++)
+        pthread_join(threads[t], NULL);
+
+    int iterationCount = 0;
+    int numNodes = 0;
+    int numEdges = 0;
+    int numTranspositions = 0;
+    size_t bytesReserved = 0;
+    for (short t=0; t < numThreads; t++) {
+        const MCTSDAG * dag = &mctsDAGs[t];
+        iterationCount += workers[t].iterationCount;
+        numNodes += dag->numNodes;
+        numEdges += dag->numEdges;
+        numTranspositions += dag->numTranspositions;
+        bytesReserved += dag->nodeCapacity * sizeof(MCTSDAGNode) + dag->edgeCapacity * sizeof(MCTSDAGEdge) + dag->tableSize * sizeof(int);
+    }
+
+    log_log("Simulation complete! Ran for %d iterations of %d playouts. Average iteration duration (millis): %G.\n", iterationCount, mctsPlayoutBatchSize, (double)runTimeMillis*numThreads/(double)iterationCount);
+    log_log("DAG has %d positions and %d edges, %d of them into a position reached before. Reserved %luKB.\n",
+        numNodes, numEdges, numTranspositions, (unsigned long)(bytesReserved / 1024));
+    log_log("Returning edge with most visits...\n");
+    Edge bestMove = getMergedMostVisitedDAGMove(mctsDAGs, numThreads);
 
-    /*
     if(saveTreeJSON)
-        saveMCTSNodeJSON(rootNode, "rootNode.json");
-    */
+        saveMCTSDAG(&mctsDAGs[0]);
+
+    return bestMove;
+}
+
+Edge getMCTSMove(UnscoredState * rootState, int runTimeMillis, short numThreads, bool shareTree, bool mergeTranspositions, bool saveTreeJSON) {
+    // Runs numThreads searches, the first on the calling thread. They either search a tree each
+    // (root parallelisation) or all search the same tree (tree parallelisation).
+    assert(runTimeMillis > 0);
+    assert(numThreads >= 1 && numThreads <= MCTS_MAX_THREADS);
+
+    if (mergeTranspositions) {
+        log_log("\ngetMCTSMove: STARTING. numPotentialMoves: %d, threads: %d, a DAG each\n", getNumFreeEdges(rootState), numThreads);
+        if (shareTree)
+            log_warn("getMCTSMove: Threads can't share a DAG, so each searches its own.\n");
+        return getMCTSDAGMove(rootState, runTimeMillis, numThreads, saveTreeJSON);
+    }
+
+    log_log("\ngetMCTSMove: STARTING. numPotentialMoves: %d, threads: %d, %s\n", getNumFreeEdges(rootState), numThreads,
+        shareTree ? "sharing one tree" : "a tree each");
+
+    short numPlayouts = mctsPlayoutBatchSize;
+    assert(numPlayouts == 1 || mctsRaveEquivalence == 0); // RAVE learns from one playout at a time
+
+    unsigned long long startTimeMillis = getTimeMillis();
+    short numTrees = shareTree ? 1 : numThreads;
+    MCTSWorker workers[numThreads];
+    pthread_t threads[numThreads];
+
+    for (short t=0; t < numTrees; t++) {
+        MCTSTree * tree = &mctsTrees[t];
+        if (tree->nodes == NULL)
+            initMCTSTree(tree, rootState);
+        else if (shareTree != mctsTreesWereShared || !reuseMCTSTree(tree, rootState))
+            resetMCTSTree(tree, rootState);
+    }
+    mctsTreesWereShared = shareTree;
+
+    if (shareTree) {
+        growMCTSTree(&mctsTrees[0], sharedTreeWasFull ? mctsTrees[0].capacity * 2 : MCTS_SHARED_INITIAL_CAPACITY);
+        sharedTreeWasFull = false;
+    }
+
+    for (short t=0; t < numThreads; t++) {
+        workers[t].tree = &mctsTrees[shareTree ? 0 : t];
+        workers[t].shareTree = shareTree;
+        workers[t].rootState = rootState;
+        workers[t].endTimeMillis = startTimeMillis + (unsigned long long)runTimeMillis;
+        workers[t].seed = getRandom64();
+        workers[t].numPlayouts = numPlayouts;
+        workers[t].iterationCount = 0;
+        memset(&workers[t].contention, 0, sizeof(MCTSContention));
+    }
+
+    for (short t=1; t < numThreads; t++)
+        pthread_create(&threads[t], NULL, runMCTSWorker, &workers[t]);
+    runMCTSWorker(&workers[0]);
+    for (short t=1; t < numThreads; t++)
+        pthread_join(threads[t], NULL);
+
+    if (shareTree && mctsTrees[0].numNodes > mctsTrees[0].capacity) {
+        // Reservations which didn't fit still counted themselves.
+        mctsTrees[0].numNodes = mctsTrees[0].capacity;
+        sharedTreeWasFull = true;
+    }
+
+    int iterationCount = 0;
+    MCTSContention contention = {0, 0, 0, 0, 0};
+    for (short t=0; t < numThreads; t++) {
+        iterationCount += workers[t].iterationCount;
+        addMCTSContention(&contention, &workers[t].contention);
+    }
+
+    int numNodes = 0;
+    int capacity = 0;
+    for (short t=0; t < numTrees; t++) {
+        numNodes += mctsTrees[t].numNodes;
+        capacity += mctsTrees[t].capacity;
+    }
+
+    log_log("Simulation complete! Ran for %d iterations of %d playouts. Average iteration duration (millis): %G.\n", iterationCount, numPlayouts, (double)runTimeMillis*numThreads/(double)iterationCount);
+    size_t nodeBytes = sizeof(MCTSNode) + 2 * sizeof(double) + sizeof(float) + 2 * sizeof(int);
+    log_log("Tree has %d nodes. Peak tree memory: %luKB of %luKB reserved.\n", numNodes,
+        (unsigned long)(numNodes * nodeBytes / 1024), (unsigned long)(capacity * nodeBytes / 1024));
+    if (shareTree)
+        logMCTSContention(&contention, iterationCount);
+    log_log("Returning child with most visits...\n");
+    Edge bestMove = getMergedMostVisitedMove(mctsTrees, numTrees);
 
-    freeMCTSNode(rootNode);
+    if(saveTreeJSON)
+        saveMCTSTree(&mctsTrees[0]);
 
     return bestMove;
 }
 
-/*
-static void saveMCTSNodeJSON(const MCTSNode * node, const char * filePath) {
-    json_t * j = MCTSNodeToJSON(node);
-    json_dump_file(j, filePath, 0);
-    json_decref(j);
+static void writeMCTSTree(TreeWriter * writer, const MCTSTree * tree, int node, int parentId, short depth, Bitboard board) {
+    // Nodes are written before their children. The children of a node which isn't sampled can't be either,
+    // since they are deeper and have fewer visits.
+    const MCTSNode * n = &tree->nodes[node];
+    if (!isTreeNodeSampled(writer, depth, tree->visits[node]))
+        return;
+
+    if (n->move != NO_EDGE)
+        setBitboardEdgeTaken(&board, n->move);
+
+    int id = getNewTreeNodeId(writer);
+    beginTreeNode(writer, id, parentId, depth, n->move, &board);
+    writeTreeNodeInt(writer, "playerJustMoved", n->playerJustMoved);
+    writeTreeNodeInt(writer, "nextPlayerToMove", n->nextPlayerToMove);
+    writeTreeNodeInt(writer, "numBoxesTakenByMove", n->numBoxesTakenByMove);
+    writeTreeNodeDouble(writer, "totalScore", tree->totalScores[node]);
+    writeTreeNodeInt(writer, "visits", tree->visits[node]);
+    writeTreeNodeInt(writer, "numChildren", n->numChildren);
+    endTreeNode(writer);
+
+    for (int c = n->firstChild; c < n->firstChild + n->numChildren; c++)
+        writeMCTSTree(writer, tree, c, id, depth + 1, board);
 }
 
-static json_t * MCTSNodeToJSON(const MCTSNode * node) {
-    json_t * j;
+static void saveMCTSTree(const MCTSTree * tree) {
+    TreeWriter writer;
+    if (!openTreeWriter(&writer, &mctsTreeSettings, "monte_carlo", &tree->rootState))
+        return;
 
-    char parentPointerString[32];
-    sprintf(parentPointerString, "%p", (void *)node->parent);
+    Bitboard rootBoard;
+    unscoredStateToBitboard(&rootBoard, &tree->rootState);
+    writeMCTSTree(&writer, tree, 0, -1, 0, rootBoard);
+    closeTreeWriter(&writer);
+}
 
-    char nodePointerString[32];
-    sprintf(nodePointerString, "%p", (void *)node);
+static void writeMCTSDAG(TreeWriter * writer, const MCTSDAG * dag, int node, int edge, int parentId, short depth) {
+    // The DAG is written out as a tree, so a position reached along several sampled paths is written
+    // once for each. Sampling goes by the visits of the edge into the node, which bound those of the
+    // edges below it along the path.
+    const MCTSDAGNode * n = &dag->nodes[node];
+    int visits = edge == MCTS_NO_NODE ? n->visits : dag->edges[edge].visits;
+    if (!isTreeNodeSampled(writer, depth, visits))
+        return;
+
+    int id = getNewTreeNodeId(writer);
+    beginTreeNode(writer, id, parentId, depth, edge == MCTS_NO_NODE ? NO_EDGE : dag->edges[edge].move, &n->board);
+    writeTreeNodeInt(writer, "numBoxesTakenByMove", edge == MCTS_NO_NODE ? 0 : dag->edges[edge].numBoxesTakenByMove);
+    writeTreeNodeInt(writer, "visits", visits);
+    writeTreeNodeInt(writer, "positionVisits", n->visits);
+    writeTreeNodeDouble(writer, "totalScore", n->totalScore);
+    writeTreeNodeInt(writer, "numChildren", n->numEdges);
+    endTreeNode(writer);
+
+    for (int e = n->firstEdge; e < n->firstEdge + n->numEdges; e++)
+        writeMCTSDAG(writer, dag, dag->edges[e].child, e, id, depth + 1);
+}
 
-    char stateString[NUM_EDGES+1];
-    for(short i=0; i<NUM_EDGES; i++) {
-        if(isEdgeTaken(&(node->state), i))
-            stateString[i] = '1';
-        else
-            stateString[i] = '0';
-    }
-    stateString[NUM_EDGES] = '\0';
-
-    json_t * children_array = json_array();
-    MCTSNode * child = node->child;
-    while(child != NULL) {
-        json_array_append_new(children_array, MCTSNodeToJSON(child));
-        child = child->sibling;
-    }
-
-    j = json_pack("{s:s, s:s, s:s, s:i, s:i, s:i, s:i, s:f, s:i, s:i, s:i, s:o}",
-            "address", nodePointerString,
-            "parent", parentPointerString,
-            "state", stateString,
-            "playerJustMoved", (int)node->playerJustMoved,
-            "nextPlayerToMove", (int)node->nextPlayerToMove,
-            "move", (int)node->move,
-            "numBoxesTakenByMove", (int)node->numBoxesTakenByMove,
-            "totalScore", node->totalScore,
-            "visits", node->visits,
-            "numPotentialMoves", (int)node->numPotentialMoves,
-            "numChildren", (int)node->numChildren,
-            "children", children_array);
-    return j;
-}
-*/
+static void saveMCTSDAG(const MCTSDAG * dag) {
+    TreeWriter writer;
+    if (!openTreeWriter(&writer, &mctsTreeSettings, "monte_carlo", &dag->rootState))
+        return;
+
+    writeMCTSDAG(&writer, dag, 0, MCTS_NO_NODE, -1, 0);
+    closeTreeWriter(&writer);
+}
 
 void runMCTSTests() {
     log_log("RUNNING MCTS TESTS\n");
 
-    log_log("\nTesting initMCTSNode...\n");
+    log_log("\nTesting initMCTSTree...\n");
     UnscoredState rootState;
     stringToUnscoredState(&rootState, "000000000000000000000000000000000000000000000000000000000000000000000000");
 
+    log_debug("It should keep nodes to 16 bytes.\n");
+    assert(sizeof(MCTSNode) == 16);
+
     log_debug("It should behave correctly for the root node.\n");
-    MCTSNode * rootNode = (MCTSNode *)malloc( sizeof(MCTSNode) );
-    initMCTSNode(rootNode, NULL, rootState, NO_PLAYER, NO_EDGE); 
-    assert(rootNode->parent == NULL);
-    assert(rootNode->child == NULL);
-    assert(rootNode->sibling == NULL);
-    assert(rootNode->move = NO_EDGE);
+    MCTSTree tree;
+    initMCTSTree(&tree, &rootState);
+    MCTSNode * rootNode = &tree.nodes[0];
+    assert(tree.numNodes == 1);
+    assert(rootNode->parent == MCTS_NO_NODE);
+    assert(rootNode->firstChild == MCTS_NO_NODE);
+    assert(rootNode->move == NO_EDGE);
     assert(rootNode->numBoxesTakenByMove == 0);
     assert(rootNode->playerJustMoved == NO_PLAYER);
     assert(rootNode->nextPlayerToMove == 1);
-    assert(rootNode->totalScore == 0.0);
-    assert(rootNode->visits == 0);
+    assert(tree.totalScores[0] == 0.0);
+    assert(tree.visits[0] == 0);
     assert(rootNode->numPotentialMoves == NUM_EDGES);
     assert(rootNode->numChildren == 0);
 
+    log_log("\nTesting addChildrenToMCTSNode...\n");
+    log_debug("It should reserve a contiguous child for every move, each move once.\n");
+    addChildrenToMCTSNode(&tree, 0, &rootState);
+    rootNode = &tree.nodes[0];
+    assert(rootNode->firstChild == 1);
+    assert(tree.numNodes == 1 + NUM_EDGES);
+    assert(rootNode->numChildren == 0);
+    Bitboard childMoves = {0, 0};
+    for (int c = rootNode->firstChild; c < rootNode->firstChild + NUM_EDGES; c++) {
+        assert(!isBitboardEdgeTaken(&childMoves, tree.nodes[c].move));
+        setBitboardEdgeTaken(&childMoves, tree.nodes[c].move);
+    }
+
     log_log("\nTesting addChildToMCTSNode...\n");
     log_debug("It should behave correctly for a child node.\n");
-    MCTSNode * firstChild = addChildToMCTSNode(rootNode, 1);
-    assert(rootNode->child == firstChild);
+    int firstChild = addChildToMCTSNode(&tree, 0, &rootState);
+    assert(firstChild == rootNode->firstChild);
     assert(rootNode->numChildren == 1);
-    assert(firstChild->parent == rootNode);
-    assert(firstChild->child == NULL);
-    assert(firstChild->sibling == NULL);
-    assert(firstChild->move = 1);
-    assert(firstChild->numBoxesTakenByMove == 0);
-    assert(firstChild->playerJustMoved == 1);
-    assert(firstChild->nextPlayerToMove == 2);
-    assert(firstChild->totalScore == 0.0);
-    assert(firstChild->visits == 0);
-    assert(firstChild->numPotentialMoves == NUM_EDGES - 1);
-    assert(firstChild->numChildren == 0);
+    assert(tree.nodes[firstChild].parent == 0);
+    assert(tree.nodes[firstChild].firstChild == MCTS_NO_NODE);
+    assert(tree.nodes[firstChild].numBoxesTakenByMove == 0);
+    assert(tree.nodes[firstChild].playerJustMoved == 1);
+    assert(tree.nodes[firstChild].nextPlayerToMove == 2);
+    assert(tree.totalScores[firstChild] == 0.0);
+    assert(tree.visits[firstChild] == 0);
+    assert(tree.nodes[firstChild].numPotentialMoves == NUM_EDGES - 1);
+    assert(tree.nodes[firstChild].numChildren == 0);
 
     log_debug("It should behave correctly for a second child node.\n");
-    MCTSNode * secondChild = addChildToMCTSNode(rootNode, 2);
-    assert(rootNode->child == firstChild);
+    int secondChild = addChildToMCTSNode(&tree, 0, &rootState);
+    assert(secondChild == firstChild + 1);
     assert(rootNode->numChildren == 2);
-    assert(firstChild->sibling == secondChild);
-    assert(secondChild->parent == rootNode);
-    assert(secondChild->child == NULL);
-    assert(secondChild->sibling == NULL);
-    assert(secondChild->move = 2);
-    assert(secondChild->numBoxesTakenByMove == 0);
-    assert(secondChild->playerJustMoved == 1);
-    assert(secondChild->nextPlayerToMove == 2);
-    assert(secondChild->totalScore == 0.0);
-    assert(secondChild->visits == 0);
-    assert(secondChild->numPotentialMoves == NUM_EDGES - 1);
-    assert(secondChild->numChildren == 0);
+    assert(tree.nodes[secondChild].parent == 0);
+    assert(tree.nodes[secondChild].move != tree.nodes[firstChild].move);
+    assert(tree.nodes[secondChild].playerJustMoved == 1);
+    assert(tree.nodes[secondChild].nextPlayerToMove == 2);
+    assert(tree.nodes[secondChild].numPotentialMoves == NUM_EDGES - 1);
+
+    log_debug("It should count the boxes a child's move completes.\n");
+    UnscoredState almostFullState;
+    stringToUnscoredState(&almostFullState, "111111111111111111111111111111111111111111111111111111111111111111111110");
+    MCTSTree almostFullTree;
+    initMCTSTree(&almostFullTree, &almostFullState);
+    addChildrenToMCTSNode(&almostFullTree, 0, &almostFullState);
+    int lastChild = addChildToMCTSNode(&almostFullTree, 0, &almostFullState);
+    assert(almostFullTree.nodes[lastChild].move == 71);
+    assert(almostFullTree.nodes[lastChild].numBoxesTakenByMove == 1);
+    assert(almostFullTree.nodes[lastChild].nextPlayerToMove == 1);
+    assert(almostFullTree.nodes[lastChild].numPotentialMoves == 0);
+
+    log_log("\nTesting resetMCTSTree...\n");
+    log_debug("It should drop every node but a new root and keep the arrays.\n");
+    MCTSNode * almostFullNodes = almostFullTree.nodes;
+    int almostFullCapacity = almostFullTree.capacity;
+    resetMCTSTree(&almostFullTree, &rootState);
+    assert(almostFullTree.numNodes == 1);
+    assert(almostFullTree.nodes == almostFullNodes && almostFullTree.capacity == almostFullCapacity);
+    assert(almostFullTree.nodes[0].firstChild == MCTS_NO_NODE);
+    assert(almostFullTree.nodes[0].numChildren == 0);
+    assert(almostFullTree.nodes[0].numPotentialMoves == NUM_EDGES);
+    assert(almostFullTree.visits[0] == 0);
+    freeMCTSTree(&almostFullTree);
 
     log_log("\nTesting applyTreePolicy...\n");
-    log_debug("It should create a new node if the given node is not fully expanded.\n");
-    MCTSNode * newNode = applyTreePolicy(rootNode, &rootState);
-    assert(newNode != firstChild && newNode != secondChild);
+    log_debug("It should create a new node if the root is not fully expanded.\n");
+    UnscoredState nodeState = rootState;
+    int newNode = applyTreePolicy(&tree, &nodeState);
+    rootNode = &tree.nodes[0];
+    assert(newNode == secondChild + 1);
     assert(rootNode->numChildren == 3);
 
     log_debug("It should modify the given state with the move of the node it picks.\n");
-    assert(isEdgeTaken(&rootState, newNode->move) == true);
+    assert(isEdgeTaken(&nodeState, tree.nodes[newNode].move) == true);
+    assert(getNumFreeEdges(&nodeState) == NUM_EDGES - 1);
 
     log_debug("It should be invariant for terminal nodes.\n");
     UnscoredState terminalState;
     stringToUnscoredState(&terminalState, "111111111111111111111111111111111111111111111111111111111111111111111111");
-
-    MCTSNode * terminalNode = (MCTSNode *)malloc( sizeof(MCTSNode) );
-    initMCTSNode(terminalNode, NULL, terminalState, NO_PLAYER, NO_EDGE); 
-    assert(terminalNode == applyTreePolicy(terminalNode, &terminalState));
-
-    log_log("\nTesting getUntriedMovesMCTSNode...\n");
-    log_debug("It should return no moves for a terminal node.\n");
-    Edge untriedMoves[NUM_EDGES];
-    short numUntriedMoves = getUntriedMovesMCTSNode(terminalNode, untriedMoves);
-    assert(numUntriedMoves == 0);
-
-    log_debug("It should return the correct number of moves for a node with some children.\n");
-    numUntriedMoves = getUntriedMovesMCTSNode(rootNode, untriedMoves);
-    assert(numUntriedMoves == rootNode->numPotentialMoves - rootNode->numChildren);
+    MCTSTree terminalTree;
+    initMCTSTree(&terminalTree, &terminalState);
+    assert(applyTreePolicy(&terminalTree, &terminalState) == 0);
+    assert(terminalTree.numNodes == 1);
 
     log_log("\nTesting getBestChildUCB1...\n");
     log_debug("It should return the child with the highest UCB1 score...\n");
-    rootNode->totalScore = 1.0;
-    rootNode->visits = 2;
+    tree.totalScores[0] = 1.0;
+    tree.visits[0] = 2;
+
+    tree.totalScores[firstChild] = 0.25;
+    tree.visits[firstChild] = 1;
 
-    firstChild->totalScore = 0.25;
-    firstChild->visits = 1;
+    tree.totalScores[secondChild] = 0.75;
+    tree.visits[secondChild] = 1;
 
-    secondChild->totalScore = 0.75;
-    secondChild->visits = 1;
+    tree.totalScores[newNode] = 0.5;
+    tree.visits[newNode] = 1;
 
-    assert(getBestChildUCB1(rootNode) == secondChild);
+    assert(getBestChildUCB1(&tree, 0) == secondChild);
 
     log_log("\nTesting applyDefaultPolicy...\n");
     log_debug("It should return 0.0 for a terminal node.\n");
-    double score = applyDefaultPolicy(terminalNode, 0);
+    double score = applyDefaultPolicy(&terminalTree, 0, &terminalState, 0, 1, NULL);
     assert(score == 0.0);
 
     log_debug("It should return a sensible value for a non-terminal state.\n");
-    MCTSNode * firstChildChild = addChildToMCTSNode(firstChild, 3);
-    score = applyDefaultPolicy(firstChildChild, NUM_BOXES);
+    UnscoredState firstChildState = rootState;
+    setEdgeTaken(&firstChildState, tree.nodes[firstChild].move);
+    addChildrenToMCTSNode(&tree, firstChild, &firstChildState);
+    int firstChildChild = addChildToMCTSNode(&tree, firstChild, &firstChildState);
+    UnscoredState firstChildChildState = firstChildState;
+    setEdgeTaken(&firstChildChildState, tree.nodes[firstChildChild].move);
+    score = applyDefaultPolicy(&tree, firstChildChild, &firstChildChildState, NUM_BOXES, 1, NULL);
     log_debug("Score: %G\n", score);
     assert(score >= 0.0 && score <= 1.0);
 
+    log_debug("It should add up the scores of a batch of playouts.\n");
+    double batchScore = applyDefaultPolicy(&tree, firstChildChild, &firstChildChildState, NUM_BOXES, 64, NULL);
+    assert(batchScore >= 0.0 && batchScore <= 64.0);
+    Bitboard almostFullBoard;
+    unscoredStateToBitboard(&almostFullBoard, &almostFullState);
+    assert(getRandomPlayoutBoxes(almostFullBoard, 64, NULL) == 64);
+
+    log_debug("It should follow whose turn it is in each playout of a batch.\n");
+    Edge borderEdges[2][2]; // the edges on the side of the board of the first and the last box
+    for (short i=0; i < 2; i++) {
+        const Edge * boxEdges = getBoxEdges(i == 0 ? 0 : NUM_BOXES - 1);
+        short numBorderEdges = 0;
+        for (short j=0; j < 4; j++) {
+            const Box * edgeBoxes = getEdgeBoxes(boxEdges[j]);
+            if (edgeBoxes[0] == NO_BOX || edgeBoxes[1] == NO_BOX)
+                borderEdges[i][numBorderEdges++] = boxEdges[j];
+        }
+        assert(numBorderEdges == 2);
+    }
+    Bitboard givenAwayBoard = {~0ULL, BITBOARD_HI_MASK}; // whoever moves first gives the box away
+    setBitboardEdgeFree(&givenAwayBoard, borderEdges[0][0]);
+    setBitboardEdgeFree(&givenAwayBoard, borderEdges[0][1]);
+    assert(getRandomPlayoutBoxes(givenAwayBoard, 100, NULL) == 0);
+    Bitboard twoCapturesBoard = {~0ULL, BITBOARD_HI_MASK}; // the player to move takes both
+    setBitboardEdgeFree(&twoCapturesBoard, borderEdges[0][0]);
+    setBitboardEdgeFree(&twoCapturesBoard, borderEdges[1][0]);
+    assert(getRandomPlayoutBoxes(twoCapturesBoard, 100, NULL) == 200);
+
+    log_debug("It should take as many boxes in a batch as in the same number of playouts one at a time.\n");
+    Bitboard firstChildChildBoard;
+    unscoredStateToBitboard(&firstChildChildBoard, &firstChildChildState);
+    int singleBoxes = 0;
+    for (short i=0; i < 6400; i++)
+        singleBoxes += getRandomPlayoutBoxes(firstChildChildBoard, 1, NULL);
+    int batchBoxes = getRandomPlayoutBoxes(firstChildChildBoard, 6400, NULL);
+    log_debug("Boxes per playout: %G one at a time, %G in a batch\n", singleBoxes / 6400.0, batchBoxes / 6400.0);
+    assert(abs(singleBoxes - batchBoxes) < 6400 / 2);
+
     log_log("\nTesting backpropagateResult...\n");
     log_debug("It should increase the visits and total score of the leaf node.\n");
-    backpropagateResult(firstChildChild, firstChildChild->nextPlayerToMove, score);
-    assert(firstChildChild->visits == 1);
-    assert(firstChildChild->totalScore == score);
-    log_debug("firstChildChild->totalScore = %G\n", firstChildChild->totalScore);
+    backpropagateResult(&tree, firstChildChild, tree.nodes[firstChildChild].nextPlayerToMove, score, 1, NULL);
+    assert(tree.visits[firstChildChild] == 1);
+    assert(tree.totalScores[firstChildChild] == score);
+    log_debug("firstChildChild totalScore = %G\n", tree.totalScores[firstChildChild]);
 
     log_debug("It should increase the visits of the parent node.\n");
-    assert(firstChild->visits == 2);
+    assert(tree.visits[firstChild] == 2);
 
     log_debug("If the parent node's move was played by the other player, it's totalScore should increase by 1.0 - the backpropagated score.\n");
     // 0.25 is assigned above
-    assert(firstChild->totalScore == 0.25 + 1.0 - score);
+    assert(fabs(tree.totalScores[firstChild] - (0.25 + 1.0 - score)) < 1e-6);
+
+    log_debug("It should count every playout of a batch as a visit.\n");
+    MCTSTree batchTree;
+    initMCTSTree(&batchTree, &rootState);
+    addChildrenToMCTSNode(&batchTree, 0, &rootState);
+    int batchChild = addChildToMCTSNode(&batchTree, 0, &rootState);
+    backpropagateResult(&batchTree, batchChild, batchTree.nodes[batchChild].nextPlayerToMove, 1.5, 4, NULL);
+    assert(batchTree.visits[batchChild] == 4 && batchTree.totalScores[batchChild] == 1.5f);
+    assert(batchTree.visits[0] == 4 && batchTree.totalScores[0] == 2.5f);
+    freeMCTSTree(&batchTree);
+
+    log_log("\nTesting RAVE...\n");
+    log_debug("It should split the free edges left by the playout between the players.\n");
+    Bitboard playoutEdges[2];
+    applyDefaultPolicy(&tree, firstChildChild, &firstChildChildState, NUM_BOXES, 1, playoutEdges);
+    Bitboard leafBoard;
+    unscoredStateToBitboard(&leafBoard, &firstChildChildState);
+    assert((playoutEdges[0].lo & playoutEdges[1].lo) == 0 && (playoutEdges[0].hi & playoutEdges[1].hi) == 0);
+    assert(((playoutEdges[0].lo | playoutEdges[1].lo) & leafBoard.lo) == 0 && ((playoutEdges[0].hi | playoutEdges[1].hi) & leafBoard.hi) == 0);
+    assert((playoutEdges[0].lo | playoutEdges[1].lo | leafBoard.lo) == ~0ULL);
+    assert((playoutEdges[0].hi | playoutEdges[1].hi | leafBoard.hi) == BITBOARD_HI_MASK);
+
+    log_debug("It should score a sibling whose move the same player made later, as if it had been made first.\n");
+    MCTSTree raveTree;
+    initMCTSTree(&raveTree, &rootState);
+    addChildrenToMCTSNode(&raveTree, 0, &rootState);
+    int playedChild = addChildToMCTSNode(&raveTree, 0, &rootState);
+    int siblingChild = addChildToMCTSNode(&raveTree, 0, &rootState);
+    Bitboard siblingMoveEdges[2] = { {0, 0}, {0, 0} };
+    setBitboardEdgeTaken(&siblingMoveEdges[0], raveTree.nodes[siblingChild].move);
+    backpropagateResult(&raveTree, playedChild, raveTree.nodes[playedChild].nextPlayerToMove, 0.25, 1, siblingMoveEdges);
+    assert(raveTree.amafVisits[playedChild] == 1 && raveTree.amafScores[playedChild] == 0.25f);
+    assert(raveTree.amafVisits[siblingChild] == 1 && raveTree.amafScores[siblingChild] == 0.25f);
+    assert(raveTree.visits[siblingChild] == 0);
+
+    log_debug("It should leave the sibling alone when the other player made its move.\n");
+    Bitboard otherPlayerEdges[2] = { {0, 0}, {0, 0} };
+    setBitboardEdgeTaken(&otherPlayerEdges[1], raveTree.nodes[siblingChild].move);
+    backpropagateResult(&raveTree, playedChild, raveTree.nodes[playedChild].nextPlayerToMove, 0.25, 1, otherPlayerEdges);
+    assert(raveTree.amafVisits[playedChild] == 2 && raveTree.amafVisits[siblingChild] == 1);
+
+    log_debug("It should only weigh in RAVE scores when they are turned on.\n");
+    raveTree.visits[0] = 2;
+    raveTree.visits[playedChild] = raveTree.visits[siblingChild] = 1;
+    raveTree.totalScores[playedChild] = raveTree.totalScores[siblingChild] = 0.5;
+    raveTree.amafVisits[playedChild] = raveTree.amafVisits[siblingChild] = 10;
+    raveTree.amafScores[playedChild] = 1.0;
+    raveTree.amafScores[siblingChild] = 9.0;
+    assert(getBestChildUCB1(&raveTree, 0) == playedChild);
+    mctsRaveEquivalence = 1000;
+    assert(getBestChildUCB1(&raveTree, 0) == siblingChild);
+    MCTSContention raveContention = {0, 0, 0, 0, 0};
+    assert(getBestSharedChildUCB1(&raveTree, 0, &raveContention) == siblingChild);
+
+    log_debug("It should count the RAVE score half when the child has as many visits as the equivalence.\n");
+    assert(fabs(getRAVEMean(1.0, 2, 9.0, 10) - (0.5 * (1.0 - sqrtf(1000.0 / 1006.0)) + 0.9 * sqrtf(1000.0 / 1006.0))) < 1e-6);
+    assert(fabs(getRAVEMean(500.0, 1000, 900.0, 1000) - 0.7) < 1e-6);
+    assert(getRAVEMean(0.5, 1, 0.0, 0) == 0.5f);
+    mctsRaveEquivalence = 0;
+    freeMCTSTree(&raveTree);
+
+    log_log("\nTesting progressive widening...\n");
+    log_debug("It should order a node's moves captures first, then safe moves, then sacrifices.\n");
+    mctsProgressiveWidening = true;
+    UnscoredState wideningState;
+    initUnscoredState(&wideningState);
+    const Edge * capturableBoxEdges = getBoxEdges(0);
+    for (short i=0; i < 3; i++)
+        setEdgeTaken(&wideningState, capturableBoxEdges[i]);
+    const Edge * sacrificeBoxEdges = getBoxEdges(NUM_BOXES - 1);
+    setEdgeTaken(&wideningState, sacrificeBoxEdges[0]);
+    setEdgeTaken(&wideningState, sacrificeBoxEdges[1]);
+
+    Edge wideningMoves[NUM_EDGES];
+    float priors[NUM_EDGES];
+    short numWideningMoves = getFreeEdges(&wideningState, wideningMoves);
+    orderMCTSMoves(&wideningState, wideningMoves, priors, numWideningMoves);
+    assert(wideningMoves[0] == capturableBoxEdges[3]);
+    for (short i = numWideningMoves - 2; i < numWideningMoves; i++)
+        assert(wideningMoves[i] == sacrificeBoxEdges[2] || wideningMoves[i] == sacrificeBoxEdges[3]);
+    assert(priors[0] == 2 * priors[1] && priors[1] == 2 * priors[numWideningMoves - 1]);
+    float totalPrior = 0.0;
+    for (short i=0; i < numWideningMoves; i++)
+        totalPrior += priors[i];
+    assert(fabs(totalPrior - 1.0) < 1e-5);
+
+    log_debug("It should only take another child into use once the node's visits pass the next square.\n");
+    MCTSNode wideNode;
+    wideNode.numPotentialMoves = 10;
+    assert(getNumMCTSChildrenAllowed(&wideNode, 0) == 1 && getNumMCTSChildrenAllowed(&wideNode, 1) == 1);
+    assert(getNumMCTSChildrenAllowed(&wideNode, 2) == 2 && getNumMCTSChildrenAllowed(&wideNode, 4) == 2);
+    assert(getNumMCTSChildrenAllowed(&wideNode, 5) == 3 && getNumMCTSChildrenAllowed(&wideNode, 1000) == 10);
+
+    log_debug("It should go below the first child rather than expand a second after one visit.\n");
+    MCTSTree wideTree;
+    initMCTSTree(&wideTree, &wideningState);
+    UnscoredState wideState = wideningState;
+    int captureChild = applyTreePolicy(&wideTree, &wideState);
+    assert(wideTree.nodes[captureChild].move == capturableBoxEdges[3]);
+    backpropagateResult(&wideTree, captureChild, wideTree.nodes[captureChild].nextPlayerToMove, 0.5, 1, NULL);
+    wideState = wideningState;
+    int grandchild = applyTreePolicy(&wideTree, &wideState);
+    assert(wideTree.nodes[0].numChildren == 1 && wideTree.nodes[grandchild].parent == captureChild);
+
+    log_debug("It should prefer the child with the higher prior until the scores tell them apart.\n");
+    int safeChild = addChildToMCTSNode(&wideTree, 0, &wideningState);
+    wideTree.visits[0] = 4;
+    wideTree.visits[captureChild] = wideTree.visits[safeChild] = 2;
+    wideTree.totalScores[captureChild] = wideTree.totalScores[safeChild] = 1.0;
+    assert(getBestChildUCB1(&wideTree, 0) == captureChild);
+    assert(getBestSharedChildUCB1(&wideTree, 0, &raveContention) == captureChild);
+    wideTree.totalScores[safeChild] = 2.0;
+    assert(getBestChildUCB1(&wideTree, 0) == safeChild);
+
+    log_debug("It should give every move the same prior when it is off.\n");
+    mctsProgressiveWidening = false;
+    assert(getNumMCTSChildrenAllowed(&wideNode, 1) == 10);
+    orderMCTSMoves(&wideningState, wideningMoves, priors, numWideningMoves);
+    assert(priors[0] == priors[numWideningMoves - 1]);
+    freeMCTSTree(&wideTree);
 
     log_log("\nTesting getMostVisitedChild...\n");
     log_debug("It should return the most visited child.\n");
-    assert(getMostVisitedChild(rootNode) == firstChild);
+    assert(getMostVisitedChild(&tree, 0) == firstChild);
+
+    log_log("\nTesting getMergedMostVisitedMove...\n");
+    log_debug("It should add up the visits of each root move over the trees.\n");
+    MCTSTree otherTree;
+    initMCTSTree(&otherTree, &rootState);
+    addChildrenToMCTSNode(&otherTree, 0, &rootState);
+    int otherChild = addChildToMCTSNode(&otherTree, 0, &rootState);
+    otherTree.nodes[otherChild].move = tree.nodes[secondChild].move;
+    otherTree.visits[otherChild] = 2;
+    MCTSTree trees[2] = { tree, otherTree };
+    assert(getMergedMostVisitedMove(trees, 1) == tree.nodes[firstChild].move);
+    assert(getMergedMostVisitedMove(trees, 2) == tree.nodes[secondChild].move);
+    freeMCTSTree(&otherTree);
+
+    freeMCTSTree(&terminalTree);
+    freeMCTSTree(&tree);
+
+    log_log("\nTesting applySharedTreePolicy...\n");
+    log_debug("It should add a virtual loss to the root and the new child.\n");
+    MCTSTree sharedTree;
+    MCTSContention contention = {0, 0, 0, 0, 0};
+    initMCTSTree(&sharedTree, &rootState);
+    nodeState = rootState;
+    int sharedChild = applySharedTreePolicy(&sharedTree, &nodeState, &contention);
+    assert(sharedChild == sharedTree.nodes[0].firstChild);
+    assert(sharedTree.nodes[0].numChildren == 1);
+    assert(sharedTree.visits[0] == 1 && sharedTree.visits[sharedChild] == 1);
+    assert(sharedTree.totalScores[sharedChild] == 0.0);
+    assert(isEdgeTaken(&nodeState, sharedTree.nodes[sharedChild].move));
+
+    log_debug("It should set up every reserved child before publishing them.\n");
+    for (int c = sharedChild; c < sharedChild + NUM_EDGES; c++) {
+        assert(sharedTree.nodes[c].parent == 0);
+        assert(sharedTree.nodes[c].numPotentialMoves == NUM_EDGES - 1);
+        assert(sharedTree.visits[c] == (c == sharedChild ? 1 : 0));
+    }
 
-    log_log("\nSaving test tree JSON...\n");
-    // saveMCTSNodeJSON(rootNode, "testTree.json");
+    log_log("\nTesting backpropagateSharedResult...\n");
+    log_debug("It should add the score without adding visits again.\n");
+    backpropagateSharedResult(&sharedTree, sharedChild, sharedTree.nodes[sharedChild].nextPlayerToMove, 0.25, 1, NULL, &contention);
+    assert(sharedTree.visits[0] == 1 && sharedTree.visits[sharedChild] == 1);
+    assert(sharedTree.totalScores[sharedChild] == 0.25f);
+    assert(sharedTree.totalScores[0] == 0.75f);
+
+    log_debug("It should add the visits of the rest of a batch.\n");
+    backpropagateSharedResult(&sharedTree, sharedChild, sharedTree.nodes[sharedChild].nextPlayerToMove, 1.0, 3, NULL, &contention);
+    assert(sharedTree.visits[0] == 3 && sharedTree.visits[sharedChild] == 3);
+    assert(sharedTree.totalScores[sharedChild] == 1.25f && sharedTree.totalScores[0] == 2.75f);
+
+    log_log("\nTesting claimSharedChild...\n");
+    log_debug("It should run out of children once every move is in use.\n");
+    for (short i=1; i < NUM_EDGES; i++)
+        assert(claimSharedChild(&sharedTree, 0, &rootState, &contention) == sharedChild + i);
+    assert(claimSharedChild(&sharedTree, 0, &rootState, &contention) == MCTS_NO_NODE);
+
+    log_debug("It should leave a node unexpanded when the tree is full.\n");
+    sharedTree.numNodes = sharedTree.capacity;
+    UnscoredState sharedChildState = rootState;
+    setEdgeTaken(&sharedChildState, sharedTree.nodes[sharedChild].move);
+    assert(claimSharedChild(&sharedTree, sharedChild, &sharedChildState, &contention) == MCTS_NO_NODE);
+    assert(contention.fullTreeLeaves == 1);
+    assert(contention.claimRetries == 0 && contention.scoreRetries == 0 && contention.expansionCollisions == 0);
+    freeMCTSTree(&sharedTree);
+
+    log_log("\nTesting reuseMCTSTree...\n");
+    MCTSTree reusedTree;
+    initMCTSTree(&reusedTree, &rootState);
+    addChildrenToMCTSNode(&reusedTree, 0, &rootState);
+    addChildToMCTSNode(&reusedTree, 0, &rootState);
+    int ourMove = addChildToMCTSNode(&reusedTree, 0, &rootState);
+    UnscoredState ourMoveState = rootState;
+    setEdgeTaken(&ourMoveState, reusedTree.nodes[ourMove].move);
+    addChildrenToMCTSNode(&reusedTree, ourMove, &ourMoveState);
+    int theirMove = addChildToMCTSNode(&reusedTree, ourMove, &ourMoveState);
+    UnscoredState theirMoveState = ourMoveState;
+    setEdgeTaken(&theirMoveState, reusedTree.nodes[theirMove].move);
+    addChildrenToMCTSNode(&reusedTree, theirMove, &theirMoveState);
+    int nextMove = addChildToMCTSNode(&reusedTree, theirMove, &theirMoveState);
+    reusedTree.visits[theirMove] = 5;
+    reusedTree.totalScores[theirMove] = 2.5;
+    reusedTree.visits[nextMove] = 3;
+    reusedTree.amafVisits[nextMove] = 4;
+    Edge nextMoveEdge = reusedTree.nodes[nextMove].move;
+
+    log_debug("It should leave the tree alone for a position where the opponent is to move.\n");
+    assert(!reuseMCTSTree(&reusedTree, &ourMoveState));
+    assert(reusedTree.numNodes == 1 + NUM_EDGES + (NUM_EDGES - 1) + (NUM_EDGES - 2));
+
+    log_debug("It should leave the tree alone for a position which isn't below its root.\n");
+    UnscoredState otherGameState = theirMoveState;
+    setEdgeFree(&otherGameState, reusedTree.nodes[ourMove].move);
+    assert(!reuseMCTSTree(&reusedTree, &otherGameState));
+
+    log_debug("It should make the node after both moves the root and keep only what is below it.\n");
+    assert(reuseMCTSTree(&reusedTree, &theirMoveState));
+    assert(reusedTree.numNodes == 1 + NUM_EDGES - 2);
+    assert(reusedTree.nodes[0].parent == MCTS_NO_NODE);
+    assert(reusedTree.nodes[0].move == NO_EDGE);
+    assert(reusedTree.nodes[0].playerJustMoved == NO_PLAYER);
+    assert(reusedTree.nodes[0].nextPlayerToMove == 1);
+    assert(reusedTree.nodes[0].numPotentialMoves == NUM_EDGES - 2);
+    assert(reusedTree.visits[0] == 5 && reusedTree.totalScores[0] == 2.5f);
+    assert(reusedTree.nodes[0].firstChild == 1 && reusedTree.nodes[0].numChildren == 1);
+    assert(reusedTree.nodes[1].parent == 0);
+    assert(reusedTree.nodes[1].move == nextMoveEdge);
+    assert(reusedTree.visits[1] == 3 && reusedTree.amafVisits[1] == 4);
+    assert(memcmp(&reusedTree.rootState, &theirMoveState, sizeof(UnscoredState)) == 0);
+
+    log_debug("It should take the rest of the reserved children into use after rerooting.\n");
+    int secondNextMove = addChildToMCTSNode(&reusedTree, 0, &theirMoveState);
+    assert(secondNextMove == 2);
+    assert(reusedTree.nodes[secondNextMove].parent == 0);
+    assert(reusedTree.nodes[secondNextMove].move != nextMoveEdge);
+    assert(!isEdgeTaken(&theirMoveState, reusedTree.nodes[secondNextMove].move));
+    freeMCTSTree(&reusedTree);
+
+    log_debug("It should take off the boxes taken on the way and rescale the scores to the new boxes left.\n");
+    UnscoredState captureRootState = rootState;
+    const Edge * boxEdges = getBoxEdges(0);
+    for (short i=0; i < 3; i++)
+        setEdgeTaken(&captureRootState, boxEdges[i]);
+    initMCTSTree(&reusedTree, &captureRootState);
+    addChildrenToMCTSNode(&reusedTree, 0, &captureRootState);
+    int captureMove;
+    do { // the capture is ordered first, but that isn't what's being tested
+        captureMove = addChildToMCTSNode(&reusedTree, 0, &captureRootState);
+    } while (reusedTree.nodes[captureMove].move != boxEdges[3]);
+    UnscoredState captureState = captureRootState;
+    setEdgeTaken(&captureState, boxEdges[3]);
+    addChildrenToMCTSNode(&reusedTree, captureMove, &captureState);
+    int quietMove = addChildToMCTSNode(&reusedTree, captureMove, &captureState);
+    assert(reusedTree.nodes[captureMove].nextPlayerToMove == 1 && reusedTree.nodes[quietMove].nextPlayerToMove == 2);
+    reusedTree.visits[captureMove] = 4;
+    reusedTree.totalScores[captureMove] = 2.0;
+    reusedTree.visits[quietMove] = 3;
+    reusedTree.totalScores[quietMove] = 1.0;
+    reusedTree.amafVisits[quietMove] = 2;
+    reusedTree.amafScores[quietMove] = 0.5;
+
+    assert(reuseMCTSTree(&reusedTree, &captureState));
+    double scoreScale = NUM_BOXES / (double)(NUM_BOXES - 1);
+    double scoreShift = 1 / (double)(NUM_BOXES - 1); // player 1 took the box, player 2 took nothing
+    assert(fabs(reusedTree.totalScores[0] - (2.0 * scoreScale - 4 * scoreShift)) < 1e-5);
+    assert(fabs(reusedTree.totalScores[1] - 1.0 * scoreScale) < 1e-5);
+    assert(fabs(reusedTree.amafScores[1] - 0.5 * scoreScale) < 1e-5);
+    assert(reusedTree.visits[0] == 4 && reusedTree.visits[1] == 3 && reusedTree.amafVisits[1] == 2);
+    freeMCTSTree(&reusedTree);
+
+    log_log("\nTesting findOrAddMCTSDAGNode...\n");
+    log_debug("It should start a DAG with just the root.\n");
+    MCTSDAG dag;
+    initMCTSDAG(&dag, &rootState);
+    assert(dag.numNodes == 1 && dag.numEdges == 0);
+    assert(dag.nodes[0].firstEdge == MCTS_NO_NODE);
+    assert(dag.nodes[0].numPotentialMoves == NUM_EDGES);
+    assert(dag.nodes[0].numBoxesLeft == NUM_BOXES);
+
+    log_debug("It should find the same node for a position reached in another order.\n");
+    Bitboard firstOrder = {0, 0};
+    setBitboardEdgeTaken(&firstOrder, 0);
+    setBitboardEdgeTaken(&firstOrder, 70);
+    int transposedNode = findOrAddMCTSDAGNode(&dag, &firstOrder);
+    Bitboard secondOrder = {0, 0};
+    setBitboardEdgeTaken(&secondOrder, 70);
+    setBitboardEdgeTaken(&secondOrder, 0);
+    assert(findOrAddMCTSDAGNode(&dag, &secondOrder) == transposedNode);
+    assert(dag.numNodes == 2);
+
+    log_debug("It should keep finding every node once the table has grown.\n");
+    int tableSize = dag.tableSize;
+    for (int i=0; i < MCTS_DAG_INITIAL_NODES; i++) {
+        Bitboard board = { (unsigned long long)i << 20, 1 };
+        assert(findOrAddMCTSDAGNode(&dag, &board) == i + 2);
+    }
+    assert(dag.tableSize > tableSize);
+    for (int i=0; i < MCTS_DAG_INITIAL_NODES; i++) {
+        Bitboard board = { (unsigned long long)i << 20, 1 };
+        assert(findOrAddMCTSDAGNode(&dag, &board) == i + 2);
+    }
+    assert(findOrAddMCTSDAGNode(&dag, &firstOrder) == transposedNode);
+    resetMCTSDAG(&dag, &rootState);
+    assert(dag.numNodes == 1);
+
+    log_log("\nTesting expandMCTSDAGNode...\n");
+    log_debug("It should lead two move orders into the same node.\n");
+    addEdgesToMCTSDAGNode(&dag, 0);
+    assert(dag.numEdges == NUM_EDGES);
+    dag.edges[0].move = 0;
+    dag.edges[1].move = 70;
+    int firstEdge = expandMCTSDAGNode(&dag, 0);
+    int secondEdge = expandMCTSDAGNode(&dag, 0);
+    assert(firstEdge == 0 && secondEdge == 1 && dag.nodes[0].numEdges == 2);
+    int firstMoveNode = dag.edges[firstEdge].child;
+    int secondMoveNode = dag.edges[secondEdge].child;
+    assert(firstMoveNode != secondMoveNode && dag.nodes[firstMoveNode].numPotentialMoves == NUM_EDGES - 1);
+
+    addEdgesToMCTSDAGNode(&dag, firstMoveNode);
+    dag.edges[dag.nodes[firstMoveNode].firstEdge].move = 70;
+    int bothMovesEdge = expandMCTSDAGNode(&dag, firstMoveNode);
+    addEdgesToMCTSDAGNode(&dag, secondMoveNode);
+    dag.edges[dag.nodes[secondMoveNode].firstEdge].move = 0;
+    int otherBothMovesEdge = expandMCTSDAGNode(&dag, secondMoveNode);
+    int bothMovesNode = dag.edges[bothMovesEdge].child;
+    assert(dag.edges[otherBothMovesEdge].child == bothMovesNode);
+    assert(dag.numNodes == 4 && dag.numTranspositions == 1);
+
+    log_log("\nTesting backpropagateMCTSDAGResult...\n");
+    log_debug("It should score each node for its player to move, whichever path the result came up.\n");
+    int pathNodes[NUM_EDGES + 1] = { 0, firstMoveNode, bothMovesNode };
+    int pathEdges[NUM_EDGES] = { firstEdge, bothMovesEdge };
+    backpropagateMCTSDAGResult(&dag, pathNodes, pathEdges, 2, 10, 1);
+    assert(dag.nodes[bothMovesNode].visits == 1 && dag.nodes[firstMoveNode].visits == 1 && dag.nodes[0].visits == 1);
+    assert(fabs(dag.nodes[bothMovesNode].totalScore - 10.0 / NUM_BOXES) < 1e-6);
+    assert(fabs(dag.nodes[firstMoveNode].totalScore - (NUM_BOXES - 10.0) / NUM_BOXES) < 1e-6);
+    assert(fabs(dag.nodes[0].totalScore - 10.0 / NUM_BOXES) < 1e-6);
+    assert(dag.edges[firstEdge].visits == 1 && dag.edges[bothMovesEdge].visits == 1);
+    assert(dag.edges[otherBothMovesEdge].visits == 0);
+
+    log_debug("It should value an edge by the node it leads to.\n");
+    pathNodes[1] = secondMoveNode;
+    pathEdges[0] = secondEdge;
+    pathEdges[1] = otherBothMovesEdge;
+    backpropagateMCTSDAGResult(&dag, pathNodes, pathEdges, 2, 20, 1);
+    assert(dag.nodes[bothMovesNode].visits == 2);
+    assert(fabs(getMCTSDAGEdgeValue(&dag, firstMoveNode, bothMovesEdge) - (NUM_BOXES - 15.0) / NUM_BOXES) < 1e-6);
+    assert(fabs(getMCTSDAGEdgeValue(&dag, secondMoveNode, otherBothMovesEdge) - (NUM_BOXES - 15.0) / NUM_BOXES) < 1e-6);
+    assert(dag.edges[bothMovesEdge].visits == 1 && dag.edges[otherBothMovesEdge].visits == 1);
+
+    log_debug("It should keep the turn and count the boxes of a move which completes them.\n");
+    MCTSDAG almostFullDAG;
+    initMCTSDAG(&almostFullDAG, &almostFullState);
+    int lastEdge = expandMCTSDAGNode(&almostFullDAG, 0);
+    assert(almostFullDAG.edges[lastEdge].move == 71 && almostFullDAG.edges[lastEdge].numBoxesTakenByMove == 1);
+    int lastNode = almostFullDAG.edges[lastEdge].child;
+    assert(almostFullDAG.nodes[lastNode].numPotentialMoves == 0 && almostFullDAG.nodes[lastNode].numBoxesLeft == 0);
+    pathNodes[0] = 0;
+    pathNodes[1] = lastNode;
+    pathEdges[0] = lastEdge;
+    backpropagateMCTSDAGResult(&almostFullDAG, pathNodes, pathEdges, 1, 0, 1);
+    assert(almostFullDAG.nodes[0].totalScore == 1.0f);
+    assert(getMCTSDAGEdgeValue(&almostFullDAG, 0, lastEdge) == 1.0f);
+
+    log_debug("It should count the boxes of the move once for each playout of a batch.\n");
+    backpropagateMCTSDAGResult(&almostFullDAG, pathNodes, pathEdges, 1, 0, 8);
+    assert(almostFullDAG.nodes[0].visits == 9 && almostFullDAG.nodes[0].totalScore == 9.0f);
+    assert(almostFullDAG.edges[lastEdge].visits == 9);
+    freeMCTSDAG(&almostFullDAG);
+    freeMCTSDAG(&dag);
 
     log_log("\nTesting getMCTSMove...\n");
-    log_debug("It should return a sensible result. (Saving JSON)\n");
+    log_debug("It should return a sensible result. (Saving the tree)\n");
     UnscoredState emptyState;
     initUnscoredState(&emptyState);
-    Edge move = getMCTSMove(&emptyState, 1000, true);
+    TreeWriterSettings defaultTreeSettings = mctsTreeSettings;
+    mctsTreeSettings.filePath = "/tmp/deepbox_test_mcts_tree.json";
+    Edge move = getMCTSMove(&emptyState, 1000, 1, false, false, true);
+    assert(move >= 0 && move < NUM_EDGES);
+
+    log_debug("It should write the root first when saving the tree.\n");
+    FILE * treeFile = fopen(mctsTreeSettings.filePath, "r");
+    assert(treeFile != NULL);
+    char line[256];
+    assert(fgets(line, sizeof(line), treeFile) != NULL && strstr(line, "\"search\":\"monte_carlo\"") != NULL);
+    assert(fgets(line, sizeof(line), treeFile) != NULL && strstr(line, "{\"id\":0,\"parent\":-1,") == line);
+    fclose(treeFile);
+    remove(mctsTreeSettings.filePath);
+    mctsTreeSettings = defaultTreeSettings;
+
+    log_debug("It should carry on from the last tree when searching the same position again.\n");
+    move = getMCTSMove(&emptyState, 200, 1, false, false, false);
+    assert(move >= 0 && move < NUM_EDGES);
+    assert(mctsTrees[0].nodes[0].move == NO_EDGE && mctsTrees[0].visits[0] > 0);
+
+    log_debug("It should return a sensible result with several threads.\n");
+    move = getMCTSMove(&emptyState, 500, 4, false, false, false);
+    assert(move >= 0 && move < NUM_EDGES);
+
+    log_debug("It should return a sensible result with several threads sharing a tree.\n");
+    move = getMCTSMove(&emptyState, 500, 4, true, false, false);
+    assert(move >= 0 && move < NUM_EDGES);
+
+    log_debug("It should return a sensible result with RAVE, with a tree each or sharing one.\n");
+    mctsRaveEquivalence = 1000;
+    move = getMCTSMove(&emptyState, 500, 1, false, false, false);
+    assert(move >= 0 && move < NUM_EDGES);
+    move = getMCTSMove(&emptyState, 500, 4, true, false, false);
     assert(move >= 0 && move < NUM_EDGES);
+    mctsRaveEquivalence = 0;
 
-    freeMCTSNode(terminalNode);
-    freeMCTSNode(rootNode);
+    log_debug("It should return a sensible result with progressive widening, with a tree each or sharing one.\n");
+    mctsProgressiveWidening = true;
+    move = getMCTSMove(&emptyState, 500, 1, false, false, false);
+    assert(move >= 0 && move < NUM_EDGES);
+    move = getMCTSMove(&emptyState, 500, 4, true, false, false);
+    assert(move >= 0 && move < NUM_EDGES);
+    mctsProgressiveWidening = false;
+
+    log_debug("It should return a sensible result playing out leaves in batches, in a tree, a shared tree or a DAG.\n");
+    mctsPlayoutBatchSize = 16;
+    move = getMCTSMove(&emptyState, 500, 1, false, false, false);
+    assert(move >= 0 && move < NUM_EDGES);
+    move = getMCTSMove(&emptyState, 500, 4, true, false, false);
+    assert(move >= 0 && move < NUM_EDGES);
+    move = getMCTSMove(&emptyState, 500, 1, false, true, false);
+    assert(move >= 0 && move < NUM_EDGES);
+    mctsPlayoutBatchSize = 1;
+
+    log_debug("It should return a sensible result with transpositions merged.\n");
+    move = getMCTSMove(&emptyState, 500, 1, false, true, false);
+    assert(move >= 0 && move < NUM_EDGES);
+    assert(mctsDAGs[0].numTranspositions > 0);
+    move = getMCTSMove(&emptyState, 500, 4, false, true, false);
+    assert(move >= 0 && move < NUM_EDGES);
 
     log_log("MCTS TESTS COMPLETED\n\n");
 }
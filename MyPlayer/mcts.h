@@ -1,30 +1,99 @@
 #ifndef MCTS_H
 #define MCTS_H
 
-#include "graphs.h"
+#include "game_board.h"
+#include "bitboard.h"
+#include "treewriter.h"
 
-typedef struct MCTSNode { 
-    struct MCTSNode * parent;
-    struct MCTSNode * child;
-    struct MCTSNode * sibling;
+#define MCTS_NO_NODE -1
+#define MCTS_MAX_THREADS 64
+#define MCTS_MAX_PLAYOUT_BATCH 256
+
+// A node is kept to 16 bytes so that many fit in the cache. Nodes don't store their state: it is
+// replayed from the root along the moves of the selection path. The children of a node are a
+// contiguous range of the tree's nodes, laid out with every move in random order the first time
+// the node is expanded and then taken into use one at a time. With progressive widening the moves
+// are laid out best prior first instead, and taken into use as the node's visits grow.
+// A node's visits and score live in arrays next to the nodes, so that UCB1 can sweep a whole range
+// of children at once.
+typedef struct MCTSNode {
+    int parent;        // index into the tree's nodes, MCTS_NO_NODE for the root
+    int firstChild;    // index of the first of numPotentialMoves children, MCTS_NO_NODE until expanded
 
     Edge move;
-    short numBoxesTakenByMove;
-    UnscoredState state; // the post-move state
-    SCGraph graph;
-    PlayerNum playerJustMoved;
-    PlayerNum nextPlayerToMove;
+    unsigned char numChildren; // children taken into use so far
+    unsigned char numPotentialMoves;
+    unsigned char numBoxesTakenByMove;
+    unsigned char playerJustMoved;
+    unsigned char nextPlayerToMove;
+} MCTSNode;
 
-    double totalScore; // from perspective of playerJustMoved
+typedef struct MCTSTree {
+    MCTSNode * nodes; // grows as needed, so nodes refer to each other by index
+    double * totalScores; // by node, from perspective of playerJustMoved
+    int * visits;        // by node
+    double * amafScores; // by node, for RAVE: the scores of every iteration through the node's parent in
+    int * amafVisits;    // which the player to move there made the node's move then or later on
+    float * priors;      // by node, how promising its move looked to its parent, summing to 1 over the children
+    int numNodes;
+    int capacity;
+    UnscoredState rootState;
+} MCTSTree;
+
+// With transpositions merged the search is a DAG: a position has one node however it was reached,
+// found from its board through a hash table. What happens from a position on doesn't depend on the
+// moves that led to it, so a node's score is the share of its boxes left taken by whoever is to move
+// there. An edge keeps its own visits, which UCB1 explores by, while its value is read from the
+// node it leads to, so every move order into a position learns from the others.
+typedef struct MCTSDAGEdge {
+    int child; // index into the DAG's nodes, MCTS_NO_NODE until the edge is taken into use
     int visits;
+    Edge move;
+    unsigned char numBoxesTakenByMove;
+} MCTSDAGEdge;
 
-    Edge potentialMoves[NUM_EDGES];
-    short nextUntriedMoveIndex;
-    short numPotentialMoves;
-    short numChildren;
-} MCTSNode;
+typedef struct MCTSDAGNode {
+    Bitboard board;
+    int firstEdge; // index of the first of numPotentialMoves edges, MCTS_NO_NODE until expanded
+    int visits;    // through any of the edges into the node
+    double totalScore;
+    unsigned char numEdges; // edges taken into use so far
+    unsigned char numPotentialMoves;
+    unsigned char numBoxesLeft;
+} MCTSDAGNode;
+
+typedef struct MCTSDAG {
+    MCTSDAGNode * nodes; // the root is node 0
+    MCTSDAGEdge * edges; // the edges of a node are a contiguous range, laid out as a tree's children are
+    int * table;         // node indices by board hash, MCTS_NO_NODE for an empty slot
+    int numNodes;
+    int nodeCapacity;
+    int numEdges;
+    int edgeCapacity;
+    int tableSize; // a power of 2, kept to at least twice numNodes
+    int numTranspositions; // edges taken into use which led to a node already in the DAG
+    UnscoredState rootState;
+} MCTSDAG;
+
+// Counts how often threads searching one tree got in each other's way.
+typedef struct MCTSContention {
+    int claimRetries;        // another thread took the same child into use first
+    int scoreRetries;        // another thread changed a score while it was being added to
+    int expansionCollisions; // another thread published a node's children first
+    int unvisitedChildren;   // children skipped by selection as their first visit wasn't added yet
+    int fullTreeLeaves;      // leaves which couldn't be expanded because the tree was full
+} MCTSContention;
+
+extern TreeWriterSettings mctsTreeSettings; // where and how much of the tree getMCTSMove saves
+extern float mctsRaveEquivalence; // visits at which a child's own score and its RAVE score count the same, 0 for no RAVE
+extern bool mctsProgressiveWidening; // whether nodes take children into use by prior as they are visited, chosen by PUCT
+extern short mctsPlayoutBatchSize; // playouts run from each leaf, whose results are backed up together
+extern bool mctsGreedyPlayouts; // whether playouts take every capture offered rather than moving uniformly at random
 
-Edge getMCTSMove(UnscoredState * rootState, int runTimeMillis, bool saveTreeJSON);
+void addSharedMCTSScore(float * totalScore, float score, MCTSContention * contention);
+void addMCTSContention(MCTSContention * total, const MCTSContention * contention);
+void logMCTSContention(const MCTSContention * contention, int iterationCount);
+Edge getMCTSMove(UnscoredState * rootState, int runTimeMillis, short numThreads, bool shareTree, bool mergeTranspositions, bool saveTreeJSON);
 void runMCTSTests();
 
 #endif
@@ -21,6 +21,13 @@
 #include "player_strategy.h"
 #include "mcts.h"
 #include "alphabeta.h"
+#include "arena.h"
+#include "bitboard.h"
+#include "tablebase.h"
+#include "proofnumber.h"
+#include "endgame.h"
+#include "treewriter.h"
+#include "ucb.h"
 #include "util.h"
 
 #define ACKNOWLEDGED "ACK"
@@ -109,9 +116,21 @@ int main(int argc, char ** argv) {
     Strategy strategy = RANDOM_MOVE;
     int turnTimeMillis = 1000;
     bool runningExamplePosition = false; // if -x flag is given then a position is expected on standard input.
+    char * tablebasePath = NULL; // endgame tablebase written by bin/tbgen
+    unsigned long long randomSeed = getTimeMicros(); // -r or --seed to repeat a run
+
+    static const struct option longOptions[] = {
+        {"seed", required_argument, NULL, 'r'},
+        {"rave", required_argument, NULL, 'k'},
+        {"widen", no_argument, NULL, 'u'},
+        {"batch", required_argument, NULL, 'b'},
+        {"greedy", no_argument, NULL, 'g'},
+        {"selective", no_argument, NULL, 'c'},
+        {NULL, 0, NULL, 0}
+    };
 
     int option;
-    while((option = getopt(argc, argv, "l:a:p:ts:i:x")) != -1) {
+    while((option = getopt_long(argc, argv, "l:a:p:ts:i:xe:j:wn:m:r:dk:ub:gc", longOptions, NULL)) != -1) {
         switch(option) {
             case 'l':
                 if(strcmp("debug", optarg) == 0)
@@ -151,8 +170,10 @@ int main(int argc, char ** argv) {
                     strategy = GRAPHS;
                 else if(strcmp("deepbox", strategyName) == 0)
                     strategy = DEEPBOX;
+                else if(strcmp("proof_number", strategyName) == 0)
+                    strategy = PROOF_NUMBER;
                 else
-                    fprintf(stderr, "Unrecognised strategy name: %s. Available options are {random_move, first_box_completing_move, monte_carlo, alpha_beta, graphs, deepbox}.\n", strategyName);
+                    fprintf(stderr, "Unrecognised strategy name: %s. Available options are {random_move, first_box_completing_move, monte_carlo, alpha_beta, graphs, deepbox, proof_number}.\n", strategyName);
 
                 break;
             case 'i':
@@ -161,23 +182,102 @@ int main(int argc, char ** argv) {
             case 'x':
                 runningExamplePosition = true;
                 break;
+            case 'e':
+                tablebasePath = optarg;
+                break;
+            case 'j':
+                abStatsPath = optarg;
+                break;
+            case 'w':
+                saveSearchTrees = true;
+                break;
+            case 'n':
+                numSearchThreads = atoi(optarg);
+                if (numSearchThreads < 1 || numSearchThreads > MCTS_MAX_THREADS) {
+                    fprintf(stderr, "Number of search threads must be between 1 and %d. Using 1.\n", MCTS_MAX_THREADS);
+                    numSearchThreads = 1;
+                }
+                break;
+            case 'm':
+                if(strcmp("root", optarg) == 0)
+                    shareSearchTree = false;
+                else if(strcmp("tree", optarg) == 0)
+                    shareSearchTree = true;
+                else
+                    fprintf(stderr, "Unrecognised parallelisation: %s. Available options are {root, tree}.\n", optarg);
+                break;
+            case 'r':
+                randomSeed = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                mergeTranspositions = true;
+                break;
+            case 'k':
+                mctsRaveEquivalence = atof(optarg);
+                if (mctsRaveEquivalence < 0) {
+                    fprintf(stderr, "RAVE equivalence can't be negative. Using 0, which turns RAVE off.\n");
+                    mctsRaveEquivalence = 0;
+                }
+                break;
+            case 'u':
+                mctsProgressiveWidening = true;
+                break;
+            case 'b':
+                mctsPlayoutBatchSize = atoi(optarg);
+                if (mctsPlayoutBatchSize < 1 || mctsPlayoutBatchSize > MCTS_MAX_PLAYOUT_BATCH) {
+                    fprintf(stderr, "Playouts per leaf must be between 1 and %d. Using 1.\n", MCTS_MAX_PLAYOUT_BATCH);
+                    mctsPlayoutBatchSize = 1;
+                }
+                break;
+            case 'g':
+                mctsGreedyPlayouts = true;
+                break;
+            case 'c':
+                abSelectiveSettings.isLMREnabled = true;
+                abSelectiveSettings.isProbCutEnabled = true;
+                break;
         }
     }
 
+    if (mctsPlayoutBatchSize > 1 && (mctsRaveEquivalence > 0 || mctsGreedyPlayouts)) {
+        fprintf(stderr, "Playouts per leaf can't go above 1 with %s, which plays out one playout at a time. Exiting.\n",
+            mctsRaveEquivalence > 0 ? "RAVE (-k)" : "greedy playouts (-g)");
+        exit(1);
+    }
+
     log_log("Server address: %s\n", server_address);
     log_log("Server port: %s\n", server_port);
     log_log("Using strategy: %s\n", strategyName);
     log_log("Time per turn (millis): %d.\n", turnTimeMillis);
+    log_log("Search threads: %d, %s%s.\n", numSearchThreads, shareSearchTree ? "sharing one tree" : "a tree each",
+        mergeTranspositions ? ", merging transpositions" : "");
+    log_log("RAVE equivalence: %G.\n", mctsRaveEquivalence);
+    log_log("Progressive widening: %s.\n", mctsProgressiveWidening ? "on" : "off");
+    log_log("Playouts per leaf: %d.\n", mctsPlayoutBatchSize);
+    log_log("Playouts: %s.\n", mctsGreedyPlayouts ? "greedy" : "random");
+    log_log("Alpha-beta LMR and ProbCut: %s.\n", abSelectiveSettings.isLMREnabled ? "on" : "off");
+    if (saveSearchTrees && strategy != MONTE_CARLO && strategy != ALPHA_BETA && strategy != DEEPBOX)
+        log_warn("Only the alpha-beta and monte carlo strategies save their search trees. %s won't write any.\n", strategyName);
+    log_log("Random seed: %llu\n", randomSeed);
+    seedRandom(randomSeed);
+
+    if (tablebasePath != NULL && !loadTablebase(tablebasePath))
+        fprintf(stderr, "Could not load tablebase: %s. Continuing without it.\n", tablebasePath);
 
     if (run_tests) {
-        /*
         runGameBoardTests();
         runPlayerClientsideTests();
         runPlayerStrategyTests();
         runUtilTests();
         runMCTSTests();
         runAlphaBetaTests();
-        */
+        runBitboardTests();
+        runTablebaseTests();
+        runProofNumberTests();
+        runArenaTests();
+        runEndgameTests();
+        runTreeWriterTests();
+        runUCBTests();
         runGraphsTests();
         
         exit(0);
@@ -193,7 +293,15 @@ int main(int argc, char ** argv) {
         stringToUnscoredState(&state, stateBuf);
         log_log("Considering example board:\n");
         printUnscoredState(&state);
-        Edge move = chooseMove(state, strategy, turnTimeMillis);
+
+        // Who took the boxes already on the board isn't known, so call it level.
+        ScoredState scoredState;
+        initScoredState(&scoredState);
+        updateScoredState(&scoredState, &state, 1);
+        scoredState.score_p2 = scoredState.score_p1 - scoredState.score_p1 / 2;
+        scoredState.score_p1 /= 2;
+
+        Edge move = chooseMove(scoredState, strategy, turnTimeMillis);
 
         log_log("CHOSE MOVE: %d\n", move);
 
@@ -250,6 +358,8 @@ int main(int argc, char ** argv) {
     // 4a. SERVER: newGame    ME: ack # then back to 3 
     // 4b. SERVER: gameOver   ME: ack # then exit
     bool game_over = false;
+    ScoredState game; // score_p1 is ours, score_p2 the opponent's
+    initScoredState(&game);
     while(!game_over) {
         bzero(recv_buf, sizeof(char)*BUFSIZE);
         bzero(cmd_buf, sizeof(char)*100);
@@ -278,14 +388,24 @@ int main(int argc, char ** argv) {
             else if (strcmp(cmd_buf, "newGame") == 0) {
                 log_log("Recognized message 'newGame'. Sending ack.\n");
                 sprintf(send_buf, ACKNOWLEDGED);
-                // TODO: Init newGame object
+                initScoredState(&game);
             }
             else if (strcmp(cmd_buf, "chooseMove") == 0) {
                 log_log("Recognized message 'chooseMove'.\n");
                 UnscoredState state;
                 stringToUnscoredState(&state, data_buf);
-                Edge move = chooseMove(state, strategy, turnTimeMillis);
+
+                // Any boxes completed since our last move were completed by the opponent.
+                updateScoredState(&game, &state, 2);
+                log_log("Score: %d - %d\n", game.score_p1, game.score_p2);
+
+                Edge move = chooseMove(game, strategy, turnTimeMillis);
                 sprintf(send_buf, "%d", move);
+
+                if (move != NO_EDGE) {
+                    setEdgeTaken(&state, move);
+                    updateScoredState(&game, &state, 1);
+                }
             }
             else if (strcmp(cmd_buf, "gameOver") == 0) {
                 log_log("GAME IS OVER. Result: %s\n", data_buf);
@@ -7,8 +7,16 @@
 #include "mcts.h"
 #include "graphs.h"
 #include "alphabeta.h"
+#include "tablebase.h"
+#include "proofnumber.h"
+#include "endgame.h"
 #include "util.h"
 
+bool saveSearchTrees = false;
+short numSearchThreads = 1;
+bool shareSearchTree = false;
+bool mergeTranspositions = false;
+
 Edge getRandomMove(UnscoredState * state) {
     Edge freeEdges[NUM_EDGES];
     short numFreeEdges = getFreeEdges(state, freeEdges);
@@ -39,7 +47,7 @@ Edge getFirstBoxCompletingMove(UnscoredState * state) {
 }
 
 Edge getGMCTSMove(const UnscoredState * state, int runTimeMillis) {
-    Edge move = getGraphsMonteCarloMove(state, runTimeMillis);
+    Edge move = getGraphsMonteCarloMove(state, runTimeMillis, numSearchThreads, shareSearchTree);
 
     if (isEdgeTaken(state, move)) { // fix graph representation not knowing about corners
         log_log("getGMCTSMove: Converting taken corner edge %d to its corresponding corner edge.\n", move);
@@ -90,14 +98,22 @@ Edge getMoveAlways4Never3(UnscoredState * state) {
     }
 }
 
-Edge getDeepBoxMove(UnscoredState * state, int turnTimeMillis) {
+Edge getDeepBoxMove(const ScoredState * scoredState, int turnTimeMillis) {
     Edge moveChoice;
 
+    UnscoredState unscoredState;
+    scoredStateToUnscoredState(&unscoredState, scoredState);
+    UnscoredState * state = &unscoredState;
+
     short numEdgesLeft = getNumFreeEdges(state);
     if (numEdgesLeft > 37) {
         log_log("Using always4never3 strategy...\n");
         moveChoice = getMoveAlways4Never3(state);
     }
+    else if (numEdgesLeft <= ENDGAME_MAX_FREE_EDGES) {
+        log_log("Solving the endgame exactly...\n");
+        moveChoice = getEndgameMove(state);
+    }
     else {
         log_log("Looking for urgent moves...\n");
         SCGraph graph;
@@ -113,7 +129,7 @@ Edge getDeepBoxMove(UnscoredState * state, int turnTimeMillis) {
         }
         else {
             log_log("Didn't find one. Using alpha-beta strategy...\n");
-            moveChoice = getABMove(state, 7 + 10-(int)numEdgesLeft/3.0, false);
+            moveChoice = getABMove(scoredState, 7 + 10-(int)numEdgesLeft/3.0, saveSearchTrees);
         }
     }
 
@@ -139,43 +155,80 @@ Edge getGraphsMove(UnscoredState * state) {
     return potentialMoves[0];
 }
 
-Edge chooseMove(UnscoredState state, Strategy strategy, int turnTimeMillis) {
-    assert(turnTimeMillis > 0);
+Edge getThresholdMove(const ScoredState * scoredState, int turnTimeMillis) {
+    // Asks whether the player to move can finish with more than half of the boxes,
+    // and settles for a draw if it can't.
+    UnscoredState state;
+    scoredStateToUnscoredState(&state, scoredState);
 
-    Edge moveChoice = NO_EDGE;
+    if (isScoredStateDecided(scoredState)) // nothing left to prove, so aim for most of what's left
+        return getPNMove(&state, getNumBoxesLeft(&state) / 2 + 1, turnTimeMillis);
 
     unsigned long long startTime = getTimeMillis();
+    Edge move;
+    ProofResult result = getProofResult(&state, WINNING_SCORE - scoredState->score_p1, turnTimeMillis, &move);
+
+    int timeLeft = turnTimeMillis - (int)(getTimeMillis() - startTime);
+    if (result == PROOF_DISPROVEN && NUM_BOXES % 2 == 0 && timeLeft > 0) {
+        Edge drawingMove;
+        if (getProofResult(&state, NUM_BOXES / 2 - scoredState->score_p1, timeLeft, &drawingMove) == PROOF_PROVEN)
+            move = drawingMove;
+    }
+
+    return move;
+}
 
-    switch(strategy) {
-        case RANDOM_MOVE:
-            moveChoice =  getRandomMove(&state);
-            break;
-        case FIRST_BOX_COMPLETING_MOVE:
-            {
-            Edge move = getFirstBoxCompletingMove(&state);
+Edge chooseMove(ScoredState scoredState, Strategy strategy, int turnTimeMillis) {
+    // score_p1 of scoredState belongs to the player to move.
+    assert(turnTimeMillis > 0);
 
-            if (move != NO_EDGE)
-                moveChoice = move;
-            else
-                moveChoice = getRandomMove(&state);
+    Edge moveChoice = NO_EDGE;
 
-            }
-            break;
-        case MONTE_CARLO:
-            moveChoice = getMCTSMove(&state, turnTimeMillis, false);
-            break;
-        case GMCTS:
-            moveChoice = getGMCTSMove(&state, turnTimeMillis);
-            break;
-        case ALPHA_BETA:
-            moveChoice = getABMove(&state, 7, false);
-            break;
-        case GRAPHS:
-            moveChoice = getGraphsMove(&state);
-            break;
-        case DEEPBOX:
-            moveChoice = getDeepBoxMove(&state, turnTimeMillis);
-            break;
+    UnscoredState state;
+    scoredStateToUnscoredState(&state, &scoredState);
+
+    unsigned long long startTime = getTimeMillis();
+
+    // Positions covered by the tablebase are answered straight away by the search strategies.
+    // The random and first box completing strategies are kept as they are for comparison.
+    if (strategy != RANDOM_MOVE && strategy != FIRST_BOX_COMPLETING_MOVE)
+        moveChoice = getTablebaseMove(&state);
+
+    if (moveChoice == NO_EDGE) {
+        switch(strategy) {
+            case RANDOM_MOVE:
+                moveChoice =  getRandomMove(&state);
+                break;
+            case FIRST_BOX_COMPLETING_MOVE:
+                {
+                Edge move = getFirstBoxCompletingMove(&state);
+
+                if (move != NO_EDGE)
+                    moveChoice = move;
+                else
+                    moveChoice = getRandomMove(&state);
+
+                }
+                break;
+            case MONTE_CARLO:
+                moveChoice = getMCTSMove(&state, turnTimeMillis, numSearchThreads, shareSearchTree, mergeTranspositions, saveSearchTrees);
+                break;
+            case GMCTS:
+                moveChoice = getGMCTSMove(&state, turnTimeMillis);
+                break;
+            case ALPHA_BETA:
+                moveChoice = getABMove(&scoredState, 7, saveSearchTrees);
+                break;
+            case GRAPHS:
+                moveChoice = getGraphsMove(&state);
+                break;
+            case DEEPBOX:
+                moveChoice = getDeepBoxMove(&scoredState, turnTimeMillis);
+                break;
+            case PROOF_NUMBER:
+                moveChoice = getThresholdMove(&scoredState, turnTimeMillis);
+                break;
+        }
     }
 
     unsigned long long endTime = getTimeMillis();
@@ -8,13 +8,20 @@ typedef enum {
     GMCTS,
     ALPHA_BETA,
     GRAPHS,
-    DEEPBOX
+    DEEPBOX,
+    PROOF_NUMBER
 } Strategy;
 
+extern bool saveSearchTrees; // the alpha-beta and monte carlo strategies write their trees for TreeViz
+extern short numSearchThreads; // the monte carlo strategies run this many searches at once
+extern bool shareSearchTree; // whether those searches share one tree rather than having one each
+extern bool mergeTranspositions; // whether monte carlo searches a DAG with one node per position
+
 Edge getRandomMove(UnscoredState *);
 Edge getRandomMoveFromList(Edge * edges, short numEdges);
 Edge getFirstBoxCompletingMove(UnscoredState *);
-Edge chooseMove(UnscoredState, Strategy, int);
+Edge getThresholdMove(const ScoredState *, int);
+Edge chooseMove(ScoredState, Strategy, int);
 void runPlayerStrategyTests();
 
 #endif
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "game_board.h"
+#include "util.h"
+#include "graphs.h"
+#include "bitboard.h"
+#include "tablebase.h"
+#include "arena.h"
+#include "proofnumber.h"
+
+// Depth-first proof-number search (df-pn) answering "can the side to move get at least
+// target of the remaining boxes?". The player trying to prove it is the OR player.
+#define PN_INFINITY 100000000
+#define PN_TABLE_SIZE (1 << 17) // must be a power of 2
+
+typedef struct PNNode {
+    Bitboard board;
+    short need; // how many more boxes the OR player needs
+    bool isOr;  // true when the OR player is to move
+} PNNode;
+
+typedef struct PNEntry {
+    Bitboard board;
+    unsigned int proof;
+    unsigned int disproof;
+    short need;
+    bool isOr;
+    bool isValid;
+} PNEntry;
+
+typedef struct PNSearch {
+    unsigned long long endTime;
+    int nodesVisited;
+    int tableHits;
+    bool isOutOfTime;
+} PNSearch;
+
+// Bounded transposition table, newer entries simply replace older ones in the same slot.
+// Proof and disproof numbers don't depend on the root, so the table is kept between searches.
+static PNEntry pnTable[PN_TABLE_SIZE];
+
+// Move generation builds its graphs here and gives the memory straight back.
+static Arena pnArena;
+
+static PNEntry * getPNEntry(const PNNode * node) {
+    unsigned long long hash = getBitboardHash(&node->board) ^ ((unsigned long long)node->need * 0x9E3779B97F4A7C15ULL) ^ node->isOr;
+    return &pnTable[hash & (PN_TABLE_SIZE - 1)];
+}
+
+static bool isPNEntryForNode(const PNEntry * entry, const PNNode * node) {
+    return entry->isValid &&
+        entry->board.lo == node->board.lo && entry->board.hi == node->board.hi &&
+        entry->need == node->need && entry->isOr == node->isOr;
+}
+
+static bool getPNTerminalValue(const PNNode * node, bool * isProven) {
+    // Returns true when the node's outcome is known without searching it.
+    if (node->need <= 0) {
+        *isProven = true;
+        return true;
+    }
+
+    short boxesLeft = getBitboardNumBoxesLeft(&node->board);
+    if (node->need > boxesLeft) {
+        *isProven = false;
+        return true;
+    }
+
+    short netScore;
+    if (probeTablebase(&node->board, &netScore)) {
+        short moverBoxes = (boxesLeft + netScore) / 2;
+        short orBoxes = node->isOr ? moverBoxes : boxesLeft - moverBoxes;
+        *isProven = orBoxes >= node->need;
+        return true;
+    }
+
+    return false;
+}
+
+static void lookupPN(PNSearch * search, const PNNode * node, unsigned int * proof, unsigned int * disproof) {
+    bool isProven;
+    if (getPNTerminalValue(node, &isProven)) {
+        *proof = isProven ? 0 : PN_INFINITY;
+        *disproof = isProven ? PN_INFINITY : 0;
+        return;
+    }
+
+    const PNEntry * entry = getPNEntry(node);
+    if (isPNEntryForNode(entry, node)) {
+        search->tableHits++;
+        *proof = entry->proof;
+        *disproof = entry->disproof;
+    }
+    else {
+        *proof = 1;
+        *disproof = 1;
+    }
+}
+
+static void storePN(const PNNode * node, unsigned int proof, unsigned int disproof) {
+    PNEntry * entry = getPNEntry(node);
+    entry->board = node->board;
+    entry->need = node->need;
+    entry->isOr = node->isOr;
+    entry->proof = proof;
+    entry->disproof = disproof;
+    entry->isValid = true;
+}
+
+static short getPNChildren(const PNNode * node, PNNode * children, Edge * moves) {
+    // Uses the same move generator as alpha-beta, so urgent moves and isomorphic moves are handled the same way.
+    UnscoredState state;
+    bitboardToUnscoredState(&state, &node->board);
+
+    if (pnArena.first == NULL)
+        initArena(&pnArena, 64 * 1024);
+
+    ArenaMark mark = getArenaMark(&pnArena);
+    SCGraph graph;
+    unscoredStateToArenaSCGraph(&graph, &state, &pnArena);
+    short numMoves = getGraphsPotentialMoves(&graph, moves);
+    resetArenaToMark(&pnArena, mark);
+
+    for (short i=0; i < numMoves; i++) {
+        // The move might be a corner move in which case it may need to be converted
+        if (isEdgeTaken(&state, moves[i]))
+            moves[i] = getCorrespondingCornerEdge(moves[i]);
+
+        children[i] = *node;
+        short numBoxesTaken = makeBitboardMove(&children[i].board, moves[i]);
+
+        if (numBoxesTaken == 0)
+            children[i].isOr = !node->isOr;
+        else if (node->isOr)
+            children[i].need -= numBoxesTaken;
+    }
+
+    return numMoves;
+}
+
+static unsigned int addPN(unsigned int a, unsigned int b) {
+    return a + b >= PN_INFINITY ? PN_INFINITY : a + b;
+}
+
+static void searchPN(PNSearch * search, const PNNode * node, unsigned int proofThreshold, unsigned int disproofThreshold) {
+    // Expands node until its proof number reaches proofThreshold or its disproof number reaches disproofThreshold.
+    search->nodesVisited++;
+    if ((search->nodesVisited & 1023) == 0 && getTimeMillis() > search->endTime)
+        search->isOutOfTime = true;
+
+    bool isProven;
+    if (search->isOutOfTime || getPNTerminalValue(node, &isProven))
+        return;
+
+    PNNode children[NUM_EDGES];
+    Edge moves[NUM_EDGES];
+    short numChildren = getPNChildren(node, children, moves);
+
+    while (true) {
+        // The proof numbers of an OR node come from its easiest child to prove and its disproof numbers
+        // from all of its children. It's the other way round for AND nodes.
+        unsigned int proof = node->isOr ? PN_INFINITY : 0;
+        unsigned int disproof = node->isOr ? 0 : PN_INFINITY;
+        short bestChild = 0;
+        unsigned int bestValue = PN_INFINITY + 1;
+        unsigned int secondBestValue = PN_INFINITY;
+        unsigned int bestChildProof = 0;
+        unsigned int bestChildDisproof = 0;
+
+        for (short i=0; i < numChildren; i++) {
+            unsigned int childProof, childDisproof;
+            lookupPN(search, &children[i], &childProof, &childDisproof);
+
+            unsigned int value;
+            if (node->isOr) {
+                proof = min(proof, childProof);
+                disproof = addPN(disproof, childDisproof);
+                value = childProof;
+            }
+            else {
+                proof = addPN(proof, childProof);
+                disproof = min(disproof, childDisproof);
+                value = childDisproof;
+            }
+
+            if (value < bestValue) {
+                secondBestValue = bestValue;
+                bestValue = value;
+                bestChild = i;
+                bestChildProof = childProof;
+                bestChildDisproof = childDisproof;
+            }
+            else if (value < secondBestValue)
+                secondBestValue = value;
+        }
+
+        if (proof >= proofThreshold || disproof >= disproofThreshold || search->isOutOfTime) {
+            storePN(node, proof, disproof);
+            return;
+        }
+
+        unsigned int childProofThreshold, childDisproofThreshold;
+        if (node->isOr) {
+            childProofThreshold = min(proofThreshold, addPN(secondBestValue, 1));
+            childDisproofThreshold = disproofThreshold - disproof + bestChildDisproof;
+        }
+        else {
+            childProofThreshold = proofThreshold - proof + bestChildProof;
+            childDisproofThreshold = min(disproofThreshold, addPN(secondBestValue, 1));
+        }
+
+        searchPN(search, &children[bestChild], childProofThreshold, childDisproofThreshold);
+    }
+}
+
+static Edge getPNHeuristicMove(const PNNode * root) {
+    // The move after which the side to move can expect the most boxes according to the static evaluation.
+    PNNode children[NUM_EDGES];
+    Edge moves[NUM_EDGES];
+    short numChildren = getPNChildren(root, children, moves);
+
+    Edge bestMove = NO_EDGE;
+    short bestValue = -1;
+    for (short i=0; i < numChildren; i++) {
+        short boxesLeft = getBitboardNumBoxesLeft(&children[i].board);
+        short moverBoxes = getBitboardStaticEvaluation(&children[i].board);
+        short value = (root->need - children[i].need) + (children[i].isOr ? moverBoxes : boxesLeft - moverBoxes);
+
+        if (value > bestValue) {
+            bestValue = value;
+            bestMove = moves[i];
+        }
+    }
+
+    return bestMove;
+}
+
+ProofResult getProofResult(const UnscoredState * state, short target, int runTimeMillis, Edge * move) {
+    // Works out whether the side to move can get at least target of the remaining boxes.
+    // move is set to a proving move if there is one, and to the best heuristic move otherwise.
+    PNNode root;
+    unscoredStateToBitboard(&root.board, state);
+    root.need = target;
+    root.isOr = true;
+
+    PNSearch search;
+    search.endTime = getTimeMillis() + runTimeMillis;
+    search.nodesVisited = 0;
+    search.tableHits = 0;
+    search.isOutOfTime = false;
+
+    unsigned long long startTime = getTimeMillis();
+    searchPN(&search, &root, PN_INFINITY, PN_INFINITY);
+
+    unsigned int proof, disproof;
+    lookupPN(&search, &root, &proof, &disproof);
+
+    ProofResult result = PROOF_UNKNOWN;
+    if (proof == 0)
+        result = PROOF_PROVEN;
+    else if (disproof == 0)
+        result = PROOF_DISPROVEN;
+
+    *move = NO_EDGE;
+    if (result == PROOF_PROVEN && getBitboardNumFreeEdges(&root.board) > 0) {
+        PNNode children[NUM_EDGES];
+        Edge moves[NUM_EDGES];
+        short numChildren = getPNChildren(&root, children, moves);
+
+        for (short i=0; i < numChildren && *move == NO_EDGE; i++) {
+            unsigned int childProof, childDisproof;
+            lookupPN(&search, &children[i], &childProof, &childDisproof);
+            if (childProof == 0)
+                *move = moves[i];
+        }
+    }
+
+    if (*move == NO_EDGE && getBitboardNumFreeEdges(&root.board) > 0)
+        *move = getPNHeuristicMove(&root);
+
+    log_log("getProofResult: Target %d is %s. Time spent: %llu, Nodes visited: %d, Table hits: %d\n",
+        target,
+        result == PROOF_PROVEN ? "proven" : (result == PROOF_DISPROVEN ? "disproven" : "unknown"),
+        getTimeMillis() - startTime, search.nodesVisited, search.tableHits);
+
+    return result;
+}
+
+Edge getPNMove(const UnscoredState * state, short target, int runTimeMillis) {
+    Edge move;
+    getProofResult(state, target, runTimeMillis, &move);
+
+    return move;
+}
+
+void runProofNumberTests() {
+    log_log("RUNNING PROOF NUMBER TESTS\n");
+
+    UnscoredState state;
+    Edge move;
+
+    log_log("Testing getProofResult...\n");
+    log_debug("It should prove that the last box can be taken.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111111110");
+    assert(getProofResult(&state, 1, 1000, &move) == PROOF_PROVEN);
+    assert(move == 71);
+
+    log_debug("It should disprove taking the last box when it has to be given away.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111101110");
+    assert(getProofResult(&state, 1, 1000, &move) == PROOF_DISPROVEN);
+    assert(move == 67 || move == 71);
+
+    log_debug("It should prove any target of 0 boxes.\n");
+    assert(getProofResult(&state, 0, 1000, &move) == PROOF_PROVEN);
+
+    log_debug("It should find that only 2 boxes can be had when two long chains must be opened.\n");
+    // Rows 0 and 1 are chains of 8, the opponent double-deals the first one.
+    stringToUnscoredState(&state, "111111110000000001111111100000000011111111111111111111111111111111111111");
+    assert(getProofResult(&state, 2, 10000, &move) == PROOF_PROVEN);
+    assert(getProofResult(&state, 3, 10000, &move) == PROOF_DISPROVEN);
+
+    log_debug("It should prove that both boxes of a short chain can be taken.\n");
+    // Box 0 has edges 8 and 9 free and box 1 only edge 9, so either move starts taking both.
+    stringToUnscoredState(&state, "111111110011111111111111111111111111111111111111111111111111111111111111");
+    assert(getProofResult(&state, 2, 1000, &move) == PROOF_PROVEN);
+    assert(move == 8 || move == 9);
+
+    log_debug("It should return a move even when it runs out of time.\n");
+    stringToUnscoredState(&state, "000000000000000000000000000000000000000000000000000000000000000000000000");
+    assert(getProofResult(&state, 15, 1, &move) == PROOF_UNKNOWN);
+    assert(move != NO_EDGE);
+
+    log_log("PROOF NUMBER TESTS COMPLETED\n\n");
+}
@@ -0,0 +1,17 @@
+#ifndef PROOFNUMBER_H
+#define PROOFNUMBER_H
+
+#include <stdbool.h>
+#include "game_board.h"
+
+typedef enum {
+    PROOF_PROVEN,    // the side to move can get at least the target number of boxes
+    PROOF_DISPROVEN, // the opponent can always stop it
+    PROOF_UNKNOWN    // ran out of time
+} ProofResult;
+
+ProofResult getProofResult(const UnscoredState * state, short target, int runTimeMillis, Edge * move);
+Edge getPNMove(const UnscoredState * state, short target, int runTimeMillis);
+void runProofNumberTests();
+
+#endif
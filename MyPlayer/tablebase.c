@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "game_board.h"
+#include "util.h"
+#include "bitboard.h"
+#include "tablebase.h"
+
+static unsigned long long binomials[NUM_EDGES+1][TABLEBASE_MAX_FREE_EDGES+2];
+static bool binomialsInitialised = false;
+
+// The currently loaded (mmap'd) tablebase.
+static const signed char * tablebaseData = NULL;
+static size_t tablebaseSize = 0;
+static short tablebaseMaxFreeEdges = -1;
+
+typedef struct TablebaseWorker {
+    short numFreeEdges;
+    unsigned long long startRank;
+    unsigned long long endRank;
+    const signed char * prevLevel; // values for positions with one fewer free edge
+    signed char * level;
+} TablebaseWorker;
+
+static void initBinomials() {
+    if (binomialsInitialised)
+        return;
+
+    for (short n=0; n <= NUM_EDGES; n++) {
+        binomials[n][0] = 1;
+        for (short k=1; k <= TABLEBASE_MAX_FREE_EDGES+1; k++) {
+            if (n == 0)
+                binomials[n][k] = 0;
+            else
+                binomials[n][k] = binomials[n-1][k-1] + binomials[n-1][k];
+        }
+    }
+
+    binomialsInitialised = true;
+}
+
+static size_t getLevelOffset(short numFreeEdges) {
+    // Where the values for positions with numFreeEdges free edges start in the file.
+    size_t offset = sizeof(TablebaseHeader);
+
+    for (short k=0; k < numFreeEdges; k++)
+        offset += binomials[NUM_EDGES][k];
+
+    return offset;
+}
+
+static unsigned long long getFreeEdgesRank(const Edge * freeEdges, short numFreeEdges) {
+    // Colex rank of an ascending list of edges.
+    unsigned long long rank = 0;
+
+    for (short i=0; i < numFreeEdges; i++)
+        rank += binomials[freeEdges[i]][i+1];
+
+    return rank;
+}
+
+static void unrankFreeEdges(unsigned long long rank, short numFreeEdges, Edge * freeEdges) {
+    Edge e = NUM_EDGES;
+
+    for (short i=numFreeEdges-1; i >= 0; i--) {
+        do {
+            e--;
+        } while (binomials[e][i+1] > rank);
+
+        freeEdges[i] = e;
+        rank -= binomials[e][i+1];
+    }
+}
+
+static void getNextFreeEdges(Edge * freeEdges, short numFreeEdges) {
+    // Steps to the edge list with the next colex rank.
+    for (short i=0; i < numFreeEdges; i++) {
+        Edge limit = (i == numFreeEdges-1) ? NUM_EDGES : freeEdges[i+1];
+
+        if (freeEdges[i] + 1 < limit) {
+            freeEdges[i]++;
+            for (short j=0; j < i; j++)
+                freeEdges[j] = j;
+            return;
+        }
+    }
+}
+
+static void freeEdgesToBitboard(Bitboard * board, const Edge * freeEdges, short numFreeEdges) {
+    board->lo = ~0ULL;
+    board->hi = BITBOARD_HI_MASK;
+
+    for (short i=0; i < numFreeEdges; i++)
+        setBitboardEdgeFree(board, freeEdges[i]);
+}
+
+static signed char solvePosition(const Edge * freeEdges, short numFreeEdges, const signed char * prevLevel) {
+    // Negamax over the moves of one position, reading the children from the previous level.
+    Bitboard board;
+    freeEdgesToBitboard(&board, freeEdges, numFreeEdges);
+
+    // prefix[i] is the rank contribution of freeEdges[0..i-1] once they keep their position,
+    // suffix[i] that of freeEdges[i..] once they shift down by one.
+    unsigned long long prefix[TABLEBASE_MAX_FREE_EDGES+1];
+    unsigned long long suffix[TABLEBASE_MAX_FREE_EDGES+1];
+    prefix[0] = 0;
+    for (short i=0; i < numFreeEdges; i++)
+        prefix[i+1] = prefix[i] + binomials[freeEdges[i]][i+1];
+    suffix[numFreeEdges] = 0;
+    for (short i=numFreeEdges-1; i >= 0; i--)
+        suffix[i] = suffix[i+1] + binomials[freeEdges[i]][i];
+
+    short bestValue = -NUM_BOXES - 1;
+    for (short j=0; j < numFreeEdges; j++) {
+        Bitboard childBoard = board;
+        short numBoxesTaken = makeBitboardMove(&childBoard, freeEdges[j]);
+        short childValue = prevLevel[prefix[j] + suffix[j+1]];
+
+        short value = numBoxesTaken > 0 ? numBoxesTaken + childValue : -childValue;
+        if (value > bestValue)
+            bestValue = value;
+    }
+
+    return (signed char)bestValue;
+}
+
+static void * runTablebaseWorker(void * arg) {
+    TablebaseWorker * worker = (TablebaseWorker *)arg;
+    if (worker->startRank >= worker->endRank)
+        return NULL;
+
+    Edge freeEdges[TABLEBASE_MAX_FREE_EDGES];
+    unrankFreeEdges(worker->startRank, worker->numFreeEdges, freeEdges);
+
+    for (unsigned long long rank=worker->startRank; rank < worker->endRank; rank++) {
+        worker->level[rank] = solvePosition(freeEdges, worker->numFreeEdges, worker->prevLevel);
+        getNextFreeEdges(freeEdges, worker->numFreeEdges);
+    }
+
+    return NULL;
+}
+
+bool generateTablebase(const char * filePath, short maxFreeEdges, int numThreads) {
+    // Retrograde construction: every position with k free edges only depends on positions
+    // with k-1 free edges, so the levels are built bottom up and written out as they complete.
+    initBinomials();
+    assert(maxFreeEdges >= 0 && maxFreeEdges <= TABLEBASE_MAX_FREE_EDGES);
+    assert(numThreads > 0);
+
+    FILE * file = fopen(filePath, "wb");
+    if (file == NULL) {
+        log_error("[ERROR] generateTablebase: Could not open %s for writing.\n", filePath);
+        return false;
+    }
+
+    TablebaseHeader header;
+    memset(&header, 0, sizeof(TablebaseHeader));
+    strcpy(header.magic, TABLEBASE_MAGIC);
+    header.numEdges = NUM_EDGES;
+    header.maxFreeEdges = maxFreeEdges;
+    fwrite(&header, sizeof(TablebaseHeader), 1, file);
+
+    signed char * prevLevel = NULL;
+    TablebaseWorker workers[numThreads];
+    pthread_t threads[numThreads];
+
+    for (short k=0; k <= maxFreeEdges; k++) {
+        unsigned long long numPositions = binomials[NUM_EDGES][k];
+        unsigned long long startTime = getTimeMillis();
+
+        signed char * level = (signed char *)malloc(numPositions);
+        if (level == NULL) {
+            log_error("[ERROR] generateTablebase: Could not allocate %llu bytes for level %d.\n", numPositions, k);
+            free(prevLevel);
+            fclose(file);
+            return false;
+        }
+
+        if (k == 0)
+            level[0] = 0; // nothing left to play for
+        else {
+            unsigned long long sliceSize = (numPositions + numThreads - 1) / numThreads;
+
+            for (int t=0; t < numThreads; t++) {
+                workers[t].numFreeEdges = k;
+                // Ranks don't fit in an int from 8 free edges on, so util.h's min won't do.
+                unsigned long long startRank = t * sliceSize;
+                unsigned long long endRank = (t+1) * sliceSize;
+                workers[t].startRank = startRank < numPositions ? startRank : numPositions;
+                workers[t].endRank = endRank < numPositions ? endRank : numPositions;
+                workers[t].prevLevel = prevLevel;
+                workers[t].level = level;
+                pthread_create(&threads[t], NULL, runTablebaseWorker, &workers[t]);
+            }
+
+            for (int t=0; t < numThreads; t++)
+                pthread_join(threads[t], NULL);
+        }
+
+        fwrite(level, 1, numPositions, file);
+        log_log("generateTablebase: Level %d done. %llu positions in %llu ms.\n", k, numPositions, getTimeMillis() - startTime);
+
+        free(prevLevel);
+        prevLevel = level;
+    }
+
+    free(prevLevel);
+    fclose(file);
+    return true;
+}
+
+bool loadTablebase(const char * filePath) {
+    initBinomials();
+    unloadTablebase();
+
+    int fd = open(filePath, O_RDONLY);
+    if (fd < 0) {
+        log_warn("[WARN] loadTablebase: Could not open %s.\n", filePath);
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(TablebaseHeader)) {
+        log_warn("[WARN] loadTablebase: %s is too small to be a tablebase.\n", filePath);
+        close(fd);
+        return false;
+    }
+
+    void * data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        log_warn("[WARN] loadTablebase: Could not mmap %s.\n", filePath);
+        return false;
+    }
+
+    const TablebaseHeader * header = (const TablebaseHeader *)data;
+    if (memcmp(header->magic, TABLEBASE_MAGIC, sizeof(header->magic)) != 0 || // the file may not end it in a NUL
+            header->numEdges != NUM_EDGES ||
+            header->maxFreeEdges < 0 ||
+            header->maxFreeEdges > TABLEBASE_MAX_FREE_EDGES ||
+            (size_t)fileStat.st_size < getLevelOffset(header->maxFreeEdges + 1)) {
+        log_warn("[WARN] loadTablebase: %s is not a tablebase for this board.\n", filePath);
+        munmap(data, fileStat.st_size);
+        return false;
+    }
+
+    tablebaseData = (const signed char *)data;
+    tablebaseSize = fileStat.st_size;
+    tablebaseMaxFreeEdges = header->maxFreeEdges;
+
+    log_log("loadTablebase: Loaded %s covering positions with up to %d free edges.\n", filePath, tablebaseMaxFreeEdges);
+    return true;
+}
+
+void unloadTablebase() {
+    if (tablebaseData != NULL)
+        munmap((void *)tablebaseData, tablebaseSize);
+
+    tablebaseData = NULL;
+    tablebaseSize = 0;
+    tablebaseMaxFreeEdges = -1;
+}
+
+short getTablebaseMaxFreeEdges() {
+    // -1 when no tablebase is loaded.
+    return tablebaseMaxFreeEdges;
+}
+
+bool probeTablebase(const Bitboard * board, short * netScore) {
+    // Sets netScore to the exact result for the player to move, if the position is covered.
+    short numFreeEdges = getBitboardNumFreeEdges(board);
+    if (numFreeEdges > tablebaseMaxFreeEdges)
+        return false;
+
+    Edge freeEdges[NUM_EDGES];
+    getBitboardFreeEdges(board, freeEdges);
+
+    *netScore = tablebaseData[getLevelOffset(numFreeEdges) + getFreeEdgesRank(freeEdges, numFreeEdges)];
+    return true;
+}
+
+Edge getTablebaseMove(const UnscoredState * state) {
+    // Returns a perfect move, or NO_EDGE if the position isn't covered by the loaded tablebase.
+    Bitboard board;
+    unscoredStateToBitboard(&board, state);
+
+    short numFreeEdges = getBitboardNumFreeEdges(&board);
+    if (numFreeEdges == 0 || numFreeEdges > tablebaseMaxFreeEdges)
+        return NO_EDGE;
+
+    Edge freeEdges[NUM_EDGES];
+    getBitboardFreeEdges(&board, freeEdges);
+
+    Edge bestMove = NO_EDGE;
+    short bestValue = -NUM_BOXES - 1;
+    for (short i=0; i < numFreeEdges; i++) {
+        Bitboard childBoard = board;
+        short numBoxesTaken = makeBitboardMove(&childBoard, freeEdges[i]);
+
+        short childValue;
+        probeTablebase(&childBoard, &childValue);
+
+        short value = numBoxesTaken > 0 ? numBoxesTaken + childValue : -childValue;
+        if (value > bestValue) {
+            bestValue = value;
+            bestMove = freeEdges[i];
+        }
+    }
+
+    log_log("getTablebaseMove: Move %d is worth %d for the player to move.\n", bestMove, bestValue);
+    return bestMove;
+}
+
+static short solveByBruteForce(Bitboard * board) {
+    // Plain negamax, used to check the tablebase on small positions.
+    short bestValue = -NUM_BOXES - 1;
+    bool hasMove = false;
+
+    for (Edge e=0; e < NUM_EDGES; e++) {
+        if (isBitboardEdgeTaken(board, e))
+            continue;
+
+        hasMove = true;
+        Bitboard childBoard = *board;
+        short numBoxesTaken = makeBitboardMove(&childBoard, e);
+        short childValue = solveByBruteForce(&childBoard);
+
+        short value = numBoxesTaken > 0 ? numBoxesTaken + childValue : -childValue;
+        if (value > bestValue)
+            bestValue = value;
+    }
+
+    return hasMove ? bestValue : 0;
+}
+
+void runTablebaseTests() {
+    log_log("RUNNING TABLEBASE TESTS\n");
+    initBinomials();
+
+    log_log("Testing unrankFreeEdges...\n");
+    log_debug("It should invert getFreeEdgesRank and agree with getNextFreeEdges.\n");
+    Edge freeEdges[3];
+    Edge nextFreeEdges[3];
+    unrankFreeEdges(0, 3, nextFreeEdges);
+    for (unsigned long long rank=0; rank < binomials[NUM_EDGES][3]; rank += 997) {
+        unrankFreeEdges(rank, 3, freeEdges);
+        assert(freeEdges[0] < freeEdges[1] && freeEdges[1] < freeEdges[2]);
+        assert(getFreeEdgesRank(freeEdges, 3) == rank);
+
+        unrankFreeEdges(rank + 1, 3, nextFreeEdges);
+        getNextFreeEdges(freeEdges, 3);
+        if (rank + 1 < binomials[NUM_EDGES][3])
+            assert(memcmp(freeEdges, nextFreeEdges, sizeof(freeEdges)) == 0);
+    }
+
+    log_log("Testing generateTablebase and loadTablebase...\n");
+    const char * filePath = "/tmp/deepbox_test_tablebase.dbt";
+    assert(generateTablebase(filePath, 3, 2));
+    assert(loadTablebase(filePath));
+    assert(getTablebaseMaxFreeEdges() == 3);
+
+    log_log("Testing probeTablebase...\n");
+    UnscoredState state;
+    Bitboard board;
+    short netScore;
+
+    log_debug("It should score the last box for the player who completes it.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111111110");
+    unscoredStateToBitboard(&board, &state);
+    assert(probeTablebase(&board, &netScore));
+    assert(netScore == 1);
+
+    log_debug("It should give the last box away when two of its edges are free.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111101110"); // edges 67 and 71 of box 27
+    unscoredStateToBitboard(&board, &state);
+    assert(probeTablebase(&board, &netScore));
+    assert(netScore == -1);
+
+    log_debug("It should not cover positions with more free edges than were generated.\n");
+    stringToUnscoredState(&state, "111111111111111111111111111111111111111111111111111111111111111111110000");
+    unscoredStateToBitboard(&board, &state);
+    assert(!probeTablebase(&board, &netScore));
+
+    log_debug("It should agree with a brute force search on positions with 3 free edges.\n");
+    for (unsigned long long rank=0; rank < binomials[NUM_EDGES][3]; rank += 211) {
+        unrankFreeEdges(rank, 3, freeEdges);
+        freeEdgesToBitboard(&board, freeEdges, 3);
+        assert(probeTablebase(&board, &netScore));
+        assert(netScore == solveByBruteForce(&board));
+    }
+
+    log_log("Testing getTablebaseMove...\n");
+    log_debug("It should complete a box rather than give one away.\n");
+    // Edge 71 completes box 27. Edges 0 and 8 are the last two edges of box 0.
+    stringToUnscoredState(&state, "011111110111111111111111111111111111111111111111111111111111111111111110");
+    assert(getTablebaseMove(&state) == 71);
+
+    unloadTablebase();
+    assert(getTablebaseMaxFreeEdges() == -1);
+
+    log_debug("It should reject a file whose magic isn't ended by a NUL.\n");
+    FILE * file = fopen(filePath, "r+b");
+    fwrite("DBXTB01X", 1, 8, file);
+    fclose(file);
+    assert(!loadTablebase(filePath));
+    assert(getTablebaseMaxFreeEdges() == -1);
+    unlink(filePath);
+
+    log_log("TABLEBASE TESTS COMPLETED\n\n");
+}
@@ -0,0 +1,29 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <stdbool.h>
+#include "game_board.h"
+#include "bitboard.h"
+
+// The tablebase file is this header followed by one signed char per position for every
+// level k = 0 .. maxFreeEdges. Positions with k free edges are stored at the colex rank of
+// their sorted free edges. Each value is the net score (boxes won minus boxes lost) the
+// player to move gets from the rest of the game under perfect play.
+#define TABLEBASE_MAGIC "DBXTB01"
+#define TABLEBASE_MAX_FREE_EDGES 12 // way past anything that fits in memory, but keeps the binomial table small
+
+typedef struct TablebaseHeader {
+    char magic[8];
+    int numEdges;
+    int maxFreeEdges;
+} TablebaseHeader;
+
+bool generateTablebase(const char * filePath, short maxFreeEdges, int numThreads);
+bool loadTablebase(const char * filePath);
+void unloadTablebase();
+short getTablebaseMaxFreeEdges();
+bool probeTablebase(const Bitboard * board, short * netScore);
+Edge getTablebaseMove(const UnscoredState * state);
+void runTablebaseTests();
+
+#endif
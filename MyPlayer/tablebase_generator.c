@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "game_board.h"
+#include "tablebase.h"
+#include "util.h"
+
+int LOG_LEVEL = LOG_LEVEL_LOG;
+
+int main(int argc, char ** argv) {
+    // Offline generator for the endgame tablebase loaded by bin/client -e.
+    char * filePath = "endgame.dbt";
+    short maxFreeEdges = 5;
+    int numThreads = 4;
+
+    int option;
+    while((option = getopt(argc, argv, "o:k:j:")) != -1) {
+        switch(option) {
+            case 'o':
+                filePath = optarg;
+                break;
+            case 'k':
+                maxFreeEdges = atoi(optarg);
+                break;
+            case 'j':
+                numThreads = atoi(optarg);
+                break;
+        }
+    }
+
+    if (maxFreeEdges < 0 || maxFreeEdges > TABLEBASE_MAX_FREE_EDGES || numThreads < 1) {
+        fprintf(stderr, "Usage: %s [-o file] [-k max free edges, 0-%d] [-j threads]\n", argv[0], TABLEBASE_MAX_FREE_EDGES);
+        exit(1);
+    }
+
+    log_log("Generating tablebase for positions with up to %d free edges into %s using %d threads.\n", maxFreeEdges, filePath, numThreads);
+
+    if (!generateTablebase(filePath, maxFreeEdges, numThreads))
+        exit(1);
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "game_board.h"
+#include "util.h"
+#include "bitboard.h"
+#include "treewriter.h"
+
+bool openTreeWriter(TreeWriter * writer, const TreeWriterSettings * settings, const char * searchName, const UnscoredState * rootState) {
+    // Starts a new file, replacing whatever tree was written there before.
+    writer->file = fopen(settings->filePath, "w");
+    writer->settings = *settings;
+    writer->nextId = 0;
+    writer->numNodesWritten = 0;
+
+    if (writer->file == NULL) {
+        log_error("[ERROR] openTreeWriter: Could not open %s.\n", settings->filePath);
+        return false;
+    }
+
+    char stateString[NUM_EDGES+1];
+    for(short i=0; i<NUM_EDGES; i++)
+        stateString[i] = isEdgeTaken(rootState, i) ? '1' : '0';
+    stateString[NUM_EDGES] = '\0';
+
+    fprintf(writer->file, "{\"search\":\"%s\",\"root\":\"%s\",\"maxDepth\":%d,\"minVisits\":%d}\n",
+        searchName, stateString, settings->maxDepth, settings->minVisits);
+
+    return true;
+}
+
+void closeTreeWriter(TreeWriter * writer) {
+    if (writer->file == NULL)
+        return;
+
+    fclose(writer->file);
+    writer->file = NULL;
+    log_log("closeTreeWriter: Wrote %d nodes to %s.\n", writer->numNodesWritten, writer->settings.filePath);
+}
+
+int getNewTreeNodeId(TreeWriter * writer) {
+    return writer->nextId++;
+}
+
+bool isTreeNodeSampled(const TreeWriter * writer, short depth, int visits) {
+    return writer->file != NULL && depth <= writer->settings.maxDepth && visits >= writer->settings.minVisits;
+}
+
+void beginTreeNode(TreeWriter * writer, int id, int parentId, short depth, Edge move, const Bitboard * board) {
+    // Starts the node's line with the fields every node has. The state is the board as two words,
+    // which is a quarter of the size of the edge string the root gets.
+    fprintf(writer->file, "{\"id\":%d,\"parent\":%d,\"depth\":%d,\"move\":%d,\"state\":\"%02llx%016llx\"",
+        id, parentId, depth, move, board->hi, board->lo);
+    writer->numNodesWritten++;
+}
+
+void writeTreeNodeInt(TreeWriter * writer, const char * key, long value) {
+    fprintf(writer->file, ",\"%s\":%ld", key, value);
+}
+
+void writeTreeNodeDouble(TreeWriter * writer, const char * key, double value) {
+    fprintf(writer->file, ",\"%s\":%g", key, value);
+}
+
+void writeTreeNodeBool(TreeWriter * writer, const char * key, bool value) {
+    fprintf(writer->file, ",\"%s\":%s", key, value ? "true" : "false");
+}
+
+void endTreeNode(TreeWriter * writer) {
+    fprintf(writer->file, "}\n");
+}
+
+void runTreeWriterTests() {
+    log_log("RUNNING TREE WRITER TESTS\n");
+
+    const char * filePath = "/tmp/deepbox_test_tree.json";
+    TreeWriterSettings settings = { filePath, 1, 5 };
+    TreeWriter writer;
+
+    UnscoredState state;
+    stringToUnscoredState(&state, "100000000000000000000000000000000000000000000000000000000000000000000001");
+    Bitboard board;
+    unscoredStateToBitboard(&board, &state);
+
+    log_log("Testing openTreeWriter...\n");
+    log_debug("It should start the file with a description of the search.\n");
+    assert(openTreeWriter(&writer, &settings, "test", &state));
+
+    log_log("Testing isTreeNodeSampled...\n");
+    log_debug("It should leave out nodes which are too deep or visited too little.\n");
+    assert(isTreeNodeSampled(&writer, 1, 5));
+    assert(!isTreeNodeSampled(&writer, 2, 5));
+    assert(!isTreeNodeSampled(&writer, 1, 4));
+
+    log_log("Testing beginTreeNode...\n");
+    log_debug("It should write a line for every node with its fields in order.\n");
+    int rootId = getNewTreeNodeId(&writer);
+    int childId = getNewTreeNodeId(&writer);
+    assert(rootId == 0 && childId == 1);
+
+    beginTreeNode(&writer, childId, rootId, 1, 71, &board);
+    writeTreeNodeInt(&writer, "visits", 7);
+    writeTreeNodeDouble(&writer, "totalScore", 2.5);
+    writeTreeNodeBool(&writer, "isMaximizer", false);
+    endTreeNode(&writer);
+
+    beginTreeNode(&writer, rootId, -1, 0, NO_EDGE, &board);
+    endTreeNode(&writer);
+    closeTreeWriter(&writer);
+    assert(writer.numNodesWritten == 2);
+
+    FILE * file = fopen(filePath, "r");
+    assert(file != NULL);
+    char line[512];
+    assert(fgets(line, sizeof(line), file) != NULL);
+    assert(strcmp(line, "{\"search\":\"test\",\"root\":\"100000000000000000000000000000000000000000000000000000000000000000000001\",\"maxDepth\":1,\"minVisits\":5}\n") == 0);
+    assert(fgets(line, sizeof(line), file) != NULL);
+    assert(strcmp(line, "{\"id\":1,\"parent\":0,\"depth\":1,\"move\":71,\"state\":\"800000000000000001\",\"visits\":7,\"totalScore\":2.5,\"isMaximizer\":false}\n") == 0);
+    assert(fgets(line, sizeof(line), file) != NULL);
+    assert(strcmp(line, "{\"id\":0,\"parent\":-1,\"depth\":0,\"move\":100,\"state\":\"800000000000000001\"}\n") == 0);
+    assert(fgets(line, sizeof(line), file) == NULL);
+    fclose(file);
+    remove(filePath);
+
+    log_debug("It should not write anything when the file can't be opened.\n");
+    settings.filePath = "/nonexistent/deepbox_test_tree.json";
+    assert(!openTreeWriter(&writer, &settings, "test", &state));
+    assert(!isTreeNodeSampled(&writer, 0, 5));
+    closeTreeWriter(&writer);
+
+    log_log("TREE WRITER TESTS COMPLETED\n\n");
+}
@@ -0,0 +1,41 @@
+#ifndef TREEWRITER_H
+#define TREEWRITER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "game_board.h"
+#include "bitboard.h"
+
+// Writes a search tree as it is searched, one line of JSON per node, so nothing is kept in memory.
+// The first line describes the search:
+//     {"search":"alpha_beta","root":"0110...","maxDepth":6,"minVisits":0}
+// and every sampled node follows as
+//     {"id":3,"parent":1,"depth":2,"move":25,"state":"<18 hex digits>", ...}
+// where bit e of state is set when edge e is taken, the root's parent is -1 and nodes reached
+// without a single move (such as whole capture sequences) have move NO_EDGE. A node may be
+// written before or after its children, so readers should collect every line before linking them.
+typedef struct TreeWriterSettings {
+    const char * filePath;
+    short maxDepth;  // nodes deeper than this are left out, and so are their children
+    int minVisits;   // nodes visited fewer times than this are left out
+} TreeWriterSettings;
+
+typedef struct TreeWriter {
+    FILE * file;
+    TreeWriterSettings settings;
+    int nextId;
+    int numNodesWritten;
+} TreeWriter;
+
+bool openTreeWriter(TreeWriter * writer, const TreeWriterSettings * settings, const char * searchName, const UnscoredState * rootState);
+void closeTreeWriter(TreeWriter * writer);
+int getNewTreeNodeId(TreeWriter * writer);
+bool isTreeNodeSampled(const TreeWriter * writer, short depth, int visits);
+void beginTreeNode(TreeWriter * writer, int id, int parentId, short depth, Edge move, const Bitboard * board);
+void writeTreeNodeInt(TreeWriter * writer, const char * key, long value);
+void writeTreeNodeDouble(TreeWriter * writer, const char * key, double value);
+void writeTreeNodeBool(TreeWriter * writer, const char * key, bool value);
+void endTreeNode(TreeWriter * writer);
+void runTreeWriterTests();
+
+#endif
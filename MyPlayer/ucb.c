@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <math.h>
+#include "game_board.h"
+#include "util.h"
+#include "ucb.h"
+
+// UCB1 for child i is totalScores[i]/visits[i] + exploration * sqrt(2*log(parentVisits)/visits[i]).
+// The parent's part, exploration * sqrt(2*log(parentVisits)), is worked out once per call, which
+// leaves a division and a square root per child:
+//     mean + parentTerm * sqrt(1/visits)
+// The vector kernels do exactly the same float operations as the scalar loop, so they pick the same
+// child, including the first of several with equal values.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UCB_X86
+#include <immintrin.h>
+#endif
+
+float getUCB1ParentTerm(int parentVisits, float exploration) {
+    return exploration * sqrtf(2.0f * logf((float)parentVisits));
+}
+
+static void updateBestUCB1Index(const float * totalScores, const int * visits, short from, short to, float parentTerm, short * bestIndex, float * bestValue) {
+    for (short i=from; i < to; i++) {
+        float inverseVisits = 1.0f / (float)visits[i];
+        float value = totalScores[i] * inverseVisits + parentTerm * sqrtf(inverseVisits);
+
+        if (value > *bestValue) {
+            *bestValue = value;
+            *bestIndex = i;
+        }
+    }
+}
+
+short getBestUCB1IndexScalar(const float * totalScores, const int * visits, short numChildren, int parentVisits, float exploration) {
+    assert(numChildren > 0);
+
+    short bestIndex = 0;
+    float bestValue = -INFINITY;
+    updateBestUCB1Index(totalScores, visits, 0, numChildren, getUCB1ParentTerm(parentVisits, exploration), &bestIndex, &bestValue);
+    return bestIndex;
+}
+
+#ifdef UCB_X86
+static void reduceBestUCB1Lanes(const float * laneValues, const int * laneIndices, short numLanes, short * bestIndex, float * bestValue) {
+    // Lanes hold the best of every numLanes-th child, so ties go to the lowest index.
+    for (short i=0; i < numLanes; i++) {
+        if (laneValues[i] > *bestValue || (laneValues[i] == *bestValue && laneIndices[i] < *bestIndex)) {
+            *bestValue = laneValues[i];
+            *bestIndex = laneIndices[i];
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+static short getBestUCB1IndexSSE(const float * totalScores, const int * visits, short numChildren, float parentTerm) {
+    __m128 bestValues = _mm_set1_ps(-INFINITY);
+    __m128i bestIndices = _mm_setzero_si128();
+    __m128i indices = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 parentTerms = _mm_set1_ps(parentTerm);
+    const __m128i step = _mm_set1_epi32(4);
+
+    short i = 0;
+    for (; i + 4 <= numChildren; i += 4) {
+        __m128 inverseVisits = _mm_div_ps(one, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&visits[i])));
+        __m128 values = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&totalScores[i]), inverseVisits), _mm_mul_ps(parentTerms, _mm_sqrt_ps(inverseVisits)));
+
+        __m128 better = _mm_cmpgt_ps(values, bestValues);
+        bestValues = _mm_or_ps(_mm_and_ps(better, values), _mm_andnot_ps(better, bestValues));
+        __m128i betterIndices = _mm_castps_si128(better);
+        bestIndices = _mm_or_si128(_mm_and_si128(betterIndices, indices), _mm_andnot_si128(betterIndices, bestIndices));
+        indices = _mm_add_epi32(indices, step);
+    }
+
+    float laneValues[4];
+    int laneIndices[4];
+    _mm_storeu_ps(laneValues, bestValues);
+    _mm_storeu_si128((__m128i *)laneIndices, bestIndices);
+
+    short bestIndex = 0;
+    float bestValue = -INFINITY;
+    reduceBestUCB1Lanes(laneValues, laneIndices, i > 0 ? 4 : 0, &bestIndex, &bestValue);
+    updateBestUCB1Index(totalScores, visits, i, numChildren, parentTerm, &bestIndex, &bestValue);
+    return bestIndex;
+}
+
+__attribute__((target("avx2")))
+static short getBestUCB1IndexAVX2(const float * totalScores, const int * visits, short numChildren, float parentTerm) {
+    __m256 bestValues = _mm256_set1_ps(-INFINITY);
+    __m256i bestIndices = _mm256_setzero_si256();
+    __m256i indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 parentTerms = _mm256_set1_ps(parentTerm);
+    const __m256i step = _mm256_set1_epi32(8);
+
+    short i = 0;
+    for (; i + 8 <= numChildren; i += 8) {
+        __m256 inverseVisits = _mm256_div_ps(one, _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)&visits[i])));
+        __m256 values = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&totalScores[i]), inverseVisits), _mm256_mul_ps(parentTerms, _mm256_sqrt_ps(inverseVisits)));
+
+        __m256 better = _mm256_cmp_ps(values, bestValues, _CMP_GT_OQ);
+        bestValues = _mm256_blendv_ps(bestValues, values, better);
+        bestIndices = _mm256_blendv_epi8(bestIndices, indices, _mm256_castps_si256(better));
+        indices = _mm256_add_epi32(indices, step);
+    }
+
+    float laneValues[8];
+    int laneIndices[8];
+    _mm256_storeu_ps(laneValues, bestValues);
+    _mm256_storeu_si256((__m256i *)laneIndices, bestIndices);
+
+    short bestIndex = 0;
+    float bestValue = -INFINITY;
+    reduceBestUCB1Lanes(laneValues, laneIndices, i > 0 ? 8 : 0, &bestIndex, &bestValue);
+    updateBestUCB1Index(totalScores, visits, i, numChildren, parentTerm, &bestIndex, &bestValue);
+    return bestIndex;
+}
+
+static bool hasAVX2() {
+    // Only reads what was found out about the CPU at start up, so it is cheap and safe from any thread.
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+short getBestUCB1Index(const float * totalScores, const int * visits, short numChildren, int parentVisits, float exploration) {
+    assert(numChildren > 0);
+    float parentTerm = getUCB1ParentTerm(parentVisits, exploration);
+
+#ifdef UCB_X86
+    // The AVX2 kernel is picked when the CPU running the client has it, whatever the build flags.
+    if (hasAVX2())
+        return getBestUCB1IndexAVX2(totalScores, visits, numChildren, parentTerm);
+    return getBestUCB1IndexSSE(totalScores, visits, numChildren, parentTerm);
+#else
+    short bestIndex = 0;
+    float bestValue = -INFINITY;
+    updateBestUCB1Index(totalScores, visits, 0, numChildren, parentTerm, &bestIndex, &bestValue);
+    return bestIndex;
+#endif
+}
+
+void runUCBTests() {
+    log_log("RUNNING UCB TESTS\n");
+
+    log_log("Testing getBestUCB1Index...\n");
+    log_debug("It should pick the child with the highest UCB1 value.\n");
+    float totalScores[NUM_EDGES];
+    int visits[NUM_EDGES];
+    totalScores[0] = 0.25f; visits[0] = 1;
+    totalScores[1] = 0.75f; visits[1] = 1;
+    totalScores[2] = 0.5f;  visits[2] = 1;
+    assert(getBestUCB1Index(totalScores, visits, 3, 3, 0.7f) == 1);
+    assert(getBestUCB1IndexScalar(totalScores, visits, 3, 3, 0.7f) == 1);
+
+    log_debug("It should favour children which have been visited less.\n");
+    totalScores[1] = 75.0f; visits[1] = 100;
+    totalScores[2] = 0.7f;  visits[2] = 1;
+    assert(getBestUCB1Index(totalScores, visits, 3, 102, 0.7f) == 2);
+
+    log_debug("It should pick the first of several children with equal values.\n");
+    for (short i=0; i < NUM_EDGES; i++) {
+        totalScores[i] = 1.0f;
+        visits[i] = 2;
+    }
+    totalScores[13] = 1.5f;
+    totalScores[21] = 1.5f;
+    assert(getBestUCB1Index(totalScores, visits, NUM_EDGES, 1000, 0.7f) == 13);
+    assert(getBestUCB1Index(totalScores, visits, 13, 1000, 0.7f) == 0);
+
+    log_debug("It should agree with the scalar loop for every number of children.\n");
+    for (short trial=0; trial < 200; trial++) {
+        int parentVisits = 1;
+        for (short i=0; i < NUM_EDGES; i++) {
+            visits[i] = randomInRange(1, 50);
+            totalScores[i] = (float)randomInRange(0, visits[i] * 4) / 4.0f;
+            parentVisits += visits[i];
+        }
+
+        for (short n=1; n <= NUM_EDGES; n++)
+            assert(getBestUCB1Index(totalScores, visits, n, parentVisits, 0.7f) == getBestUCB1IndexScalar(totalScores, visits, n, parentVisits, 0.7f));
+    }
+
+    log_log("UCB TESTS COMPLETED\n\n");
+}
@@ -0,0 +1,11 @@
+#ifndef UCB_H
+#define UCB_H
+
+// Child statistics are kept as arrays, one entry per child, so that a node's children can be scored
+// together. Every child must have been visited at least once.
+float getUCB1ParentTerm(int parentVisits, float exploration);
+short getBestUCB1Index(const float * totalScores, const int * visits, short numChildren, int parentVisits, float exploration);
+short getBestUCB1IndexScalar(const float * totalScores, const int * visits, short numChildren, int parentVisits, float exploration);
+void runUCBTests();
+
+#endif
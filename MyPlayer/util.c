@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <sys/time.h>
+#include <pthread.h>
 #include "util.h"
 
 BTree * newBTree(unsigned int value) {
@@ -74,25 +75,81 @@ unsigned long long getTimeMillis() {
     return tMillis;
 }
 
-int randomInRange(unsigned int min, unsigned int max) {
-    // Credit: http://stackoverflow.com/questions/2509679/how-to-generate-a-random-number-from-within-a-range
-    int r;
+unsigned long long getTimeMicros() {
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    unsigned long long tMicros =
+        (unsigned long long)(t.tv_sec) * 1000000 +
+        (unsigned long long)(t.tv_usec);
+
+    return tMicros;
+}
+
+// Every thread draws from its own xoshiro256** generator, so searches running on several threads
+// neither share nor lock any state. Threads start from the state seedRandom(0) would give them.
+static __thread unsigned long long randomState[4] = {
+    0xe220a8397b1dcdafULL, 0x6e789e6aa1b965f4ULL, 0x06c45d188009454fULL, 0xf88bb8a8724c81ecULL
+};
+
+static unsigned long long splitMix64(unsigned long long * state) {
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void seedRandom(unsigned long long seed) {
+    // Spreads the seed over the whole state, which is never all zero however small the seed.
+    for (short i=0; i < 4; i++)
+        randomState[i] = splitMix64(&seed);
+}
+
+static unsigned long long rotateLeft(unsigned long long x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
 
-    const unsigned int range = 1 + max - min;
-    const unsigned int buckets = RAND_MAX / range;
-    const unsigned int limit = buckets * range;
+unsigned long long getRandom64() {
+    unsigned long long * s = randomState;
+    unsigned long long result = rotateLeft(s[1] * 5, 7) * 9;
+    unsigned long long t = s[1] << 17;
 
-    /* Create equal size buckets all in a row, then fire randomly towards
-     * the buckets until you land in one of them. All buckets are equally
-     * likely. If you land off the end of the line of buckets, try again. */
-    do {
-        r = rand();
-    } while (r >= limit);
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotateLeft(s[3], 45);
 
-    return min + (r / buckets);
+    return result;
 }
 
+int randomInRange(unsigned int min, unsigned int max) {
+    // Lemire's multiply-shift: the top half of a 32-bit draw times the range is a fair pick from the
+    // range once the few draws whose low half falls under 2^32 mod range are thrown away. That
+    // remainder, the only division, is worked out just when the low half is small enough to need it.
+    unsigned int range = max - min + 1;
+    unsigned int r = (unsigned int)(getRandom64() >> 32);
+    if (range == 0) // the whole 32 bits
+        return min + r;
+
+    unsigned long long m = (unsigned long long)r * range;
+    unsigned int low = (unsigned int)m;
+    if (low < range) {
+        unsigned int threshold = -range % range;
+        while (low < threshold) {
+            r = (unsigned int)(getRandom64() >> 32);
+            m = (unsigned long long)r * range;
+            low = (unsigned int)m;
+        }
+    }
+
+    return min + (unsigned int)(m >> 32);
+}
 
+static void * getFirstRandomOnThread(void * arg) {
+    *(unsigned long long *)arg = getRandom64();
+    return NULL;
+}
 
 void runUtilTests() {
     log_log("RUNNING UTIL TESTS\n");
@@ -106,6 +163,42 @@ void runUtilTests() {
     r = randomInRange(0,1);
     assert(r == 0 || r == 1);
 
+    log_debug("It should stay within the interval and reach every value in it.\n");
+    bool seen[7] = {false};
+    for (short i=0; i < 1000; i++) {
+        r = randomInRange(10, 16);
+        assert(r >= 10 && r <= 16);
+        seen[r - 10] = true;
+    }
+    for (short i=0; i < 7; i++)
+        assert(seen[i]);
+
+    log_log("Testing seedRandom...\n");
+    log_debug("It should repeat the same numbers after the same seed.\n");
+    int firstNumbers[8];
+    seedRandom(42);
+    for (short i=0; i < 8; i++)
+        firstNumbers[i] = randomInRange(0, 1000);
+    seedRandom(42);
+    for (short i=0; i < 8; i++)
+        assert(randomInRange(0, 1000) == firstNumbers[i]);
+
+    log_debug("It should give other numbers after another seed.\n");
+    seedRandom(43);
+    bool allSame = true;
+    for (short i=0; i < 8; i++)
+        allSame = allSame && randomInRange(0, 1000) == firstNumbers[i];
+    assert(!allSame);
+
+    log_debug("It should start every thread from the state of seed 0.\n");
+    seedRandom(0);
+    unsigned long long firstRandom = getRandom64();
+    pthread_t thread;
+    unsigned long long threadRandom;
+    pthread_create(&thread, NULL, getFirstRandomOnThread, &threadRandom);
+    pthread_join(thread, NULL);
+    assert(threadRandom == firstRandom);
+
     log_log("Testing newBTree...\n");
     log_debug("It should initialize the values correctly.\n");
     BTree * btRoot = newBTree(3);
@@ -31,6 +31,9 @@ bool doesBTreeContain(BTree * bt, unsigned int value);
 int max(int, int);
 int min(int, int);
 unsigned long long getTimeMillis();
+unsigned long long getTimeMicros();
+void seedRandom(unsigned long long seed);
+unsigned long long getRandom64();
 int randomInRange(unsigned int min, unsigned int max);
 void runUtilTests();
 
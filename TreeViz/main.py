@@ -123,14 +123,57 @@ class ABTree:
     def getJsonData(self):
         return json.dumps(self.tree)
 
+def stateHexToString(stateHex):
+    # Bit e of the hex number is set when edge e is taken.
+    bits = int(stateHex, 16)
+    return "".join("1" if (bits >> e) & 1 else "0" for e in range(72))
+
+def linkTreeLines(lines):
+    # Builds the nested tree out of a file written by the player's tree writer: a line describing
+    # the search and then one line per node, which may come before or after its children.
+    nodes = {}
+    for line in lines:
+        node = json.loads(line)
+        node["address"] = str(node["id"])
+        node["parent"] = "(nil)" if node["parent"] == -1 else str(node["parent"])
+        node["state"] = stateHexToString(node["state"])
+        node["children"] = []
+        nodes[node["id"]] = node
+
+    root = None
+    for node in sorted(nodes.values(), key=lambda n: n["id"]):
+        if node["parent"] == "(nil)":
+            root = node
+        elif int(node["parent"]) in nodes:
+            nodes[int(node["parent"])]["children"].append(node)
+
+    return root
+
+def loadTree(s):
+    # Reads either a streamed tree (one line per node) or a whole tree saved as a single JSON object.
+    lines = [line for line in s.splitlines() if line.strip()]
+    header = json.loads(lines[0])
+    if "search" not in header:
+        tree = ABTree()
+        tree.initFromString(s)
+        return tree
+
+    root = linkTreeLines(lines[1:])
+    if header["search"] == "monte_carlo":
+        tree = MCTSTree()
+    else:
+        tree = ABTree()
+        root.setdefault("value", root.get("bestMove"))
+
+    tree.initFromString(json.dumps(root))
+    return tree
+
 app = flask.Flask(__name__)
 
 @app.route('/')
 def main():
     with open(TREE_FILE, "r") as f:
-        # tree = MCTSTree()
-        tree = ABTree()
-        tree.initFromString(f.read())
+        tree = loadTree(f.read())
 
     data = tree.getJsonData()
     print("tree data: " + data)